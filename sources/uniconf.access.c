@@ -0,0 +1,510 @@
+#include "uniconf.internal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The access profile
+ *
+ * In the sampling mode each n-th getter call counts the node found in the constructed tree.
+ * The counts of the tree are folded into the profile by the paths when the tree is replaced,
+ * the profile may be exported as {"path": count} and loaded back, e.g. at the startup.
+ * The profile counts are kept by the interned paths, the JSON is printed only by the export.
+ *
+ * The reorganize moves the hot children to the front of the object lists,
+ * the hotness of the child is the sum of its subtree, so the lookups of the hot paths walk less.
+ * The constructs reorganize the new tree by the profile before it is published.
+ * The arrays keep their order, the object hashes and the diffs don't depend on it.
+ */
+
+typedef struct uniconf_access_child
+{
+    cJSON *node;
+    uint64_t weight;
+    size_t position;
+} uniconf_access_child_t;
+
+typedef struct uniconf_access_profile
+{
+    uniconf_intern_pool_t *paths; // the keys of the counts
+    uniconf_map_t *counts;        // by the interned path
+} uniconf_access_profile_t;
+
+typedef struct uniconf_access_entry
+{
+    const char *path;
+    uint64_t count;
+} uniconf_access_entry_t;
+
+static int uniconf_access_period = 0;
+static unsigned long uniconf_access_ticks = 0;
+static uniconf_map_t *uniconf_access_counts = NULL; // of the current tree
+static uniconf_access_profile_t uniconf_access_profile = {0};
+static pthread_mutex_t uniconf_access_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Enable|disable the access sampling
+ *
+ * @param period : each period-th getter call is counted, 0 = off
+ */
+void uniconf_access_sampling(int period)
+{
+    uniconf_access_period = (period > 0) ? period : 0;
+}
+
+/**
+ * Count the node got, if sampled
+ *
+ * @param node : of the constructed tree
+ */
+void uniconf_access_count(const cJSON *node)
+{
+    int period = uniconf_access_period;
+    if (!period || !node || __atomic_fetch_add(&uniconf_access_ticks, 1, __ATOMIC_RELAXED) % period)
+    {
+        return;
+    }
+    pthread_mutex_lock(&uniconf_access_mutex);
+    if (!uniconf_access_counts)
+    {
+        uniconf_access_counts = uniconf_map_create(0);
+    }
+    void **slot = uniconf_access_counts ? uniconf_map_slot(uniconf_access_counts, node) : NULL;
+    if (slot)
+    {
+        *slot = (void *)((uintptr_t)*slot + 1);
+    }
+    pthread_mutex_unlock(&uniconf_access_mutex);
+}
+
+/**
+ * Add the count of the path to the profile
+ *
+ * @param profile
+ * @param path
+ * @param count
+ *
+ * @return int : 0 = ok, -ENOMEM
+ */
+static int uniconf__access_add(uniconf_access_profile_t *profile, const char *path, uint64_t count)
+{
+    if (!profile->paths && !(profile->paths = uniconf_intern_pool()))
+    {
+        return -ENOMEM;
+    }
+    if (!profile->counts && !(profile->counts = uniconf_map_create(0)))
+    {
+        return -ENOMEM;
+    }
+    const char *key = uniconf_intern_in(profile->paths, path);
+    void **slot = key ? uniconf_map_slot(profile->counts, key) : NULL;
+    if (!slot)
+    {
+        return -ENOMEM;
+    }
+    *slot = (void *)((uintptr_t)*slot + (uintptr_t)count);
+    return 0;
+}
+
+/**
+ * Free the profile
+ *
+ * @param profile
+ */
+static void uniconf__access_free(uniconf_access_profile_t *profile)
+{
+    uniconf_map_destroy(profile->counts, NULL);
+    uniconf_intern_pool_free(profile->paths);
+    *profile = (uniconf_access_profile_t){0};
+}
+
+/**
+ * Add the counts of the subtree to the profile
+ *
+ * @param profile
+ * @param counts
+ * @param node
+ * @param path : the buffer of the node path, grown
+ * @param size : of the buffer
+ * @param length : of the node path
+ */
+static void uniconf__access_fold(uniconf_access_profile_t *profile, const uniconf_map_t *counts, const cJSON *node, char **path, size_t *size, size_t length)
+{
+    uintptr_t count = (uintptr_t)uniconf_map_get(counts, node);
+    if (count && length)
+    {
+        uniconf__access_add(profile, *path, count);
+    }
+    size_t index = 0;
+    uniconf_EachChild(child, node)
+    {
+        char number[24];
+        const char *name = cJSON_IsArray(node) ? (snprintf(number, sizeof(number), "%zu", index++), number) : child->string;
+        size_t need = length + strlen(name ? name : "") + 2;
+        if (need > *size)
+        {
+            char *grown = realloc(*path, need * 2);
+            if (!grown)
+            {
+                return;
+            }
+            *path = grown;
+            *size = need * 2;
+        }
+        sprintf(*path + length, length ? ".%s" : "%s", name ? name : "");
+        uniconf__access_fold(profile, counts, child, path, size, strlen(*path));
+        (*path)[length] = '\0';
+    }
+}
+
+/**
+ * Fold the counts of the tree into the profile
+ *
+ * @param profile
+ * @param counts
+ * @param root
+ */
+static void uniconf__access_fold_tree(uniconf_access_profile_t *profile, const uniconf_map_t *counts, const cJSON *root)
+{
+    size_t size = 256;
+    char *path = calloc(1, size);
+    if (path && counts && uniconf_map_count(counts))
+    {
+        uniconf__access_fold(profile, counts, root, &path, &size, 0);
+    }
+    free(path);
+}
+
+/**
+ * Walk the path, without loading the lazy branches
+ *
+ * @param node
+ * @param path
+ *
+ * @return cJSON*
+ */
+static cJSON *uniconf__access_walk(cJSON *node, const char *path)
+{
+    char *the_path = strdup(path);
+    if (!the_path)
+    {
+        return NULL;
+    }
+    for (char *sptr, *token = strtok_r(the_path, PATH_DELIM, &sptr); node && token; token = strtok_r(NULL, PATH_DELIM, &sptr))
+    {
+        long index = 0;
+        if (uniconf_lazy_pending_node(node))
+        {
+            node = NULL;
+        }
+        else if (cJSON_IsArray(node))
+        {
+            node = uniconf_is_index(token, &index) ? uniconf_item(node, index) : NULL;
+        }
+        else
+        {
+            node = cJSON_GetObjectItemCaseSensitive(node, token);
+        }
+    }
+    free(the_path);
+    return node;
+}
+
+/**
+ * Order the children by the weights
+ *
+ * @param a
+ * @param b
+ *
+ * @return int
+ */
+static int uniconf__access_compare(const void *a, const void *b)
+{
+    const uniconf_access_child_t *left = a;
+    const uniconf_access_child_t *right = b;
+    if (left->weight != right->weight)
+    {
+        return (left->weight > right->weight) ? -1 : 1;
+    }
+    return (left->position < right->position) ? -1 : 1; // stable
+}
+
+/**
+ * Reorder the object children by the subtree weights
+ *
+ * @param node
+ * @param weights : of the profile paths
+ * @param counts : of the nodes | NULL
+ * @param moved : the count of the reordered objects, in|out
+ *
+ * @return uint64_t : the subtree weight
+ */
+static uint64_t uniconf__access_reorder(cJSON *node, const uniconf_map_t *weights, const uniconf_map_t *counts, int *moved)
+{
+    uint64_t total = (uintptr_t)uniconf_map_get(weights, node) + (uintptr_t)uniconf_map_get(counts, node);
+    size_t count = 0;
+    uniconf_EachChild(child, node)
+    {
+        count++;
+    }
+    uniconf_access_child_t *children = (cJSON_IsObject(node) && count > 1) ? malloc(count * sizeof(uniconf_access_child_t)) : NULL;
+    int hot = 0;
+    size_t i = 0;
+    uniconf_EachChild(child, node)
+    {
+        uint64_t weight = uniconf__access_reorder(child, weights, counts, moved);
+        if (children)
+        {
+            children[i] = (uniconf_access_child_t){.node = child, .weight = weight, .position = i};
+            hot |= (i && weight > children[i - 1].weight);
+        }
+        total += weight;
+        i++;
+    }
+    if (children && hot)
+    {
+        qsort(children, count, sizeof(uniconf_access_child_t), uniconf__access_compare);
+        for (i = 0; i < count; i++)
+        {
+            children[i].node->prev = i ? children[i - 1].node : children[count - 1].node; // the first one points to the last
+            children[i].node->next = (i + 1 < count) ? children[i + 1].node : NULL;
+        }
+        node->child = children[0].node;
+        (*moved)++;
+    }
+    free(children);
+    return total;
+}
+
+/**
+ * Add the profile count to the weight of the node at the path
+ *
+ * @param path : interned
+ * @param count
+ * @param data : the root and the weights
+ */
+static void uniconf__access_weigh(const void *path, void *count, void *data)
+{
+    void **args = data;
+    cJSON *node = count ? uniconf__access_walk(args[0], path) : NULL;
+    void **slot = node ? uniconf_map_slot(args[1], node) : NULL;
+    if (slot)
+    {
+        *slot = (void *)((uintptr_t)*slot + (uintptr_t)count);
+    }
+}
+
+/**
+ * Reorder the tree by the profile and the counts
+ *
+ * @param root
+ * @param counts : of the tree | NULL
+ *
+ * @return int : the count of the reordered objects, <0 = error
+ */
+static int uniconf__access_reorganize(cJSON *root, const uniconf_map_t *counts)
+{
+    uniconf_map_t *weights = uniconf_map_create(0);
+    if (!weights)
+    {
+        return -ENOMEM;
+    }
+    void *args[] = {root, weights};
+    uniconf_map_each(uniconf_access_profile.counts, uniconf__access_weigh, args);
+    int moved = 0;
+    if (uniconf_map_count(weights) || uniconf_map_count(counts))
+    {
+        uniconf__access_reorder(root, weights, counts, &moved);
+    }
+    uniconf_map_destroy(weights, NULL);
+    return moved;
+}
+
+/**
+ * Move the hot children to the front, by the profile and the counts
+ * Not concurrently with the getters, as the constructs.
+ *
+ * @return int : the count of the reordered objects, <0 = error
+ */
+int uniconf_reorganize()
+{
+    cJSON *root = uniconf_root_mutable();
+    if (!root)
+    {
+        return -ENOENT;
+    }
+    pthread_mutex_lock(&uniconf_access_mutex);
+    int ret = uniconf__access_reorganize(root, uniconf_access_counts);
+    pthread_mutex_unlock(&uniconf_access_mutex);
+    return ret;
+}
+
+/**
+ * Fold the counts of the previous tree into the profile and order the new one
+ *
+ * @param previous : the counted tree | NULL
+ * @param current
+ */
+void uniconf_access_rebuild(const cJSON *previous, cJSON *current)
+{
+    pthread_mutex_lock(&uniconf_access_mutex);
+    if (previous)
+    {
+        uniconf__access_fold_tree(&uniconf_access_profile, uniconf_access_counts, previous);
+    }
+    uniconf_map_destroy(uniconf_access_counts, NULL);
+    uniconf_access_counts = NULL;
+    if (uniconf_map_count(uniconf_access_profile.counts) && current)
+    {
+        uniconf__access_reorganize(current, NULL);
+    }
+    pthread_mutex_unlock(&uniconf_access_mutex);
+}
+
+/**
+ * Copy the count to the profile
+ *
+ * @param path
+ * @param count
+ * @param data : the profile
+ */
+static void uniconf__access_copy(const void *path, void *count, void *data)
+{
+    uniconf__access_add(data, path, (uintptr_t)count);
+}
+
+/**
+ * Collect the entry
+ *
+ * @param path
+ * @param count
+ * @param data : the entries cursor
+ */
+static void uniconf__access_collect(const void *path, void *count, void *data)
+{
+    uniconf_access_entry_t **entry = data;
+    **entry = (uniconf_access_entry_t){.path = path, .count = (uintptr_t)count};
+    (*entry)++;
+}
+
+/**
+ * Order the entries by the paths
+ *
+ * @param a
+ * @param b
+ *
+ * @return int
+ */
+static int uniconf__access_compare_paths(const void *a, const void *b)
+{
+    return strcmp(((const uniconf_access_entry_t *)a)->path, ((const uniconf_access_entry_t *)b)->path);
+}
+
+/**
+ * Print the profile
+ *
+ * @param profile
+ *
+ * @return char* : {"path": count} ordered by the paths, must be freed | NULL = no memory
+ */
+static char *uniconf__access_print(const uniconf_access_profile_t *profile)
+{
+    size_t count = uniconf_map_count(profile->counts);
+    uniconf_access_entry_t *entries = malloc((count ? count : 1) * sizeof(uniconf_access_entry_t));
+    cJSON *json = entries ? cJSON_CreateObject() : NULL;
+    if (json)
+    {
+        uniconf_access_entry_t *cursor = entries;
+        uniconf_map_each(profile->counts, uniconf__access_collect, &cursor);
+        qsort(entries, count, sizeof(uniconf_access_entry_t), uniconf__access_compare_paths);
+        for (size_t i = 0; i < count; i++)
+        {
+            cJSON_AddNumberToObject(json, entries[i].path, (double)entries[i].count);
+        }
+    }
+    char *text = json ? cJSON_PrintUnformatted(json) : NULL;
+    cJSON_Delete(json);
+    free(entries);
+    return text;
+}
+
+/**
+ * Export the profile with the counts of the tree
+ *
+ * @return char* : {"path": count}, must be freed | NULL = no memory
+ */
+char *uniconf_access_export()
+{
+    uniconf_access_profile_t profile = {0};
+    pthread_mutex_lock(&uniconf_access_mutex);
+    uniconf_map_each(uniconf_access_profile.counts, uniconf__access_copy, &profile);
+    if (uniconf_get_root())
+    {
+        uniconf__access_fold_tree(&profile, uniconf_access_counts, uniconf_get_root());
+    }
+    pthread_mutex_unlock(&uniconf_access_mutex);
+    char *json = uniconf__access_print(&profile);
+    uniconf__access_free(&profile);
+    return json;
+}
+
+/**
+ * Load the profile ordering the next constructs, the counts are kept
+ *
+ * @param json : as exported
+ *
+ * @return int : the count of the paths, <0 = error
+ */
+int uniconf_access_load(const char *json)
+{
+    cJSON *parsed = json ? cJSON_Parse(json) : NULL;
+    if (!cJSON_IsObject(parsed))
+    {
+        cJSON_Delete(parsed);
+        return -EINVAL;
+    }
+    uniconf_access_profile_t profile = {0};
+    int count = 0;
+    uniconf_EachChild(entry, parsed)
+    {
+        if (!cJSON_IsNumber(entry) || !entry->string)
+        {
+            count = -EINVAL;
+            break;
+        }
+        double value = entry->valuedouble;
+        int ret = uniconf__access_add(&profile, entry->string, (value >= 1 && value < 0x1p63) ? (uint64_t)value : 0);
+        count = ret ? ret : count + 1;
+        if (ret)
+        {
+            break;
+        }
+    }
+    cJSON_Delete(parsed);
+    if (count < 0)
+    {
+        uniconf__access_free(&profile);
+        return count;
+    }
+    pthread_mutex_lock(&uniconf_access_mutex);
+    uniconf_access_profile_t previous = uniconf_access_profile;
+    uniconf_access_profile = profile;
+    pthread_mutex_unlock(&uniconf_access_mutex);
+    uniconf__access_free(&previous);
+    return count;
+}
+
+/**
+ * Drop the counts and the profile
+ *
+ */
+void uniconf_access_reset()
+{
+    pthread_mutex_lock(&uniconf_access_mutex);
+    uniconf_map_destroy(uniconf_access_counts, NULL);
+    uniconf_access_counts = NULL;
+    uniconf__access_free(&uniconf_access_profile);
+    pthread_mutex_unlock(&uniconf_access_mutex);
+}
@@ -0,0 +1,249 @@
+#include "uniconf.internal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * The asynchronous construct
+ *
+ * The construct runs on its own thread, the caller gets the handle at once and may wait for it
+ * or poll the progress: the files parsed of the counted ones and their bytes.
+ * The files are counted by the scan before the construct, the lazy branches are not counted.
+ * The callback is called after the tree is published and the subscribers are notified,
+ * before the waiters are woken. The constructs are serialized, the getters read the previous tree meanwhile.
+ * The callback can't wait for its construct nor free the handle: -EDEADLK.
+ */
+
+struct uniconf_async
+{
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    char *path;
+    uniconf_async_f callback;
+    void *data;
+    // progress
+    size_t files;
+    size_t total;
+    size_t bytes;
+    int done;
+    int result;
+};
+
+// of the constructing thread
+static __thread uniconf_async_t *uniconf_async_current = NULL;
+static __thread uniconf_async_t *uniconf_async_calling = NULL;
+
+/**
+ * Count the parsed file, if constructing asynchronously
+ *
+ * @param length
+ */
+void uniconf_async_parsed(size_t length)
+{
+    uniconf_async_t *async = uniconf_async_current;
+    if (async)
+    {
+        __atomic_add_fetch(&async->files, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&async->bytes, length, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * The thread of the construct
+ *
+ * @param arg : the handle
+ *
+ * @return void*
+ */
+static void *uniconf__async_run(void *arg)
+{
+    uniconf_async_t *async = arg;
+    __atomic_store_n(&async->total, uniconf_count(async->path), __ATOMIC_RELAXED);
+
+    uniconf_async_current = async;
+    int result = uniconf_construct("%s", async->path);
+    uniconf_async_current = NULL;
+
+    if (async->callback)
+    {
+        uniconf_async_calling = async;
+        async->callback(result, async->data);
+        uniconf_async_calling = NULL;
+    }
+    pthread_mutex_lock(&async->mutex);
+    async->result = result;
+    async->done = 1;
+    pthread_cond_broadcast(&async->cond);
+    pthread_mutex_unlock(&async->mutex);
+    return NULL;
+}
+
+/**
+ * Start the construct from path on the background thread
+ *
+ * @param callback : called with the construct result, NULL = none
+ * @param data
+ * @param format
+ * @param ...
+ *
+ * @return uniconf_async_t* : must be freed by uniconf_async_free() | NULL = error, errno is set
+ */
+uniconf_async_t *uniconf_construct_async(uniconf_async_f callback, void *data, const char *format, ...)
+{
+    if (!format)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    uniconf_async_t *async = calloc(1, sizeof(uniconf_async_t));
+    if (!async)
+    {
+        return NULL;
+    }
+    va_list ap;
+    va_start(ap, format);
+    int length = vasprintf(&async->path, format, ap);
+    va_end(ap);
+    if (length < 0)
+    {
+        free(async);
+        errno = ENOMEM;
+        return NULL;
+    }
+    async->callback = callback;
+    async->data = data;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&async->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&async->mutex, NULL);
+
+    int ret = pthread_create(&async->thread, NULL, uniconf__async_run, async);
+    if (ret)
+    {
+        pthread_cond_destroy(&async->cond);
+        pthread_mutex_destroy(&async->mutex);
+        free(async->path);
+        free(async);
+        errno = ret;
+        return NULL;
+    }
+    return async;
+}
+
+/**
+ * Wait for the construct
+ *
+ * @param async
+ *
+ * @return int : the construct result, -EDEADLK = from the callback
+ */
+int uniconf_async_wait(uniconf_async_t *async)
+{
+    if (!async)
+    {
+        return -EINVAL;
+    }
+    if (async == uniconf_async_calling)
+    {
+        return -EDEADLK;
+    }
+    pthread_mutex_lock(&async->mutex);
+    while (!async->done)
+    {
+        pthread_cond_wait(&async->cond, &async->mutex);
+    }
+    int result = async->result;
+    pthread_mutex_unlock(&async->mutex);
+    return result;
+}
+
+/**
+ * Wait for the construct no longer than the timeout
+ *
+ * @param async
+ * @param milliseconds
+ *
+ * @return int : the construct result, -ETIMEDOUT = not done yet, -EDEADLK = from the callback
+ */
+int uniconf_async_timedwait(uniconf_async_t *async, unsigned milliseconds)
+{
+    if (!async)
+    {
+        return -EINVAL;
+    }
+    if (async == uniconf_async_calling)
+    {
+        return -EDEADLK;
+    }
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += milliseconds / 1000;
+    deadline.tv_nsec += (milliseconds % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    int ret = 0;
+    pthread_mutex_lock(&async->mutex);
+    while (!async->done && ETIMEDOUT != ret)
+    {
+        ret = pthread_cond_timedwait(&async->cond, &async->mutex, &deadline);
+    }
+    int result = async->done ? async->result : -ETIMEDOUT;
+    pthread_mutex_unlock(&async->mutex);
+    return result;
+}
+
+/**
+ * Get the progress of the construct
+ *
+ * @param async
+ * @param progress : out
+ */
+void uniconf_async_progress(uniconf_async_t *async, uniconf_progress_t *progress)
+{
+    if (!async || !progress)
+    {
+        return;
+    }
+    pthread_mutex_lock(&async->mutex);
+    progress->done = async->done;
+    pthread_mutex_unlock(&async->mutex);
+    progress->files = __atomic_load_n(&async->files, __ATOMIC_RELAXED);
+    progress->total = __atomic_load_n(&async->total, __ATOMIC_RELAXED);
+    progress->bytes = __atomic_load_n(&async->bytes, __ATOMIC_RELAXED);
+}
+
+/**
+ * Wait for the construct and free the handle
+ *
+ * @param async
+ *
+ * @return int : 0 = freed, -EDEADLK = from the callback, not freed
+ */
+int uniconf_async_free(uniconf_async_t *async)
+{
+    if (!async)
+    {
+        return 0;
+    }
+    if (async == uniconf_async_calling)
+    {
+        return -EDEADLK;
+    }
+    pthread_join(async->thread, NULL);
+    pthread_cond_destroy(&async->cond);
+    pthread_mutex_destroy(&async->mutex);
+    free(async->path);
+    free(async);
+    return 0;
+}
@@ -0,0 +1,223 @@
+#include "uniconf.internal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The typed access for the generated bindings
+ *
+ * The converters are strict: the value is stored only when the node fits the type,
+ * so the binding keeps the default and reports the mismatch.
+ * Strings are accepted for scalars, as the .env and .ini values are strings.
+ * The errors go to their own list, the published tree is read-only.
+ */
+
+static cJSON *uniconf_bind_log = NULL; // the errors of the binds since the construct
+static pthread_mutex_t uniconf_bind_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Get the type name of the node
+ *
+ * @param node
+ *
+ * @return const char*
+ */
+const char *uniconf_typeName(const cJSON *node)
+{
+    switch (node ? (node->type & 0xFF) : cJSON_NULL)
+    {
+    case cJSON_False:
+    case cJSON_True:
+        return "boolean";
+    case cJSON_Number:
+        return "number";
+    case cJSON_String:
+        return "string";
+    case cJSON_Array:
+        return "array";
+    case cJSON_Object:
+        return "object";
+    case cJSON_Raw:
+        return "raw";
+    case cJSON_NULL:
+        return "null";
+    }
+    return "invalid";
+}
+
+/**
+ * Convert the node to the integer
+ * The numbers with the fraction or out of the range mismatch.
+ *
+ * @param node
+ * @param value
+ *
+ * @return int : 1 = converted, 0 = type mismatch
+ */
+int uniconf_asNumber(const cJSON *node, long long *value)
+{
+    if (cJSON_IsNumber(node))
+    {
+        double number = cJSON_GetNumberValue(node);
+        // [-2^63, 2^63), false for NaN
+        if (number >= -9223372036854775808.0 && number < 9223372036854775808.0 && (double)(long long)number == number)
+        {
+            *value = (long long)number;
+            return 1;
+        }
+        return 0;
+    }
+    if (cJSON_IsString(node) && *node->valuestring)
+    {
+        char *end = NULL;
+        errno = 0;
+        long long number = strtoll(node->valuestring, &end, 0);
+        if (!*end && !errno)
+        {
+            *value = number;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Convert the node to the double
+ *
+ * @param node
+ * @param value
+ *
+ * @return int : 1 = converted, 0 = type mismatch
+ */
+int uniconf_asDouble(const cJSON *node, double *value)
+{
+    if (cJSON_IsNumber(node))
+    {
+        *value = cJSON_GetNumberValue(node);
+        return 1;
+    }
+    if (cJSON_IsString(node) && *node->valuestring)
+    {
+        char *end = NULL;
+        errno = 0;
+        double number = uniconf_strtod(node->valuestring, &end);
+        if (!*end && !errno)
+        {
+            *value = number;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Convert the node to the boolean
+ * true|false, numbers and the strings known to uniconf_getBoolean
+ *
+ * @param node
+ * @param value
+ *
+ * @return int : 1 = converted, 0 = type mismatch
+ */
+int uniconf_asBoolean(const cJSON *node, int *value)
+{
+    if (cJSON_IsBool(node))
+    {
+        *value = cJSON_IsTrue(node);
+        return 1;
+    }
+    if (cJSON_IsNumber(node) || cJSON_IsString(node))
+    {
+        int result = uniconf_boolean((cJSON *)node);
+        if (result >= 0)
+        {
+            *value = !!result;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Get the string of the node, it lives in the tree
+ *
+ * @param node
+ * @param value
+ *
+ * @return int : 1 = converted, 0 = type mismatch
+ */
+int uniconf_asString(const cJSON *node, const char **value)
+{
+    if (cJSON_IsString(node))
+    {
+        *value = node->valuestring;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Report the binding error to the list of uniconf_bind_errors()
+ *
+ * @param schema
+ * @param path
+ * @param expected : the type name
+ * @param node : the found node or NULL = missing
+ *
+ * @return int : 1, the count of errors
+ */
+int uniconf_bind_error(const char *schema, const char *path, const char *expected, const cJSON *node)
+{
+    pthread_mutex_lock(&uniconf_bind_mutex);
+    if (!uniconf_bind_log)
+    {
+        uniconf_bind_log = cJSON_CreateArray();
+    }
+    cJSON *errors = uniconf_error_redirect(uniconf_bind_log);
+    if (!node)
+    {
+        uniconf_error("ERROR: schema '%s': '%s' of type %s is required", schema, path, expected);
+    }
+    else if (cJSON_IsString(node))
+    {
+        uniconf_error("ERROR: schema '%s': '%s' expects %s, got string \"%s\"", schema, path, expected, node->valuestring);
+    }
+    else if (cJSON_IsNumber(node))
+    {
+        uniconf_error("ERROR: schema '%s': '%s' expects %s, got number %g", schema, path, expected, node->valuedouble);
+    }
+    else
+    {
+        uniconf_error("ERROR: schema '%s': '%s' expects %s, got %s", schema, path, expected, uniconf_typeName(node));
+    }
+    uniconf_error_redirect(errors);
+    pthread_mutex_unlock(&uniconf_bind_mutex);
+    return 1;
+}
+
+/**
+ * Get the errors of the binds since the construct
+ *
+ * @return char* : the JSON array, must be freed | NULL = none
+ */
+char *uniconf_bind_errors()
+{
+    pthread_mutex_lock(&uniconf_bind_mutex);
+    char *errors = cJSON_GetArraySize(uniconf_bind_log) ? cJSON_PrintUnformatted(uniconf_bind_log) : NULL;
+    pthread_mutex_unlock(&uniconf_bind_mutex);
+    return errors;
+}
+
+/**
+ * Forget the errors of the binds, before the construct
+ *
+ */
+void uniconf_bind_reset()
+{
+    pthread_mutex_lock(&uniconf_bind_mutex);
+    cJSON_Delete(uniconf_bind_log);
+    uniconf_bind_log = NULL;
+    pthread_mutex_unlock(&uniconf_bind_mutex);
+}
@@ -0,0 +1,208 @@
+#include "uniconf.internal.h"
+
+#include <errno.h>
+#include <string.h>
+
+/**
+ * The construction budgets
+ *
+ * The limits of the next constructs and layers: the file size (decompressed), the total bytes,
+ * the nodes, the nesting in a file, the length of the substituted string and the wall time.
+ * The first exceeded budget is reported to the errors with the file and the limit,
+ * the scans and the parsers stop, the construct returns its error:
+ * -EFBIG for the sizes, -E2BIG for the nodes, the nesting and the expansion, -ETIMEDOUT for the time.
+ *
+ * The lazy branches loaded after the construct are not limited.
+ */
+
+#define BUDGET_CLOCK_PERIOD 1024 // of the nodes between the time checks
+
+static uniconf_budget_t uniconf_budget_limits = {0};
+// while constructing, not counting the lazy loads of the other threads
+static __thread int uniconf_budget_active = 0;
+static __thread int uniconf_budget_failed = 0;
+static __thread size_t uniconf_budget_bytes = 0;
+static __thread size_t uniconf_budget_nodes = 0;
+static __thread uint64_t uniconf_budget_deadline = 0;
+
+/**
+ * Set the budgets of the next constructs and layers
+ *
+ * @param budget : 0 = unlimited, NULL = all unlimited
+ */
+void uniconf_budget(const uniconf_budget_t *budget)
+{
+    uniconf_budget_limits = budget ? *budget : (uniconf_budget_t){0};
+}
+
+/**
+ * Start counting the construct
+ *
+ */
+void uniconf_budget_begin()
+{
+    uniconf_budget_failed = 0;
+    uniconf_budget_bytes = 0;
+    uniconf_budget_nodes = 0;
+    uniconf_budget_deadline = uniconf_budget_limits.milliseconds
+                                  ? uniconf_trace_clock() + uniconf_budget_limits.milliseconds * 1000000ULL
+                                  : 0;
+    uniconf_budget_active = 1;
+}
+
+/**
+ * Stop counting
+ *
+ * @return int : the error of the exceeded budget | 0
+ */
+int uniconf_budget_end()
+{
+    int failed = uniconf_budget_failed;
+    uniconf_budget_failed = 0;
+    uniconf_budget_active = 0;
+    return failed;
+}
+
+/**
+ * Get the error of the exceeded budget
+ *
+ * @return int : <0 = exceeded, the construct must stop
+ */
+int uniconf_budget_error()
+{
+    return uniconf_budget_failed;
+}
+
+/**
+ * Check the wall time
+ *
+ * @return int : <0 = exceeded
+ */
+int uniconf_budget_check()
+{
+    if (uniconf_budget_active && !uniconf_budget_failed && uniconf_budget_deadline &&
+        uniconf_trace_clock() > uniconf_budget_deadline)
+    {
+        uniconf_budget_failed = -ETIMEDOUT;
+        uniconf_error("ERROR: budget exceeded: the construct is over %u ms", uniconf_budget_limits.milliseconds);
+    }
+    return uniconf_budget_failed;
+}
+
+/**
+ * Get the largest size of the next file
+ *
+ * @return size_t : 0 = unlimited
+ */
+size_t uniconf_budget_file_limit()
+{
+    if (!uniconf_budget_active)
+    {
+        return 0;
+    }
+    size_t limit = uniconf_budget_limits.file_size;
+    if (uniconf_budget_limits.total_size)
+    {
+        size_t left = uniconf_budget_limits.total_size - uniconf_budget_bytes;
+        limit = (!limit || left < limit) ? left : limit;
+    }
+    return limit;
+}
+
+/**
+ * Count the file to be parsed
+ *
+ * @param source
+ * @param length
+ *
+ * @return int : <0 = exceeded
+ */
+int uniconf_budget_file(const char *source, size_t length)
+{
+    if (!uniconf_budget_active || uniconf_budget_check())
+    {
+        return uniconf_budget_failed;
+    }
+    if (uniconf_budget_limits.file_size && length > uniconf_budget_limits.file_size)
+    {
+        uniconf_budget_failed = -EFBIG;
+        uniconf_error("ERROR: budget exceeded: file '%s' is over %zu bytes", source, uniconf_budget_limits.file_size);
+    }
+    else if (uniconf_budget_limits.total_size && length > uniconf_budget_limits.total_size - uniconf_budget_bytes)
+    {
+        uniconf_budget_failed = -EFBIG;
+        uniconf_error("ERROR: budget exceeded: the files are over %zu bytes at '%s'", uniconf_budget_limits.total_size, source);
+    }
+    else
+    {
+        uniconf_budget_bytes += length;
+    }
+    return uniconf_budget_failed;
+}
+
+/**
+ * Count the node added
+ *
+ * @return int : <0 = exceeded
+ */
+int uniconf_budget_node()
+{
+    if (!uniconf_budget_active || uniconf_budget_failed)
+    {
+        return uniconf_budget_failed;
+    }
+    if (++uniconf_budget_nodes > uniconf_budget_limits.nodes && uniconf_budget_limits.nodes)
+    {
+        uniconf_budget_failed = -E2BIG;
+        uniconf_error("ERROR: budget exceeded: the tree is over %zu nodes", uniconf_budget_limits.nodes);
+    }
+    else if (0 == uniconf_budget_nodes % BUDGET_CLOCK_PERIOD)
+    {
+        uniconf_budget_check();
+    }
+    return uniconf_budget_failed;
+}
+
+/**
+ * Check the nesting in the file
+ *
+ * @param source : NULL = the position is reported by the parser
+ * @param line
+ * @param depth
+ *
+ * @return int : <0 = exceeded
+ */
+int uniconf_budget_depth(const char *source, int line, int depth)
+{
+    if (uniconf_budget_active && !uniconf_budget_failed && uniconf_budget_limits.depth && depth > uniconf_budget_limits.depth)
+    {
+        uniconf_budget_failed = -E2BIG;
+        if (source)
+        {
+            uniconf_error_file(source, line, "budget exceeded: the nesting is over %d", uniconf_budget_limits.depth);
+        }
+        else
+        {
+            uniconf_error("ERROR: budget exceeded: the nesting is over %d", uniconf_budget_limits.depth);
+        }
+    }
+    return uniconf_budget_failed;
+}
+
+/**
+ * Check the length of the substituted string
+ *
+ * @param str : the original one
+ * @param length : substituted so far
+ *
+ * @return int : <0 = exceeded
+ */
+int uniconf_budget_expansion(const char *str, size_t length)
+{
+    if (uniconf_budget_active && !uniconf_budget_failed && uniconf_budget_limits.expansion && length > uniconf_budget_limits.expansion)
+    {
+        uniconf_budget_failed = -E2BIG;
+        uniconf_error("ERROR: budget exceeded: the expansion of '%.64s' is over %zu bytes", str, uniconf_budget_limits.expansion);
+    }
+    return uniconf_budget_failed;
+}
@@ -18,27 +18,186 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 
-static uniconf_t
-    uniconf_root = NULL;
+static cJSON *uniconf_root = NULL;              // published
+static cJSON *uniconf_retired = NULL;           // the replaced tree, freed by the next construct
+static __thread cJSON *uniconf_building = NULL; // of the constructing thread
+
+// the getters in progress by the parity of the epoch, the retired tree is freed when they are gone
+static unsigned long uniconf_epoch = 0;
+static unsigned long uniconf_readers[2] = {0};
+
+// the constructs one at a time, the construct from the subscriber fails with -EDEADLK
+static pthread_mutex_t uniconf_build_mutex = PTHREAD_ERRORCHECK_MUTEX_INITIALIZER_NP;
+
+static uniconf_profile_f uniconf_profiler = NULL;
+static void *uniconf_profiler_data = NULL;
 
 /**
- * Get the root
+ * Get the root, the tree being constructed on the constructing thread
  *
  * @return uniconf_t
  */
 uniconf_t uniconf_get_root()
 {
-    return uniconf_root;
+    return uniconf_root_mutable();
+}
+
+/**
+ * Get the root for the library, the published tree is changed by the lazy loads only
+ *
+ * @return cJSON*
+ */
+cJSON *uniconf_root_mutable()
+{
+    return uniconf_building ? uniconf_building : __atomic_load_n(&uniconf_root, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Enter the getter: the tree it reads isn't freed until it leaves
+ *
+ * @return unsigned long : the epoch for uniconf_reader_leave()
+ */
+unsigned long uniconf_reader_enter()
+{
+    for (;;)
+    {
+        unsigned long epoch = __atomic_load_n(&uniconf_epoch, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&uniconf_readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
+        if (epoch == __atomic_load_n(&uniconf_epoch, __ATOMIC_SEQ_CST))
+        {
+            return epoch;
+        }
+        __atomic_sub_fetch(&uniconf_readers[epoch & 1], 1, __ATOMIC_SEQ_CST); // drained meanwhile
+    }
+}
+
+/**
+ * Leave the getter
+ *
+ * @param epoch : of uniconf_reader_enter()
+ */
+void uniconf_reader_leave(unsigned long epoch)
+{
+    __atomic_sub_fetch(&uniconf_readers[epoch & 1], 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Start the next epoch, when the getters of the one before the current have left
+ * So the count of the parity is of one epoch only. Doesn't wait, safe in the getter.
+ *
+ * @param epoch : out, the finished one
+ *
+ * @return int : 1 = started, 0 = the getters of the one before are still there
+ */
+int uniconf_readers_advance(unsigned long *epoch)
+{
+    unsigned long current = __atomic_load_n(&uniconf_epoch, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&uniconf_readers[(current + 1) & 1], __ATOMIC_SEQ_CST) ||
+        !__atomic_compare_exchange_n(&uniconf_epoch, &current, current + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+    {
+        return 0;
+    }
+    *epoch = current;
+    return 1;
+}
+
+/**
+ * Have the getters of the finished epoch left
+ * Doesn't wait, safe in the getter.
+ *
+ * @param epoch : of uniconf_readers_advance()
+ *
+ * @return int
+ */
+int uniconf_readers_gone(unsigned long epoch)
+{
+    unsigned long current = __atomic_load_n(&uniconf_epoch, __ATOMIC_SEQ_CST);
+    // the next epoch was started after they left
+    return current > epoch + 1 || (current == epoch + 1 && !__atomic_load_n(&uniconf_readers[epoch & 1], __ATOMIC_SEQ_CST));
+}
+
+/**
+ * Wait for the getters entered before, the new ones read the published tree
+ *
+ */
+void uniconf_readers_drain()
+{
+    unsigned long epoch = 0;
+    while (!uniconf_readers_advance(&epoch))
+    {
+        sched_yield();
+    }
+    while (!uniconf_readers_gone(epoch))
+    {
+        sched_yield();
+    }
+}
+
+/**
+ * Take the construct lock, the layers are constructed one at a time with the tree
+ *
+ * @return int : 0 = locked, -EDEADLK = from the subscriber
+ */
+int uniconf_build_lock()
+{
+    return -pthread_mutex_lock(&uniconf_build_mutex);
+}
+
+/**
+ * Release the construct lock
+ *
+ */
+void uniconf_build_unlock()
+{
+    pthread_mutex_unlock(&uniconf_build_mutex);
+}
+
+/**
+ * Take the construct lock for the state shared with the construct,
+ * the subscriber holds it already
+ *
+ * @return int : 1 = taken, 0 = held by the thread, <0 = error
+ */
+int uniconf_build_enter()
+{
+    int ret = uniconf_build_lock();
+    return ret ? ((-EDEADLK == ret) ? 0 : ret) : 1;
+}
+
+/**
+ * Release the construct lock taken by uniconf_build_enter()
+ *
+ * @param locked
+ */
+void uniconf_build_leave(int locked)
+{
+    if (locked > 0)
+    {
+        uniconf_build_unlock();
+    }
+}
+
+/**
+ * Is the tree being constructed by this thread
+ *
+ * @return int
+ */
+int uniconf_constructing()
+{
+    return NULL != uniconf_building;
 }
 
-static int uniconf_process(uniconf_t node, const char *path, const char *name);
-static int uniconf_dir(uniconf_t root, const char *path, const char *name);
-static int uniconf_file(uniconf_t root, const char *path, const char *filename);
-static uniconf_t uniconf_object_v(uniconf_t object, const char *format, va_list ap);
+static int uniconf_process(cJSON *node, const char *path, const char *name);
+static int uniconf_dir(cJSON *root, const char *path, const char *name);
+static int uniconf_file(cJSON *root, const char *path, const char *filename);
+static cJSON *uniconf_object_v(cJSON *object, cJSON *view, const char *format, va_list ap);
+static int uniconf__build(int (*load)(cJSON *root, const void *data), const void *data);
 
 /**
  * Process the directory entry into the config node
@@ -49,7 +208,7 @@ static uniconf_t uniconf_object_v(uniconf_t object, const char *format, va_list
  *
  * @return <0 - error, >= 0 - count
  */
-static int uniconf_process(uniconf_t node, const char *path, const char *name)
+static int uniconf_process(cJSON *node, const char *path, const char *name)
 {
     if (name && ((0 == strcmp(".", name)) || (0 == strcmp("..", name))))
     {
@@ -74,14 +233,14 @@ static int uniconf_process(uniconf_t node, const char *path, const char *name)
  *
  * @return <0 = error, >=0 = count
  */
-static int uniconf_dir(uniconf_t root, const char *path, const char *name)
+static int uniconf_dir(cJSON *root, const char *path, const char *name)
 {
     int ret = 0;
-    int count = 0;
 
     char *pathname = uniconf_makepath(path, name);
     if (pathname)
     {
+        cJSON *node = root;
         if (name)
         {
             char *branch = strdup(name);
@@ -92,37 +251,129 @@ static int uniconf_dir(uniconf_t root, const char *path, const char *name)
             }
             if (*branch)
             {
-                root = uniconf_node(root, branch);
+                uint64_t whence = uniconf_whence_enter(pathname);
+                node = uniconf_node(root, branch);
+                uniconf_whence_leave(whence);
             }
             free(branch);
         }
 
-        struct dirent **namelist;
+        ret = (node != root && uniconf_lazy_mode()) ? uniconf_lazy_register(node, pathname)
+                                                    : uniconf_scan(node, pathname);
+        free(pathname);
+    }
+    return ret;
+}
+
+/**
+ * Process the directory entries into the node
+ *
+ * @param node
+ * @param pathname
+ *
+ * @return <0 = error, >=0 = count
+ */
+int uniconf_scan(cJSON *node, const char *pathname)
+{
+    int ret = 0;
+    int count = 0;
+    uint64_t start = UNICONF_PROBING(scan) ? uniconf_trace_clock() : 0;
+
+    struct dirent **namelist;
 
-        int n = scandir(pathname, &namelist, NULL, alphasort);
-        if (n < 0)
+    int n = scandir(pathname, &namelist, NULL, alphasort);
+    if (n < 0)
+    {
+        return -errno;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        if (ret >= 0)
         {
-            free(pathname);
-            return -errno;
+            ret = uniconf_budget_check();
         }
+        if (ret >= 0)
+        {
+            ret = uniconf_process(node, pathname, namelist[i]->d_name);
+            count += ret > 0 ? ret : 0;
+        }
+        free(namelist[i]);
+    }
+    free(namelist);
 
+    ret = ret < 0 ? ret : count;
+    if (start)
+    {
+        UNICONF_TRACE(scan, UNICONF_TRACE_SCAN, pathname, NULL, n, ret, uniconf_trace_clock() - start);
+    }
+    return ret;
+}
+
+/**
+ * Find the extension choosing the parser
+ *
+ * @param name : the compression extension is cut off
+ * @param compression : out, NULL = not compressed
+ *
+ * @return char* : the dot of the extension | NULL
+ */
+static char *uniconf_file_ext(char *name, char **compression)
+{
+    char *ext = strrchr(name, '.');
+    *compression = NULL;
+    if (ext && uniconf_compressed(ext + 1))
+    {
+        // the inner extension chooses the parser
+        *compression = ext + 1;
+        ext[0] = '\0';
+        ext = strrchr(name, '.');
+    }
+    return ext;
+}
+
+/**
+ * Count the files the construct would parse
+ *
+ * @param path : the directory|file
+ *
+ * @return size_t
+ */
+size_t uniconf_count(const char *path)
+{
+    size_t count = 0;
+    int result = uniconf_check(path, NULL);
+    if (result > 0)
+    {
+        struct dirent **namelist;
+        int n = scandir(path, &namelist, NULL, alphasort);
         for (int i = 0; i < n; i++)
         {
-            if (ret >= 0)
+            const char *name = namelist[i]->d_name;
+            char *pathname = (strcmp(".", name) && strcmp("..", name)) ? uniconf_makepath(path, name) : NULL;
+            // the lazy branches are parsed later
+            if (pathname && !(uniconf_lazy_mode() && uniconf_check(pathname, NULL) > 0))
             {
-                ret = uniconf_process(root, pathname, namelist[i]->d_name);
-                count += ret > 0 ? ret : 0;
+                count += uniconf_count(pathname);
             }
+            free(pathname);
             free(namelist[i]);
         }
-        free(namelist);
-        free(pathname);
+        free(n < 0 ? NULL : namelist);
     }
-    return ret < 0 ? ret : count;
+    else if (0 == result)
+    {
+        char *name = strdup(path);
+        char *compression = NULL;
+        char *ext = name ? uniconf_file_ext(name, &compression) : NULL;
+        count = (ext && uniconf_parser_find(ext + 1)) ? 1 : 0;
+        free(name);
+    }
+    return count;
 }
 
 /**
- * Parse the file by the extension
+ * Parse the file by the parser of the extension
  *
  * @param root
  * @param path
@@ -131,62 +382,342 @@ static int uniconf_dir(uniconf_t root, const char *path, const char *name)
  *
  * @return <0 = error, >=0 = count
  */
-static int uniconf_file(uniconf_t root, const char *path, const char *filename)
+static int uniconf_file(cJSON *root, const char *path, const char *filename)
 {
     int ret = 0;
 
     char *filepath = uniconf_makepath(path, filename);
     char *name = NULL;
+    char *stem = NULL; // of the file path
 
-    char *ext = NULL;
     if (filename && *filename)
     {
         name = strdup(filename);
-        ext = strrchr(name, '.');
-        if (ext)
-        {
-            ext[0] = '\0';
-        }
     }
     else
     {
-        ext = strrchr(filepath, '.');
+        stem = strdup(filepath);
+    }
+    char *compression = NULL;
+    char *ext = (name || stem) ? uniconf_file_ext(name ? name : stem, &compression) : NULL;
+    if (ext && name)
+    {
+        ext[0] = '\0';
     }
 
-    if (ext)
+    uniconf_parser_f parser = ext ? uniconf_parser_find(ext + 1) : NULL;
+    if (parser)
     {
-        ext++;
-        if (!strcmp("env", ext))
-        {
-            ret = uniconf_env(root, filepath, name);
-        }
-        else if (!strcmp("ini", ext))
-        {
-            ret = uniconf_ini(root, filepath, name);
-        }
-        else if (!strcmp("list", ext))
+        size_t length = 0;
+        int mapped = 0;
+        char *buffer = uniconf_read(filepath, &length, &mapped);
+        if (!buffer)
         {
-            ret = uniconf_list(root, filepath, name);
+            uniconf_error("Failed to open file '%s'", filepath);
         }
-        else if (!strcmp("conf", ext))
+        else if (compression && -EOPNOTSUPP != (ret = uniconf_parse_compressed(root, ext + 1, compression, buffer, length, filepath, name)))
         {
-            ret = uniconf_conf(root, filepath, name);
+            uniconf_read_free(buffer, length, mapped);
+            buffer = NULL;
         }
-        else if (!strcmp("json", ext))
+        else if (compression)
         {
-            ret = uniconf_json(root, filepath, name);
+            ret = 0;
+            size_t size = length;
+            size_t limit = uniconf_budget_file_limit();
+            char *inflated = uniconf_inflate(compression, buffer, size, &length, limit);
+            if (!inflated && EFBIG == errno)
+            {
+                ret = uniconf_budget_file(filepath, limit + 1); // stopped at the limit
+            }
+            else if (!inflated)
+            {
+                uniconf_error("Failed to decompress file '%s': %s", filepath, strerror(errno));
+            }
+            uniconf_read_free(buffer, size, mapped);
+            buffer = inflated;
+            mapped = 0;
         }
-        else if (!strcmp("yml", ext) || !strcmp("yaml", ext))
+        if (buffer)
         {
-            ret = uniconf_yml(root, filepath, name);
+            ret = uniconf_parse(root, parser, ext + 1, buffer, length, filepath, name);
+            uniconf_read_free(buffer, length, mapped);
         }
     }
 
+    free(stem);
     free(name);
     free(filepath);
     return ret;
 }
 
+/**
+ * Parse the buffer or the stream, profiled and traced
+ *
+ * @param root
+ * @param parser : of the buffer | NULL
+ * @param streamer : of the stream, when no parser
+ * @param stream
+ * @param format : the extension of the parser
+ * @param buffer : followed by '\0'
+ * @param length
+ * @param source
+ * @param branch
+ *
+ * @return <0 = error, >=0 = count
+ */
+static int uniconf__parse(cJSON *root, uniconf_parser_f parser, uniconf_stream_parser_f streamer, uniconf_stream_t *stream,
+                          const char *format, const char *buffer, size_t length, const char *source, const char *branch)
+{
+    int ret = parser ? uniconf_budget_file(source, length) : 0; // the stream is stopped at the limit
+    if (ret < 0)
+    {
+        return ret;
+    }
+    size_t substitutions = uniconf_substitute_count();
+    uint64_t start = (uniconf_profiler || UNICONF_PROBING(file__done)) ? uniconf_trace_clock() : 0;
+    if (UNICONF_PROBING(file__start))
+    {
+        UNICONF_TRACE(file__start, UNICONF_TRACE_FILE_START, source, format, length, 0, 0);
+    }
+
+    uint64_t whence = uniconf_whence_enter(source); // the lazy branch may be parsed inside
+    ret = parser ? parser(root, buffer, length, source, branch) : streamer(root, stream, source, branch);
+    uniconf_whence_leave(whence);
+
+    length = parser ? length : uniconf_stream_length(stream);
+    uniconf_async_parsed(length);
+
+    uint64_t elapsed = start ? uniconf_trace_clock() - start : 0;
+    if (start && UNICONF_PROBING(file__done))
+    {
+        UNICONF_TRACE(file__done, UNICONF_TRACE_FILE_DONE, source, format, length, ret, elapsed);
+    }
+    if (uniconf_profiler)
+    {
+        uniconf_file_stats_t stats = {
+            .filepath = source,
+            .count = ret,
+            .nanoseconds = elapsed,
+            .substitutions = uniconf_substitute_count() - substitutions,
+        };
+        uniconf_profiler(&stats, uniconf_profiler_data);
+    }
+    return ret;
+}
+
+/**
+ * Parse the buffer, profiled and traced
+ *
+ * @param root
+ * @param parser
+ * @param format : the extension of the parser
+ * @param buffer : followed by '\0'
+ * @param length
+ * @param source
+ * @param branch
+ *
+ * @return <0 = error, >=0 = count
+ */
+int uniconf_parse(cJSON *root, uniconf_parser_f parser, const char *format, const char *buffer, size_t length, const char *source, const char *branch)
+{
+    return uniconf__parse(root, parser, NULL, NULL, format, buffer, length, source, branch);
+}
+
+/**
+ * Parse the compressed data while decompressing, by the stream parser of the format
+ *
+ * @param root
+ * @param format : the extension of the parser
+ * @param compression : the extension of the compression
+ * @param data
+ * @param size
+ * @param source
+ * @param branch
+ *
+ * @return <0 = error, >=0 = count, -EOPNOTSUPP = no stream parser, to be decompressed whole
+ */
+int uniconf_parse_compressed(cJSON *root, const char *format, const char *compression, const char *data, size_t size, const char *source, const char *branch)
+{
+    uniconf_stream_parser_f streamer = uniconf_parser_stream(format);
+    if (!streamer)
+    {
+        return -EOPNOTSUPP;
+    }
+    size_t limit = uniconf_budget_file_limit();
+    uniconf_stream_t *stream = uniconf_stream_open(compression, data, size, limit);
+    if (!stream)
+    {
+        return -errno;
+    }
+    int ret = uniconf_budget_error();
+    ret = ret ? ret : uniconf__parse(root, NULL, streamer, stream, format, NULL, 0, source, branch);
+    int failed = uniconf_stream_error(stream);
+    if (-EFBIG == failed)
+    {
+        ret = uniconf_budget_file(source, limit + 1); // stopped at the limit
+    }
+    else if (failed)
+    {
+        uniconf_error("Failed to decompress file '%s': %s", source, strerror(-failed));
+    }
+    else if (ret >= 0)
+    {
+        int counted = uniconf_budget_file(source, uniconf_stream_length(stream));
+        ret = (counted < 0) ? counted : ret;
+    }
+    uniconf_stream_close(stream);
+    return ret;
+}
+
+/**
+ * Set the callback called after each parsed file
+ *
+ * @param callback : NULL = off
+ * @param data
+ */
+void uniconf_profile(uniconf_profile_f callback, void *data)
+{
+    uniconf_profiler = callback;
+    uniconf_profiler_data = data;
+}
+
+/**
+ * Free the tree replaced by the last construct with its side tables, after the getters reading it
+ *
+ */
+static void uniconf_retire()
+{
+    uniconf_readers_drain();
+    uniconf_lazy_drop(uniconf_retired);
+    if (uniconf_retired)
+    {
+        uniconf_whence_drop(uniconf_retired);
+        uniconf_listset_drop(uniconf_retired);
+        cJSON_Delete(uniconf_retired);
+        uniconf_retired = NULL;
+    }
+    uniconf_index_release();
+    uniconf_fold_release();
+    uniconf_hash_release();
+}
+
+/**
+ * Replace the tree by the loaded one
+ * The new tree is loaded aside and published complete, the getters read the previous one meanwhile.
+ * The previous tree stays readable until the next construct starts.
+ *
+ * @param load : fills the new root
+ * @param data
+ *
+ * @return : >=0 - success count, <0 - error number
+ */
+static int uniconf_build(int (*load)(cJSON *root, const void *data), const void *data)
+{
+    int ret = -pthread_mutex_lock(&uniconf_build_mutex);
+    if (ret)
+    {
+        return ret; // from the subscriber
+    }
+    ret = uniconf__build(load, data);
+    pthread_mutex_unlock(&uniconf_build_mutex);
+    return ret;
+}
+
+/**
+ * Construct the new tree and publish it, under the construct lock
+ *
+ * @param load : fills the new root
+ * @param data
+ *
+ * @return : >=0 - success count, <0 - error number
+ */
+static int uniconf__build(int (*load)(cJSON *root, const void *data), const void *data)
+{
+    int ret = 0;
+    uniconf_retire();
+    uniconf_bind_reset();
+    uniconf_intern_begin();
+    cJSON *previous = uniconf_root;
+    // construct
+    cJSON *root = uniconf_building = cJSON_CreateObject();
+    uniconf_whence_begin(root);
+    uniconf_budget_begin();
+
+    if (load)
+    {
+        ret = load(root, data);
+    }
+    int exceeded = uniconf_budget_end();
+    ret = exceeded ? exceeded : ret;
+    if (ret >= 0)
+    {
+        uniconf_whence_enter("environment");
+        ret += uniconf_environ_override(root);
+    }
+    uniconf_whence_end();
+    uniconf_environ_close();
+    uniconf_access_rebuild(previous, root);
+    uniconf_fold_build(root);
+    uniconf_index_build(root);
+    uniconf_hash_build(root);
+    uniconf_history_push(previous, root);
+
+    // publish
+    __atomic_store_n(&uniconf_root, root, __ATOMIC_RELEASE);
+    uniconf_building = NULL;
+    uniconf_retired = previous;
+
+    uniconf_notify(previous, root);
+    return ret;
+}
+
+/**
+ * Load the directory|file
+ *
+ * @param root
+ * @param data : the path
+ *
+ * @return <0 = error, >=0 = count
+ */
+static int uniconf_load_path(cJSON *root, const void *data)
+{
+    return uniconf_load(root, data);
+}
+
+/**
+ * Process the directory|file into the root, without replacing the tree
+ *
+ * @param root
+ * @param path
+ *
+ * @return <0 = error, >=0 = count
+ */
+int uniconf_load(cJSON *root, const char *path)
+{
+    return uniconf_process(root, path, NULL);
+}
+
+typedef struct uniconf_sources
+{
+    const uniconf_source_t *items;
+    size_t count;
+} uniconf_sources_t;
+
+/**
+ * Load the in-memory sources
+ *
+ * @param root
+ * @param data : the sources
+ *
+ * @return <0 = error, >=0 = count
+ */
+static int uniconf_load_sources(cJSON *root, const void *data)
+{
+    const uniconf_sources_t *sources = data;
+    return uniconf_sources(root, sources->items, sources->count);
+}
+
 /**
  * Load config from path
  *
@@ -197,52 +728,174 @@ static int uniconf_file(uniconf_t root, const char *path, const char *filename)
  */
 int uniconf_construct(const char *format, ...)
 {
-    int ret = 0;
-    // clear previous
-    uniconf_destruct();
-    // construct
-    uniconf_root = cJSON_CreateObject();
-
+    char *uniconf_path = NULL;
     if (format)
     {
-        char *uniconf_path = NULL;
         va_list ap;
         va_start(ap, format);
         vasprintf(&uniconf_path, format, ap);
         va_end(ap);
+    }
+    int ret = uniconf_build(uniconf_path ? uniconf_load_path : NULL, uniconf_path);
+    FREE_AND_NULL(uniconf_path);
+    return ret;
+}
 
-        ret = uniconf_process(uniconf_root, uniconf_path, NULL);
-        FREE_AND_NULL(uniconf_path);
+/**
+ * Load config from the in-memory sources, as from the directory
+ *
+ * @param sources
+ * @param count
+ *
+ * @return : >=0 - success count, <0 - error number
+ */
+int uniconf_construct_sources(const uniconf_source_t *sources, size_t count)
+{
+    if (!sources && count)
+    {
+        return -EINVAL;
     }
+    uniconf_sources_t data = {.items = sources, .count = count};
+    return uniconf_build(uniconf_load_sources, &data);
+}
+
+/**
+ * Load config from the buffer of the format
+ *
+ * @param format : the extension, e.g. "json"
+ * @param buffer
+ * @param length
+ *
+ * @return : >=0 - success count, <0 - error number
+ */
+int uniconf_construct_buffer(const char *format, const char *buffer, size_t length)
+{
+    if (!format || (!buffer && length))
+    {
+        return -EINVAL;
+    }
+    uniconf_source_t source = {.name = "", .format = format, .buffer = buffer ? buffer : "", .length = length};
+    return uniconf_construct_sources(&source, 1);
+}
+
+/**
+ * Move the prepared tree into the root
+ *
+ * @param root
+ * @param data : the tree, left empty
+ *
+ * @return <0 = error, >=0 = count
+ */
+static int uniconf_load_tree(cJSON *root, const void *data)
+{
+    cJSON *tree = (cJSON *)data;
+    root->child = tree->child;
+    tree->child = NULL;
+    uniconf_intern_tree(root);
+    return 0;
+}
+
+/**
+ * Switch to the retained version without reparsing
+ *
+ * @param version : of uniconf_versions(), as uniconf_version() with no layers
+ *
+ * @return : >=0 - success, <0 - error number
+ */
+int uniconf_rollback(uint64_t version)
+{
+    int ret = -pthread_mutex_lock(&uniconf_build_mutex);
+    if (ret)
+    {
+        return ret; // from the subscriber
+    }
+    // the history and the tree it patches are of the same construct
+    uint64_t current = uniconf_hash(uniconf_root);
+    cJSON *tree = (version == current) ? NULL : uniconf_history_tree(version, uniconf_root);
+    if (tree)
+    {
+        ret = cJSON_IsObject(tree) ? uniconf__build(uniconf_load_tree, tree) : -EINVAL;
+        cJSON_Delete(tree);
+    }
+    else
+    {
+        ret = (version == current) ? 0 : -ENOENT;
+    }
+    pthread_mutex_unlock(&uniconf_build_mutex);
     return ret;
 }
 
 /**
  * Destruct config tree
+ * Not from the subscribers, nothing is done there.
  *
  */
 void uniconf_destruct()
 {
+    if (pthread_mutex_lock(&uniconf_build_mutex))
+    {
+        return; // from the subscriber
+    }
+    uniconf_index_reset();
+    uniconf_hash_reset();
+    uniconf_lazy_reset();
+    uniconf_bind_reset();
+    uniconf_listset_reset();
+    uniconf_fold_reset();
+    uniconf_layer_reset();
+    uniconf_history_reset();
+    uniconf_whence_reset();
+    uniconf_access_reset();
+    cJSON_Delete(uniconf_retired);
+    uniconf_retired = NULL;
     if (uniconf_root)
     {
         cJSON_Delete(uniconf_root);
         uniconf_root = NULL;
     }
+    uniconf_intern_reset();
+    pthread_mutex_unlock(&uniconf_build_mutex);
 }
 
-static uniconf_t uniconf_object_v(uniconf_t object, const char *format, va_list ap)
+/**
+ * Find the node by the path, in the attached snapshot or the layers if any, then in the mounted base
+ *
+ * @param object
+ * @param view : the scalar of the snapshot is filled here, NULL = build it
+ * @param format
+ * @param ap
+ *
+ * @return cJSON*
+ */
+static cJSON *uniconf_object_v(cJSON *object, cJSON *view, const char *format, va_list ap)
 {
     char *the_path = NULL;
     vasprintf(&the_path, format, ap);
-    for (char *sptr, *token = strtok_r(the_path, PATH_DELIM, &sptr); object && token; token = strtok_r(NULL, PATH_DELIM, &sptr))
+    if (!the_path)
+    {
+        return NULL;
+    }
+    uint64_t start = UNICONF_PROBING(lookup) ? uniconf_trace_clock() : 0;
+    if (uniconf_shm_attached())
     {
-        object = cJSON_GetObjectItemCaseSensitive(object, token);
+        object = uniconf_shm_object(the_path, view);
+    }
+    else
+    {
+        cJSON *root = object;
+        cJSON *tree = object;
+        object = uniconf_layered() ? uniconf_layer_walk(the_path, &tree) : uniconf_walk(object, the_path);
+        if (tree == root)
+        {
+            uniconf_access_count(object);
+        }
+        object = object ? object : uniconf_shm_base_object(the_path, view);
     }
-    if (the_path)
+    if (start)
     {
-        free(the_path);
-        the_path = NULL;
+        UNICONF_TRACE(lookup, UNICONF_TRACE_LOOKUP, the_path, NULL, 0, NULL != object, uniconf_trace_clock() - start);
     }
+    FREE_AND_NULL(the_path);
 
     return object;
 }
@@ -258,7 +911,9 @@ uniconf_t uniconf_getObject(const char *format, ...)
 {
     va_list ap;
     va_start(ap, format);
-    uniconf_t object = uniconf_object_v(uniconf_get_root(), format, ap);
+    unsigned long epoch = uniconf_reader_enter();
+    cJSON *object = uniconf_object_v(uniconf_root_mutable(), NULL, format, ap);
+    uniconf_reader_leave(epoch);
     va_end(ap);
 
     return object;
@@ -273,12 +928,16 @@ uniconf_t uniconf_getObject(const char *format, ...)
  */
 char *uniconf_getString(const char *format, ...)
 {
+    cJSON view;
     va_list ap;
     va_start(ap, format);
-    uniconf_t object = uniconf_object_v(uniconf_get_root(), format, ap);
+    unsigned long epoch = uniconf_reader_enter();
+    cJSON *object = uniconf_object_v(uniconf_root_mutable(), &view, format, ap);
+    char *value = cJSON_IsString(object) ? cJSON_GetStringValue(object) : NULL;
+    uniconf_reader_leave(epoch);
     va_end(ap);
 
-    return cJSON_IsString(object) ? cJSON_GetStringValue(object) : NULL;
+    return value;
 }
 
 /**
@@ -290,21 +949,24 @@ char *uniconf_getString(const char *format, ...)
  */
 long long uniconf_getNumber(const char *format, ...)
 {
+    cJSON view;
     va_list ap;
     va_start(ap, format);
-    uniconf_t object = uniconf_object_v(uniconf_get_root(), format, ap);
-    va_end(ap);
-
+    unsigned long epoch = uniconf_reader_enter();
+    cJSON *object = uniconf_object_v(uniconf_root_mutable(), &view, format, ap);
+    long long value = 0;
     if (cJSON_IsString(object))
     {
-        return atoll(cJSON_GetStringValue(object));
+        value = atoll(cJSON_GetStringValue(object));
     }
     else if (cJSON_IsNumber(object))
     {
-        return (long long)cJSON_GetNumberValue(object);
+        value = (long long)cJSON_GetNumberValue(object);
     }
+    uniconf_reader_leave(epoch);
+    va_end(ap);
 
-    return 0;
+    return value;
 }
 
 /**
@@ -343,11 +1005,26 @@ static int stringFound(char *str, char *word, char *delim)
  */
 int uniconf_getBoolean(const char *format, ...)
 {
+    cJSON view;
     va_list ap;
     va_start(ap, format);
-    uniconf_t object = uniconf_object_v(uniconf_get_root(), format, ap);
+    unsigned long epoch = uniconf_reader_enter();
+    cJSON *object = uniconf_object_v(uniconf_root_mutable(), &view, format, ap);
+    int value = uniconf_boolean(object);
+    uniconf_reader_leave(epoch);
     va_end(ap);
 
+    return value;
+}
+
+/**
+ * @brief Treats the node as boolean
+ *
+ * @param object
+ * @return int : 1 - true, 0 - false, -1 - undefined string
+ */
+int uniconf_boolean(cJSON *object)
+{
     if (object)
     {
         if (cJSON_IsString(object))
@@ -372,7 +1049,7 @@ int uniconf_getBoolean(const char *format, ...)
         }
         else if (uniconf_IsComplex(object))
         {
-            return (int)cJSON_GetArraySize(object);
+            return uniconf_size(object) + (int)uniconf_listset_count(object);
         }
     }
     return 0;
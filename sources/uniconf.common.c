@@ -2,6 +2,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <locale.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
@@ -76,10 +77,10 @@ cJSON *uniconf_node(cJSON *root, const char *name)
 
     if (name && *name)
     {
-        node = cJSON_GetObjectItemCaseSensitive(root, name);
+        node = uniconf_intern_child(root, name);
         if (!node)
         {
-            node = cJSON_AddObjectToObject(root, name);
+            node = uniconf_add(root, name, cJSON_CreateObject());
             // node = cJSON_AddNullToObject(root, name);
         }
     }
@@ -87,6 +88,23 @@ cJSON *uniconf_node(cJSON *root, const char *name)
     return node;
 }
 
+/**
+ * Account the node added while constructing: the provenance and the budget
+ *
+ * @param node
+ *
+ * @return cJSON* : the node
+ */
+cJSON *uniconf_added(cJSON *node)
+{
+    if (node)
+    {
+        uniconf_whence_mark(node);
+        uniconf_budget_node();
+    }
+    return node;
+}
+
 /**
  * Create|get the NULL named node
  *
@@ -100,16 +118,64 @@ cJSON *uniconf_nodeNULL(cJSON *root, const char *name)
 
     if (name && *name)
     {
-        node = cJSON_GetObjectItemCaseSensitive(root, name);
+        node = uniconf_intern_child(root, name);
         if (!node)
         {
-            node = cJSON_AddNullToObject(root, name);
+            node = uniconf_add(root, name, cJSON_CreateNull());
         }
     }
 
     return node;
 }
 
+/**
+ * Copy the next line of the buffer, as getline
+ *
+ * @param line : the reused copy
+ * @param size : the allocated size
+ * @param ptr : the position, moved to the next line
+ * @param end : the buffer end
+ *
+ * @return char* : the line with '\n', if any | NULL = the end
+ */
+char *uniconf_getline(char **line, size_t *size, const char **ptr, const char *end)
+{
+    if (*ptr >= end)
+    {
+        return NULL;
+    }
+    const char *eol = memchr(*ptr, '\n', end - *ptr);
+    size_t len = (eol ? eol + 1 : end) - *ptr;
+    if (len + 1 > *size)
+    {
+        char *grown = realloc(*line, len + 1);
+        if (!grown)
+        {
+            return NULL;
+        }
+        *line = grown;
+        *size = len + 1;
+    }
+    memcpy(*line, *ptr, len);
+    (*line)[len] = '\0';
+    *ptr += len;
+    return *line;
+}
+
+/**
+ * Copy the next line of the buffer or of the stream
+ *
+ * @param lines
+ * @param line : the reused copy
+ * @param size : the allocated size
+ *
+ * @return char* : the line with '\n', if any | NULL = the end
+ */
+char *uniconf_lines_get(uniconf_lines_t *lines, char **line, size_t *size)
+{
+    return lines->stream ? uniconf_stream_getline(lines->stream, line, size) : uniconf_getline(line, size, &lines->ptr, lines->end);
+}
+
 /**
  * Is comment ?
  *
@@ -254,6 +320,60 @@ char *uniconf_unquote(char *str)
     return ptr;
 }
 
+/**
+ * Resolve one path segment against the node
+ *
+ * The single place where children are looked up,
+ * so any per-object index is used by all the walkers.
+ * Numeric segments address array items, negative ones count from the end.
+ * The lazy branches are loaded on the way.
+ *
+ * @param object
+ * @param name
+ *
+ * @return cJSON*
+ */
+cJSON *uniconf_lookup(cJSON *object, const char *name)
+{
+    if (object && name)
+    {
+        object = uniconf_lazy_load(object);
+        if (cJSON_IsArray(object))
+        {
+            long index = 0;
+            return uniconf_is_index(name, &index) ? uniconf_lazy_load(uniconf_item(object, index)) : NULL;
+        }
+        return uniconf_lazy_load(uniconf_fold_enabled() ? uniconf_fold_child(object, name) : cJSON_GetObjectItemCaseSensitive(object, name));
+    }
+    return NULL;
+}
+
+/**
+ * Walk the path from the node
+ *
+ * @param node
+ * @param path : NULL or empty = the node itself
+ *
+ * @return cJSON*
+ */
+cJSON *uniconf_walk(cJSON *node, const char *path)
+{
+    if (node && path && *path)
+    {
+        char *the_path = strdup(path);
+        if (!the_path)
+        {
+            return NULL;
+        }
+        for (char *sptr, *token = strtok_r(the_path, PATH_DELIM, &sptr); node && token; token = strtok_r(NULL, PATH_DELIM, &sptr))
+        {
+            node = uniconf_lookup(node, token);
+        }
+        free(the_path);
+    }
+    return node;
+}
+
 /**
  * Find the variable in the tree
  *
@@ -264,17 +384,33 @@ char *uniconf_unquote(char *str)
  */
 cJSON *uniconf_vardata(cJSON *root, char *varname)
 {
-    cJSON *var = root ? root : uniconf_get_root();
+    if (!root && varname && uniconf_layer_constructing())
+    {
+        return uniconf_layer_walk(varname, NULL);
+    }
+    cJSON *var = root ? root : uniconf_root_mutable();
     if (varname)
     {
         for (char *sptr, *token = strtok_r(varname, PATH_DELIM, &sptr); var && token; token = strtok_r(NULL, PATH_DELIM, &sptr))
         {
-            var = cJSON_GetObjectItemCaseSensitive(var, (const char *)token);
+            var = uniconf_lookup(var, (const char *)token);
         }
     }
     return var;
 }
 
+static size_t uniconf_substitutions = 0;
+
+/**
+ * Count the substituted variables since the start
+ *
+ * @return size_t
+ */
+size_t uniconf_substitute_count()
+{
+    return uniconf_substitutions;
+}
+
 /**
  * Try substitute named vars in the string.
  * Must be freed!
@@ -289,6 +425,8 @@ char *uniconf_substitute(cJSON *root, const char *str)
     char *result = NULL;
     if (str)
     {
+        uint64_t start = (UNICONF_PROBING(substitute) && strchr(str, '$')) ? uniconf_trace_clock() : 0;
+        size_t substitutions = uniconf_substitutions;
         char *buffer = strdup(str);
         char *pointer = buffer;
         while (strchr(pointer, '$'))
@@ -314,6 +452,9 @@ char *uniconf_substitute(cJSON *root, const char *str)
             char *varname = NULL;
             int len = 0;
             sscanf(pointer, "$%c%m[^])>}]%c%n", &lbr, &varname, &rbr, &len);
+            // the tree walk cuts the name, the environment takes only the plain ones
+            int plain = varname && !varname[strcspn(varname, PATH_DELIM)];
+            int closed = ('(' == lbr && ')' == rbr) || ('[' == lbr && ']' == rbr) || ('{' == lbr && '}' == rbr) || ('<' == lbr && '>' == rbr);
 
             cJSON *var = NULL;
             switch (lbr)
@@ -334,6 +475,7 @@ char *uniconf_substitute(cJSON *root, const char *str)
 
             if (var)
             {
+                uniconf_substitutions++;
                 if (cJSON_IsString(var))
                 {
                     char *temp = NULL;
@@ -352,13 +494,31 @@ char *uniconf_substitute(cJSON *root, const char *str)
                 }
                 pointer += len;
             }
+            else if (plain && closed && uniconf_environ_get(varname))
+            {
+                uniconf_substitutions++;
+                char *temp = NULL;
+                asprintf(&temp, "%s%s", result ? result : "", uniconf_environ_get(varname));
+                if (result)
+                    free(result);
+                result = temp;
+                pointer += len;
+            }
             else
             {
                 uniconf_error("WARNING: variable '%s' is undefined", varname);
+                if (UNICONF_PROBING(miss))
+                {
+                    UNICONF_TRACE(miss, UNICONF_TRACE_MISS, varname, NULL, 0, 0, 0);
+                }
                 FREE_AND_NULL(varname);
                 break;
             }
             FREE_AND_NULL(varname);
+            if (result && uniconf_budget_expansion(str, strlen(result)) < 0)
+            {
+                break;
+            }
         }
         char *temp = NULL;
         asprintf(&temp, "%s%s", result ? result : "", pointer);
@@ -366,6 +526,14 @@ char *uniconf_substitute(cJSON *root, const char *str)
             free(result);
         result = temp;
         free(buffer);
+        if (result && uniconf_substitutions != substitutions && uniconf_budget_expansion(str, strlen(result)) < 0)
+        {
+            FREE_AND_NULL(result); // the value is dropped
+        }
+        if (start)
+        {
+            UNICONF_TRACE(substitute, UNICONF_TRACE_SUBSTITUTE, str, NULL, 0, uniconf_substitutions - substitutions, uniconf_trace_clock() - start);
+        }
     }
     return result;
 }
@@ -383,19 +551,39 @@ int uniconf_set(cJSON *node, char *name, char *value)
 {
     if (node && name && value)
     {
-        if (cJSON_GetObjectItemCaseSensitive(node, name))
+        cJSON *previous = uniconf_intern_child(node, name);
+        if (previous)
         {
-            cJSON_DeleteItemFromObject(node, name);
+            cJSON_Delete(cJSON_DetachItemViaPointer(node, previous));
         }
-        cJSON *item = cJSON_CreateString(value);
-        if (item)
+        if (uniconf_add(node, name, cJSON_CreateString(value)))
         {
-            if (cJSON_AddItemToObject(node, name, item))
-            {
-                return 1;
-            }
-            cJSON_Delete(item);
+            return 1;
         }
     }
     return 0;
 }
+
+/**
+ * Convert the string to the double, the decimal point is '.' whatever the locale of the process
+ *
+ * @param str
+ * @param end : out, as strtod() | NULL
+ *
+ * @return double
+ */
+double uniconf_strtod(const char *str, char **end)
+{
+    static locale_t uniconf_c_locale = (locale_t)0; // created once, kept
+    locale_t locale = __atomic_load_n(&uniconf_c_locale, __ATOMIC_ACQUIRE);
+    if (!locale)
+    {
+        locale_t created = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+        if (created && !__atomic_compare_exchange_n(&uniconf_c_locale, &locale, created, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            freelocale(created); // by the other thread meanwhile
+        }
+        locale = locale ? locale : created;
+    }
+    return locale ? strtod_l(str, end, locale) : strtod(str, end);
+}
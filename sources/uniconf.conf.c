@@ -17,12 +17,14 @@ static int uniconf__set_array(cJSON *node, const char *name, config_setting_t *t
  * Parse the .conf file
  *
  * @param root
- * @param filepath
+ * @param buffer
+ * @param length
+ * @param source
  * @param branch
  *
  * @return int
  */
-int uniconf_conf(cJSON *root, const char *filepath, const char *branch)
+int uniconf_conf(cJSON *root, const char *buffer, size_t length, const char *source, const char *branch)
 {
     int count = 0;
     cJSON *node = uniconf_node(root, branch);
@@ -32,9 +34,11 @@ int uniconf_conf(cJSON *root, const char *filepath, const char *branch)
         config_t the_config;
         config_init(&the_config);
 
-        if ((CONFIG_FALSE == config_read_file(&the_config, filepath)))
+        (void)length; // '\0' terminated
+        if ((CONFIG_FALSE == config_read_string(&the_config, buffer)))
         {
-            uniconf_error_file(config_error_file(&the_config), config_error_line(&the_config), config_error_text(&the_config));
+            const char *file = config_error_file(&the_config);
+            uniconf_error_file(file ? file : source, config_error_line(&the_config), config_error_text(&the_config));
         }
         else
         {
@@ -52,6 +56,7 @@ static int uniconf__to_json(cJSON *node, config_setting_t *tree)
     int count = -1;
     if (node && tree)
     {
+        uniconf_whence_line(config_setting_source_line(tree));
         switch (config_setting_type(tree))
         {
         case CONFIG_TYPE_BOOL:
@@ -93,7 +98,7 @@ static int uniconf__set_number(cJSON *node, const char *name, double value)
     {
         if (cJSON_IsObject(node) && name)
         {
-            cJSON_AddNumberToObject(node, name, value);
+            uniconf_add(node, name, cJSON_CreateNumber(value));
             count = 1;
         }
         else if (cJSON_IsArray(node))
@@ -106,6 +111,7 @@ static int uniconf__set_number(cJSON *node, const char *name, double value)
             }
             else
             {
+                uniconf_added(item);
                 count = 1;
             }
         }
@@ -123,7 +129,7 @@ static int uniconf__set_string(cJSON *node, const char *name, const char *value)
         {
             if (cJSON_IsObject(node) && name)
             {
-                cJSON_AddStringToObject(node, name, expanded);
+                uniconf_add(node, name, cJSON_CreateString(expanded));
                 count = 1;
             }
             else if (cJSON_IsArray(node))
@@ -136,6 +142,7 @@ static int uniconf__set_string(cJSON *node, const char *name, const char *value)
                 }
                 else
                 {
+                    uniconf_added(item);
                     count = 1;
                 }
             }
@@ -150,11 +157,20 @@ static int uniconf__set_all(cJSON *node, config_setting_t *tree)
     int count = 0;
     if (node)
     {
+        int depth = 0;
+        for (config_setting_t *setting = tree; setting && !config_setting_is_root(setting); setting = config_setting_parent(setting))
+        {
+            depth++;
+        }
+        if (uniconf_budget_depth(NULL, config_setting_source_line(tree), depth) < 0)
+        {
+            return -2;
+        }
         int len = config_setting_length(tree);
         for (int i = 0; i < len; i++)
         {
             int ret = uniconf__to_json(node, config_setting_get_elem(tree, i));
-            if (ret < 0)
+            if (ret < 0 || uniconf_budget_error())
             {
                 return -2;
             }
@@ -172,12 +188,12 @@ static int uniconf__set_object(cJSON *node, const char *name, config_setting_t *
         count = 0;
         if (cJSON_IsObject(node) && name)
         {
-            node = cJSON_AddObjectToObject(node, name);
+            node = uniconf_add(node, name, cJSON_CreateObject());
         }
         else if (cJSON_IsArray(node))
         {
             cJSON *obj = cJSON_CreateObject();
-            cJSON_AddItemToArray(node, obj);
+            cJSON_AddItemToArray(node, uniconf_added(obj));
             node = obj;
         }
         if (node)
@@ -197,12 +213,12 @@ static int uniconf__set_array(cJSON *node, const char *name, config_setting_t *t
         count = 0;
         if (cJSON_IsObject(node) && name)
         {
-            node = cJSON_AddArrayToObject(node, name);
+            node = uniconf_add(node, name, cJSON_CreateArray());
         }
         else if (cJSON_IsArray(node))
         {
             cJSON *arr = cJSON_CreateArray();
-            cJSON_AddItemToArray(node, arr);
+            cJSON_AddItemToArray(node, uniconf_added(arr));
             node = arr;
         }
         if (node)
@@ -7,25 +7,25 @@
 #include <string.h>
 
 /**
- * Parse the .env file
+ * Parse the lines of the .env file
  *
  * Removes quotes, if any.
  * Each $() variable will be replaced.
  * Trailing comments start with ###
  *
  * @param root
- * @param filepath
+ * @param lines
  * @param branch
  *
  * @return int
  */
-int uniconf_env(cJSON *root, const char *filepath, const char *branch)
+static int uniconf__env(cJSON *root, uniconf_lines_t *lines, const char *branch)
 {
     int count = 0;
     cJSON *node = uniconf_node(root, branch);
     if (node)
     {
-        uniconf_FileByLine(filepath, line)
+        uniconf_LinesByLine(lines, line)
         {
             if (!uniconf_is_commented(line, "#"))
             {
@@ -52,3 +52,38 @@ int uniconf_env(cJSON *root, const char *filepath, const char *branch)
 
     return count;
 }
+
+/**
+ * Parse the .env file
+ *
+ * @param root
+ * @param buffer
+ * @param length
+ * @param source
+ * @param branch
+ *
+ * @return int
+ */
+int uniconf_env(cJSON *root, const char *buffer, size_t length, const char *source, const char *branch)
+{
+    (void)source; // nothing to report
+    uniconf_lines_t lines = {.ptr = buffer, .end = buffer + length};
+    return uniconf__env(root, &lines, branch);
+}
+
+/**
+ * Parse the .env file while decompressing
+ *
+ * @param root
+ * @param stream
+ * @param source
+ * @param branch
+ *
+ * @return int
+ */
+int uniconf_env_stream(cJSON *root, uniconf_stream_t *stream, const char *source, const char *branch)
+{
+    (void)source; // nothing to report
+    uniconf_lines_t lines = {.stream = stream};
+    return uniconf__env(root, &lines, branch);
+}
@@ -0,0 +1,267 @@
+#include "uniconf.internal.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+extern char **environ;
+
+/**
+ * The process environment overlay
+ *
+ * $(VAR) falls back to the environment when the tree has no such variable:
+ * the index of the environ entries is built by one scan on the first miss
+ * and lives until the end of the construct or the lazy load, the entries are not copied.
+ * The index is of the thread, as the tree it builds.
+ *
+ * The prefixed variables override the tree at the end of the construct:
+ * APP__DB__HOST=value -> db.host = "value"
+ */
+
+typedef struct uniconf_environ_entry
+{
+    const char *entry; // NAME=VALUE in the environ
+    size_t namelen;
+} uniconf_environ_entry_t;
+
+static int uniconf_environ_fallback = 0;
+static char *uniconf_environ_prefix = NULL;
+
+// of the building thread
+static __thread uniconf_environ_entry_t *uniconf_environ_index = NULL;
+static __thread size_t uniconf_environ_mask = 0;
+
+#define ENVIRON_DELIM "__"
+
+/**
+ * Enable|disable the $() fallback to the process environment
+ *
+ * @param enabled
+ */
+void uniconf_env_fallback(int enabled)
+{
+    uniconf_environ_fallback = enabled;
+}
+
+/**
+ * Set the prefix of the overriding variables
+ *
+ * @param prefix : NULL = no overrides
+ */
+void uniconf_env_prefix(const char *prefix)
+{
+    FREE_AND_NULL(uniconf_environ_prefix);
+    if (prefix && *prefix)
+    {
+        uniconf_environ_prefix = strdup(prefix);
+    }
+}
+
+/**
+ * Hash the name (FNV-1a)
+ *
+ * @param name
+ * @param len
+ *
+ * @return size_t
+ */
+static size_t uniconf__environ_hash(const char *name, size_t len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)name[i];
+        h *= 0x100000001b3ULL;
+    }
+    return (size_t)(h ^ (h >> 32));
+}
+
+/**
+ * Index the environ by one scan
+ *
+ * @return int : <0 = error, >=0 = count
+ */
+static int uniconf__environ_scan()
+{
+    size_t count = 0;
+    for (char **env = environ; env && *env; env++)
+    {
+        count++;
+    }
+
+    size_t size = 16;
+    while (size < count * 2)
+    {
+        size <<= 1;
+    }
+    uniconf_environ_index = calloc(size, sizeof(uniconf_environ_entry_t));
+    if (!uniconf_environ_index)
+    {
+        return -ENOMEM;
+    }
+    uniconf_environ_mask = size - 1;
+
+    for (char **env = environ; env && *env; env++)
+    {
+        char *eq = strchr(*env, '=');
+        if (eq)
+        {
+            size_t len = eq - *env;
+            size_t at = uniconf__environ_hash(*env, len) & uniconf_environ_mask;
+            while (uniconf_environ_index[at].entry)
+            {
+                if (len == uniconf_environ_index[at].namelen && !memcmp(*env, uniconf_environ_index[at].entry, len))
+                {
+                    break; // the first one wins, as getenv()
+                }
+                at = (at + 1) & uniconf_environ_mask;
+            }
+            if (!uniconf_environ_index[at].entry)
+            {
+                uniconf_environ_index[at] = (uniconf_environ_entry_t){.entry = *env, .namelen = len};
+            }
+        }
+    }
+    return (int)count;
+}
+
+/**
+ * Find the environment variable
+ *
+ * @param name
+ *
+ * @return const char* the value | NULL
+ */
+const char *uniconf_environ_get(const char *name)
+{
+    if (!uniconf_environ_fallback || !name)
+    {
+        return NULL;
+    }
+    if (!uniconf_environ_index && uniconf__environ_scan() < 0)
+    {
+        return NULL;
+    }
+
+    size_t len = strlen(name);
+    for (size_t at = uniconf__environ_hash(name, len) & uniconf_environ_mask; uniconf_environ_index[at].entry; at = (at + 1) & uniconf_environ_mask)
+    {
+        if (len == uniconf_environ_index[at].namelen && !memcmp(name, uniconf_environ_index[at].entry, len))
+        {
+            return uniconf_environ_index[at].entry + len + 1;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Drop the index of the thread, the environ may change before the next construct
+ *
+ */
+void uniconf_environ_close()
+{
+    FREE_AND_NULL(uniconf_environ_index);
+    uniconf_environ_mask = 0;
+}
+
+/**
+ * Apply one overriding variable
+ *
+ * @param root
+ * @param name : the part after the prefix
+ * @param value
+ *
+ * @return int : 1 = applied, 0 = conflict
+ */
+static int uniconf__environ_apply(cJSON *root, const char *name, const char *value)
+{
+    char *path = strndup(name, strcspn(name, "="));
+    if (!path)
+    {
+        return 0;
+    }
+    for (char *ptr = path; *ptr; ptr++)
+    {
+        *ptr = tolower(*ptr);
+    }
+
+    int ret = 0;
+    cJSON *node = root;
+    char *segment = path;
+    while (node && segment)
+    {
+        char *next = strstr(segment, ENVIRON_DELIM);
+        if (next)
+        {
+            *next = '\0';
+            next += strlen(ENVIRON_DELIM);
+        }
+
+        if (cJSON_IsArray(node))
+        {
+            long index = 0;
+            cJSON *item = uniconf_is_index(segment, &index) ? uniconf_item(node, index) : NULL;
+            if (item && !next)
+            {
+                cJSON *string = cJSON_CreateString(value);
+                ret = string && cJSON_ReplaceItemViaPointer(node, item, uniconf_added(string));
+            }
+            node = item;
+        }
+        else if (cJSON_IsObject(node))
+        {
+            // the existing key in any case, or the new lowercase one
+            cJSON *item = uniconf_lazy_load(cJSON_GetObjectItem(node, segment));
+            if (!next)
+            {
+                char *key = strdup(item ? item->string : segment);
+                ret = key && uniconf_set(node, key, (char *)value);
+                FREE_AND_NULL(key);
+            }
+            else if (!item)
+            {
+                item = uniconf_node(node, segment);
+            }
+            node = item;
+        }
+        else
+        {
+            node = NULL;
+        }
+        segment = next;
+    }
+
+    if (!ret)
+    {
+        uniconf_error("ERROR: environment variable '%s%.*s' conflicts with the tree", uniconf_environ_prefix, (int)strcspn(name, "="), name);
+    }
+    free(path);
+    return ret;
+}
+
+/**
+ * Apply the prefixed environment variables in one pass
+ *
+ * @param root
+ *
+ * @return int : the count of the overridden values
+ */
+int uniconf_environ_override(cJSON *root)
+{
+    int count = 0;
+    if (root && uniconf_environ_prefix)
+    {
+        size_t len = strlen(uniconf_environ_prefix);
+        for (char **env = environ; env && *env; env++)
+        {
+            char *eq = strchr(*env, '=');
+            if (eq && !strncmp(*env, uniconf_environ_prefix, len) && (eq - *env) > (ptrdiff_t)len)
+            {
+                count += uniconf__environ_apply(root, *env + len, eq + 1);
+            }
+        }
+    }
+    return count;
+}
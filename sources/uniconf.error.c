@@ -2,6 +2,9 @@
 #include <stdarg.h>
 #include <stdio.h>
 
+// of the thread, NULL = the "errors" of the root
+static __thread cJSON *uniconf_error_target = NULL;
+
 static void uniconf_error_v(const char *format, va_list ap);
 void uniconf_error(const char *format, ...);
 void uniconf_error_file(const char *filename, int line, const char *message, ...);
@@ -14,13 +17,13 @@ void uniconf_error_file(const char *filename, int line, const char *message, ...
  */
 static void uniconf_error_v(const char *format, va_list ap)
 {
-    cJSON *root = uniconf_get_root();
-    if (root && format && *format)
+    cJSON *root = uniconf_root_mutable();
+    if ((root || uniconf_error_target) && format && *format)
     {
-        cJSON *errors = cJSON_GetObjectItemCaseSensitive(root, "errors");
+        cJSON *errors = uniconf_error_target ? uniconf_error_target : uniconf_intern_child(root, "errors");
         if (!errors)
         {
-            errors = cJSON_AddArrayToObject(root, "errors");
+            errors = uniconf_add(root, "errors", cJSON_CreateArray());
         }
 
         char *text = NULL;
@@ -32,6 +35,20 @@ static void uniconf_error_v(const char *format, va_list ap)
     }
 }
 
+/**
+ * Send the errors of the thread to the array
+ *
+ * @param errors : NULL = to the root
+ *
+ * @return cJSON* : the previous one
+ */
+cJSON *uniconf_error_redirect(cJSON *errors)
+{
+    cJSON *previous = uniconf_error_target;
+    uniconf_error_target = errors;
+    return previous;
+}
+
 /**
  * Add the free error string
  *
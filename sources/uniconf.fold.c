@@ -0,0 +1,269 @@
+#include "uniconf.internal.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+/**
+ * The case-insensitive lookups
+ *
+ * In the case-insensitive mode each object of the constructed tree gets the table
+ * of its children by the case-folded key hash, so "DB_Host", "db_host" and "DB_HOST"
+ * are found by one probe instead of the strcasecmp walk.
+ * The keys differing only by the case are reported by the construct, the first one is found.
+ *
+ * The tree is read-only, the tables hold the children until the tree is retired, the lazy branches are walked.
+ * The tables of the new tree are published with it, the replaced ones are freed by the next construct.
+ */
+
+typedef struct uniconf_fold_slot
+{
+    uint64_t hash;
+    cJSON *item;
+} uniconf_fold_slot_t;
+
+typedef struct uniconf_fold
+{
+    size_t mask;
+    uniconf_fold_slot_t slots[];
+} uniconf_fold_t;
+
+static int uniconf_fold_mode = 0;
+static int uniconf_fold_active = 0;
+static uniconf_map_t *uniconf_folds = NULL;
+static uniconf_map_t *uniconf_folds_retired = NULL; // of the previous tree
+
+/**
+ * Enable|disable the case-insensitive keys for the next constructs
+ *
+ * @param enabled
+ */
+void uniconf_ignore_case(int enabled)
+{
+    uniconf_fold_mode = enabled;
+}
+
+/**
+ * Is the current tree case-insensitive, the tree being constructed is not
+ *
+ * @return int
+ */
+int uniconf_fold_enabled()
+{
+    return !uniconf_constructing() && __atomic_load_n(&uniconf_fold_active, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Hash the case-folded key (FNV-1a)
+ *
+ * @param key
+ *
+ * @return uint64_t
+ */
+static uint64_t uniconf__fold_hash(const char *key)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (const unsigned char *ptr = (const unsigned char *)key; *ptr; ptr++)
+    {
+        h ^= tolower(*ptr);
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/**
+ * Build the table of the object children
+ *
+ * @param folds
+ * @param object
+ * @param path : the object path for the conflicts
+ * @param conflicts : the messages or NULL
+ *
+ * @return int : <0 = error
+ */
+static int uniconf__fold_table(uniconf_map_t *folds, cJSON *object, const char *path, cJSON *conflicts)
+{
+    size_t count = 0;
+    uniconf_EachChild(item, object)
+    {
+        count++;
+    }
+    if (!count)
+    {
+        return 0;
+    }
+    size_t size = 4;
+    while (size < count * 2)
+    {
+        size <<= 1;
+    }
+    uniconf_fold_t *fold = calloc(1, sizeof(uniconf_fold_t) + size * sizeof(uniconf_fold_slot_t));
+    if (!fold)
+    {
+        return -ENOMEM;
+    }
+    fold->mask = size - 1;
+
+    uniconf_EachChild(item, object)
+    {
+        if (!item->string)
+        {
+            continue;
+        }
+        uint64_t hash = uniconf__fold_hash(item->string);
+        size_t at = hash & fold->mask;
+        for (; fold->slots[at].item; at = (at + 1) & fold->mask)
+        {
+            const char *known = fold->slots[at].item->string;
+            if (fold->slots[at].hash == hash && !strcasecmp(known, item->string))
+            {
+                break;
+            }
+        }
+        if (!fold->slots[at].item)
+        {
+            fold->slots[at] = (uniconf_fold_slot_t){.hash = hash, .item = item};
+        }
+        else if (conflicts && strcmp(fold->slots[at].item->string, item->string))
+        {
+            char *message = NULL;
+            asprintf(&message, "WARNING: conflicting keys '%s' and '%s' at '%s'", fold->slots[at].item->string, item->string, path);
+            cJSON_AddItemToArray(conflicts, cJSON_CreateString(message ? message : ""));
+            FREE_AND_NULL(message);
+        }
+    }
+
+    void **slot = uniconf_map_slot(folds, object);
+    if (!slot)
+    {
+        free(fold);
+        return -ENOMEM;
+    }
+    free(*slot);
+    *slot = fold;
+    return 1;
+}
+
+/**
+ * Build the tables of the subtree
+ *
+ * @param folds
+ * @param node
+ * @param path
+ * @param conflicts
+ *
+ * @return int : the count of the objects
+ */
+static int uniconf__fold_build(uniconf_map_t *folds, cJSON *node, const char *path, cJSON *conflicts)
+{
+    int count = 0;
+    if (cJSON_IsObject(node))
+    {
+        count += (uniconf__fold_table(folds, node, path, conflicts) > 0);
+    }
+    int index = 0;
+    uniconf_EachChild(item, node)
+    {
+        if (uniconf_IsComplex(item))
+        {
+            char *child = NULL;
+            if (item->string)
+            {
+                asprintf(&child, "%s%s%s", path, *path ? "." : "", item->string);
+            }
+            else
+            {
+                asprintf(&child, "%s%s%d", path, *path ? "." : "", index);
+            }
+            count += uniconf__fold_build(folds, item, child ? child : path, conflicts);
+            FREE_AND_NULL(child);
+        }
+        index++;
+    }
+    return count;
+}
+
+/**
+ * Build the tables of the constructed tree, report the conflicting keys, publish the tables
+ * The tables of the replaced tree are kept until uniconf_fold_release().
+ *
+ * @param root
+ *
+ * @return int : the count of the conflicts
+ */
+int uniconf_fold_build(cJSON *root)
+{
+    int active = uniconf_fold_mode && root;
+    uniconf_map_t *folds = active ? uniconf_map_create(0) : NULL;
+    int count = 0;
+    if (folds)
+    {
+        cJSON *conflicts = cJSON_CreateArray();
+        uniconf__fold_build(folds, root, "", conflicts);
+        uniconf_EachChild(message, conflicts)
+        {
+            uniconf_error("%s", message->valuestring);
+            count++;
+        }
+        cJSON_Delete(conflicts);
+        if (count)
+        {
+            // the root has got the errors
+            uniconf__fold_table(folds, root, "", NULL);
+        }
+    }
+    uniconf_map_destroy(uniconf_folds_retired, free);
+    uniconf_folds_retired = __atomic_exchange_n(&uniconf_folds, folds, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&uniconf_fold_active, active, __ATOMIC_RELEASE);
+    return count;
+}
+
+/**
+ * Free the tables of the replaced tree
+ *
+ */
+void uniconf_fold_release()
+{
+    uniconf_map_destroy(uniconf_folds_retired, free);
+    uniconf_folds_retired = NULL;
+}
+
+/**
+ * Get the child by the case-insensitive name
+ *
+ * @param object
+ * @param name
+ *
+ * @return cJSON*
+ */
+cJSON *uniconf_fold_child(const cJSON *object, const char *name)
+{
+    uniconf_fold_t *fold = uniconf_map_get(__atomic_load_n(&uniconf_folds, __ATOMIC_ACQUIRE), object);
+    if (!fold)
+    {
+        return cJSON_GetObjectItem(object, name);
+    }
+    uint64_t hash = uniconf__fold_hash(name);
+    for (size_t at = hash & fold->mask; fold->slots[at].item; at = (at + 1) & fold->mask)
+    {
+        if (fold->slots[at].hash == hash && !strcasecmp(fold->slots[at].item->string, name))
+        {
+            return fold->slots[at].item;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Drop all the tables
+ *
+ */
+void uniconf_fold_reset()
+{
+    uniconf_fold_release();
+    uniconf_map_destroy(uniconf_folds, free);
+    uniconf_folds = NULL;
+    uniconf_fold_active = 0;
+}
@@ -17,15 +17,18 @@
 #define _GNU_SOURCE
 
 #include <cjson/cJSON.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #define PATH_DELIM "./:\\ "
 
-typedef cJSON *uniconf_t;
+// the nodes of the constructed tree are read-only, the lookups index them
+typedef const cJSON *uniconf_t;
 
 uniconf_t uniconf_get_root();
 
-// interface
+// interface, the construct publishes the complete tree at once,
+// the nodes got from the replaced tree stay valid until the next construct starts
 int uniconf_construct(const char *format, ...);
 void uniconf_destruct();
 
@@ -34,10 +37,197 @@ char *uniconf_getString(const char *format, ...);
 long long uniconf_getNumber(const char *format, ...);
 int uniconf_getBoolean(const char *format, ...);
 
+// in-memory sources
+typedef struct uniconf_source
+{
+    const char *name;   // the relative path as in the directory, "region/db.yml"
+    const char *format; // the extension, NULL = of the name
+    const char *buffer;
+    size_t length;
+} uniconf_source_t;
+
+int uniconf_construct_sources(const uniconf_source_t *sources, size_t count);
+int uniconf_construct_buffer(const char *format, const char *buffer, size_t length);
+
+// asynchronous construct, the callback is called on its thread after the tree is published
+typedef struct uniconf_async uniconf_async_t;
+
+typedef void (*uniconf_async_f)(int result, void *data);
+
+typedef struct uniconf_progress
+{
+    size_t files;
+    size_t total; // of the files to parse, 0 = not counted yet
+    size_t bytes; // parsed
+    int done;
+} uniconf_progress_t;
+
+uniconf_async_t *uniconf_construct_async(uniconf_async_f callback, void *data, const char *format, ...);
+int uniconf_async_wait(uniconf_async_t *async);
+int uniconf_async_timedwait(uniconf_async_t *async, unsigned milliseconds);
+void uniconf_async_progress(uniconf_async_t *async, uniconf_progress_t *progress);
+int uniconf_async_free(uniconf_async_t *async);
+
+// layers, the later is above
+int uniconf_layer(const char *name, const char *format, ...);
+int uniconf_layer_remove(const char *name);
+uniconf_t uniconf_layer_get(const char *name);
+char *uniconf_layer_errors(const char *name);
+
+// provenance
+typedef struct uniconf_whence
+{
+    const char *file;  // the file|directory path
+    int line;          // 0 = the whole file
+    const char *layer; // NULL = the constructed tree
+} uniconf_whence_t;
+
+void uniconf_provenance(int enabled);
+int uniconf_whence(uniconf_whence_t *whence, const char *format, ...);
+
+// profiling
+typedef struct uniconf_file_stats
+{
+    const char *filepath;
+    int count; // the parser result
+    uint64_t nanoseconds;
+    size_t substitutions;
+} uniconf_file_stats_t;
+
+typedef void (*uniconf_profile_f)(const uniconf_file_stats_t *stats, void *data);
+
+void uniconf_profile(uniconf_profile_f callback, void *data);
+
+// construction budgets, 0 = unlimited
+typedef struct uniconf_budget
+{
+    size_t file_size;      // of each file, decompressed
+    size_t total_size;     // of all the files
+    size_t nodes;          // of the tree
+    int depth;             // the nesting in a file
+    size_t expansion;      // the length of the substituted string
+    unsigned milliseconds; // the wall time
+} uniconf_budget_t;
+
+void uniconf_budget(const uniconf_budget_t *budget);
+
+// access profile, {"path": count}
+void uniconf_access_sampling(int period);
+int uniconf_reorganize();
+char *uniconf_access_export();
+int uniconf_access_load(const char *json);
+
+// tracing, the USDT probes uniconf:file__start, file__done, scan, substitute, miss, lookup get the same arguments
+typedef enum uniconf_trace_event
+{
+    UNICONF_TRACE_FILE_START, // path, parser, size
+    UNICONF_TRACE_FILE_DONE,  // path, parser, size, result = the parser result, nanoseconds
+    UNICONF_TRACE_SCAN,       // path = the directory, size = the entries, result = the count, nanoseconds
+    UNICONF_TRACE_SUBSTITUTE, // path = the string, result = the substituted variables, nanoseconds
+    UNICONF_TRACE_MISS,       // path = the undefined variable
+    UNICONF_TRACE_LOOKUP,     // path, result = found, nanoseconds
+} uniconf_trace_event_t;
+
+typedef struct uniconf_trace
+{
+    uniconf_trace_event_t event;
+    const char *path;
+    const char *parser; // the extension
+    size_t size;
+    int result;
+    uint64_t nanoseconds;
+} uniconf_trace_t;
+
+typedef void (*uniconf_trace_f)(const uniconf_trace_t *trace, void *data);
+
+void uniconf_trace(uniconf_trace_f callback, void *data);
+
+// parsers, the buffer is followed by '\0'
+typedef int (*uniconf_parser_f)(cJSON *root, const char *buffer, size_t length, const char *source, const char *branch);
+
+int uniconf_parser_register(const char *extension, uniconf_parser_f parser);
+uniconf_parser_f uniconf_parser_find(const char *extension);
+
+// compiled snapshots
+int uniconf_compile(const char *filepath);
+void *uniconf_compile_image(size_t *size);
+int uniconf_attach_file(const char *filepath);
+int uniconf_mount(const void *image, size_t size);
+int uniconf_mount_base(const void *image, size_t size);
+
+// typed binding, used by the generated code
+const char *uniconf_typeName(const cJSON *node);
+int uniconf_asNumber(const cJSON *node, long long *value);
+int uniconf_asDouble(const cJSON *node, double *value);
+int uniconf_asBoolean(const cJSON *node, int *value);
+int uniconf_asString(const cJSON *node, const char **value);
+int uniconf_bind_error(const char *schema, const char *path, const char *expected, const cJSON *node);
+char *uniconf_bind_errors();
+
+// shared snapshots, the strings and objects got from the attached one stay valid
+// until the generation after the next one is mapped by a getter, or until uniconf_detach()
+int uniconf_publish(const char *name);
+int uniconf_unpublish(const char *name);
+int uniconf_attach(const char *name);
+void uniconf_detach();
+uint64_t uniconf_generation();
+
+// interned keys
+void uniconf_intern_keys(int enabled);
+size_t uniconf_intern_count();
+
+// case-insensitive keys
+void uniconf_ignore_case(int enabled);
+
+// compact lists
+void uniconf_list_compact(int enabled);
+int uniconf_listContains(const char *path, const char *value);
+const char *uniconf_listMatch(const char *path, const char *value);
+int uniconf_listPrefix(const char *path, const char *prefix, const char **entries, int max);
+int uniconf_listSize(const char *path);
+
+// lazy branches
+void uniconf_lazy(int enabled);
+char *uniconf_lazy_errors();
+const cJSON *uniconf_children(const cJSON *node);
+
+// process environment
+void uniconf_env_fallback(int enabled);
+void uniconf_env_prefix(const char *prefix);
+
+// structural hashes
+uint64_t uniconf_hash(const cJSON *node);
+uint64_t uniconf_version();
+int uniconf_equal(const cJSON *a, const cJSON *b);
+cJSON *uniconf_diff(const cJSON *previous, const cJSON *current);
+
+// versions
+void uniconf_versions_keep(int depth);
+int uniconf_versions(uint64_t *versions, int max);
+int uniconf_rollback(uint64_t version);
+
+// subscriptions
+typedef void (*uniconf_callback_f)(const char *path, uniconf_t previous, uniconf_t current, void *data);
+
+int uniconf_subscribe(uniconf_callback_f callback, void *data, const char *format, ...);
+int uniconf_unsubscribe(int id);
+
+// queries
+typedef struct uniconf_query uniconf_query_t;
+typedef struct uniconf_cursor uniconf_cursor_t;
+
+uniconf_query_t *uniconf_query_compile(const char *format, ...);
+void uniconf_query_free(uniconf_query_t *query);
+uniconf_cursor_t *uniconf_query_exec(const uniconf_query_t *query, uniconf_t root);
+uniconf_t uniconf_cursor_next(uniconf_cursor_t *cursor);
+void uniconf_cursor_rewind(uniconf_cursor_t *cursor);
+void uniconf_cursor_close(uniconf_cursor_t *cursor);
+
 #define uniconf_IsArray(element) cJSON_IsArray(element)
 #define uniconf_IsObject(element) cJSON_IsObject(element)
 #define uniconf_IsComplex(element) (cJSON_IsArray(element) || cJSON_IsObject(element))
 #define uniconf_GetName(element) ((element)->string)
-#define uniconf_ForEach(element, array) for (cJSON *element = (array != NULL) ? (array)->child : NULL; element != NULL; element = element->next)
+#define uniconf_ForEach(element, array) for (const cJSON *element = uniconf_children(array); element != NULL; element = element->next)
+#define uniconf_ForEachMatch(element, cursor) for (const cJSON *element = uniconf_cursor_next(cursor); element != NULL; element = uniconf_cursor_next(cursor))
 
 #endif // UNICONF_H
@@ -0,0 +1,466 @@
+#include "uniconf.internal.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The structural (Merkle) hashes
+ *
+ * Each node of the constructed tree gets the hash of its type, value and children,
+ * computed bottom-up once per construct. Equal subtrees have equal hashes,
+ * so the equality check is O(1) and the diff descends only into changed subtrees.
+ * Object hashes don't depend on the order of the keys, as cJSON_Compare.
+ *
+ * The hashes of the new tree are published with it, the hashes of the previous tree are kept
+ * for the subscribers and the getters still reading it, until the next construct.
+ * The lazy branches not loaded are hashed by their directories and the construct, as their content
+ * isn't known: the stored hashes are kept after the load, so the version doesn't change until the next construct.
+ */
+
+static uniconf_map_t *uniconf_hashes = NULL;
+static uniconf_map_t *uniconf_hashes_previous = NULL;
+static uniconf_map_t *uniconf_hashes_retired = NULL; // of the freed tree, may be read until the next construct
+static uint64_t uniconf_hashes_construct = 0;       // the count of the hashed trees
+
+#define HASH_SEED 0x9e3779b97f4a7c15ULL
+
+/**
+ * Finalize the bits (splitmix64)
+ *
+ * @param x
+ *
+ * @return uint64_t
+ */
+static uint64_t uniconf__mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/**
+ * Hash the string (FNV-1a)
+ *
+ * @param str
+ * @param seed
+ *
+ * @return uint64_t
+ */
+static uint64_t uniconf__string(const char *str, uint64_t seed)
+{
+    uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+    for (const unsigned char *ptr = (const unsigned char *)(str ? str : ""); *ptr; ptr++)
+    {
+        h ^= *ptr;
+        h *= 0x100000001b3ULL;
+    }
+    return uniconf__mix(h);
+}
+
+/**
+ * Get the known hash
+ *
+ * @param node
+ *
+ * @return uint64_t : 0 = unknown
+ */
+static uint64_t uniconf__known(const cJSON *node)
+{
+    void *hash = uniconf_map_get(__atomic_load_n(&uniconf_hashes, __ATOMIC_ACQUIRE), node);
+    if (!hash)
+    {
+        hash = uniconf_map_get(__atomic_load_n(&uniconf_hashes_previous, __ATOMIC_ACQUIRE), node);
+    }
+    return (uint64_t)(uintptr_t)hash;
+}
+
+/**
+ * Keep the hash of the node
+ *
+ * @param store : or NULL
+ * @param node
+ * @param h
+ *
+ * @return uint64_t : h
+ */
+static uint64_t uniconf__store(uniconf_map_t *store, const cJSON *node, uint64_t h)
+{
+    void **slot = store ? uniconf_map_slot(store, node) : NULL;
+    if (slot)
+    {
+        *slot = (void *)(uintptr_t)h;
+    }
+    return h;
+}
+
+/**
+ * Compute the hash of the node
+ *
+ * @param node
+ * @param store : the map to keep the hashes of the subtree or NULL
+ *
+ * @return uint64_t : 0 = unknown
+ */
+static uint64_t uniconf__compute(const cJSON *node, uniconf_map_t *store)
+{
+    int unknown = 0;
+    uint64_t type = (uint64_t)(node->type & 0xFF);
+    uint64_t h = uniconf__mix(HASH_SEED + type);
+
+    if (uniconf_lazy_pending_node(node))
+    {
+        // not forcing the load: the registered paths, and the construct as the content may differ
+        char **paths = NULL;
+        int count = uniconf_lazy_paths(node, &paths);
+        h = store ? uniconf__mix(h ^ uniconf_hashes_construct) : h;
+        for (int i = 0; i < count; i++)
+        {
+            h = uniconf__string(paths[i], h);
+        }
+        return count ? uniconf__store(store, node, h ? h : 1) : 0;
+    }
+
+    switch (node->type & 0xFF)
+    {
+    case cJSON_Number:
+    {
+        double value = (0 == node->valuedouble) ? 0 : node->valuedouble; // -0 == 0
+        uint64_t bits = 0;
+        memcpy(&bits, &value, sizeof(bits));
+        h = uniconf__mix(h ^ bits);
+    }
+    break;
+    case cJSON_String:
+    case cJSON_Raw:
+        h = uniconf__string(node->valuestring, h);
+        break;
+    case cJSON_Array:
+    {
+        uint64_t count = 0;
+        uniconf_EachChild(item, node)
+        {
+            uint64_t child = store ? uniconf__compute(item, store) : uniconf_hash(item);
+            unknown |= !child;
+            h = uniconf__mix(h ^ child) + HASH_SEED;
+            count++;
+        }
+        h = uniconf__mix(h ^ count ^ uniconf_listset_hash(node)); // the compact list entries
+    }
+    break;
+    case cJSON_Object:
+    {
+        uint64_t sum = 0;
+        uint64_t count = 0;
+        uniconf_EachChild(item, node)
+        {
+            uint64_t child = store ? uniconf__compute(item, store) : uniconf_hash(item);
+            unknown |= !child;
+            sum += uniconf__mix(uniconf__string(item->string, HASH_SEED) ^ (child * HASH_SEED));
+            count++;
+        }
+        h = uniconf__mix(h ^ sum ^ uniconf__mix(count));
+    }
+    break;
+    }
+
+    return unknown ? 0 : uniconf__store(store, node, h ? h : 1);
+}
+
+/**
+ * Hash the new tree and publish the hashes
+ * The hashes of the replaced tree are kept until uniconf_hash_release()
+ *
+ * @param root
+ *
+ * @return uint64_t : the root hash
+ */
+uint64_t uniconf_hash_build(cJSON *root)
+{
+    uniconf_map_t *hashes = uniconf_map_create(uniconf_map_count(uniconf_hashes));
+    uniconf_hashes_construct++;
+    uint64_t hash = (root && hashes) ? uniconf__compute(root, hashes) : 0;
+    __atomic_store_n(&uniconf_hashes_previous, uniconf_hashes, __ATOMIC_RELEASE); // dropped by the release
+    __atomic_store_n(&uniconf_hashes, hashes, __ATOMIC_RELEASE);
+    return hash;
+}
+
+/**
+ * Drop the hashes of the replaced tree, when it is freed
+ * Their nodes addresses may be reused by the next tree. The getters entered before
+ * may still read the map, it is freed by the next release.
+ *
+ */
+void uniconf_hash_release()
+{
+    uniconf_map_destroy(uniconf_hashes_retired, NULL);
+    uniconf_hashes_retired = __atomic_exchange_n(&uniconf_hashes_previous, NULL, __ATOMIC_ACQ_REL);
+}
+
+/**
+ * Drop all the hashes
+ *
+ */
+void uniconf_hash_reset()
+{
+    uniconf_hash_release();
+    uniconf_hash_release(); // the previous one retired by the first
+    uniconf_map_destroy(uniconf_hashes, NULL);
+    uniconf_hashes = NULL;
+}
+
+/**
+ * Get the structural hash of the node
+ * O(1) for the nodes of the constructed tree, computed for the others.
+ *
+ * @param node
+ *
+ * @return uint64_t : 0 = NULL node
+ */
+uint64_t uniconf_hash(const cJSON *node)
+{
+    if (!node)
+    {
+        return 0;
+    }
+    uint64_t hash = uniconf__known(node);
+    return hash ? hash : uniconf__compute(node, NULL);
+}
+
+/**
+ * Are the subtrees equal
+ *
+ * @param a
+ * @param b
+ *
+ * @return int
+ */
+int uniconf_equal(const cJSON *a, const cJSON *b)
+{
+    return (a == b) || (a && b && uniconf_hash(a) == uniconf_hash(b));
+}
+
+/**
+ * Get the config version: the root hash, with the layers the hash of their trees folded in
+ *
+ * @return uint64_t
+ */
+uint64_t uniconf_version()
+{
+    unsigned long epoch = uniconf_reader_enter();
+    uint64_t version = uniconf_hash(uniconf_get_root());
+    uint64_t layers = uniconf_layer_hash();
+    version = layers ? uniconf__mix(version ^ layers) : version;
+    uniconf_reader_leave(epoch);
+    return version;
+}
+
+/**
+ * Add the operation to the patch
+ *
+ * @param patch
+ * @param op
+ * @param path
+ * @param value : duplicated or NULL
+ */
+static void uniconf__op(cJSON *patch, const char *op, const char *path, const cJSON *value)
+{
+    cJSON *item = cJSON_CreateObject();
+    if (item)
+    {
+        cJSON_AddStringToObject(item, "op", op);
+        cJSON_AddStringToObject(item, "path", path);
+        if (value)
+        {
+            // the copy may outlive the tree and its interned keys
+            cJSON_AddItemToObject(item, "value", uniconf_intern_own(cJSON_Duplicate(value, 1)));
+        }
+        cJSON_AddItemToArray(patch, item);
+    }
+}
+
+/**
+ * Build the JSON pointer of the child
+ *
+ * @param path
+ * @param key : object key or NULL
+ * @param index : array index
+ *
+ * @return char* must be freed
+ */
+static char *uniconf__pointer(const char *path, const char *key, int index)
+{
+    char *result = NULL;
+    if (key)
+    {
+        // escape ~ and /
+        size_t len = strlen(path);
+        result = malloc(len + 2 * strlen(key) + 2);
+        if (result)
+        {
+            char *ptr = result + len;
+            memcpy(result, path, len);
+            *ptr++ = '/';
+            for (; *key; key++)
+            {
+                if ('~' == *key || '/' == *key)
+                {
+                    *ptr++ = '~';
+                    *ptr++ = ('~' == *key) ? '0' : '1';
+                }
+                else
+                {
+                    *ptr++ = *key;
+                }
+            }
+            *ptr = '\0';
+        }
+    }
+    else
+    {
+        asprintf(&result, "%s/%d", path, index);
+    }
+    return result;
+}
+
+/**
+ * Get the child by the exact key
+ *
+ * @param object
+ * @param key
+ *
+ * @return const cJSON*
+ */
+static const cJSON *uniconf__key(const cJSON *object, const char *key)
+{
+    for (const cJSON *item = uniconf_children(object); key && item; item = item->next)
+    {
+        if (item->string && !strcmp(item->string, key))
+        {
+            return item;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Diff the subtrees
+ *
+ * @param patch
+ * @param path
+ * @param previous
+ * @param current
+ */
+static void uniconf__diff(cJSON *patch, const char *path, const cJSON *previous, const cJSON *current)
+{
+    if (uniconf_equal(previous, current))
+    {
+        return;
+    }
+
+    if (cJSON_IsObject(previous) && cJSON_IsObject(current))
+    {
+        uniconf_ForEach(item, previous)
+        {
+            char *pointer = uniconf__pointer(path, item->string, 0);
+            if (pointer)
+            {
+                const cJSON *other = uniconf__key(current, item->string);
+                if (other)
+                {
+                    uniconf__diff(patch, pointer, item, other);
+                }
+                else
+                {
+                    uniconf__op(patch, "remove", pointer, NULL);
+                }
+                free(pointer);
+            }
+        }
+        uniconf_ForEach(item, current)
+        {
+            if (!uniconf__key(previous, item->string))
+            {
+                char *pointer = uniconf__pointer(path, item->string, 0);
+                if (pointer)
+                {
+                    uniconf__op(patch, "add", pointer, item);
+                    free(pointer);
+                }
+            }
+        }
+    }
+    else if (cJSON_IsArray(previous) && cJSON_IsArray(current))
+    {
+        cJSON *before = previous->child;
+        cJSON *after = current->child;
+        int index = 0;
+        for (; before && after; before = before->next, after = after->next, index++)
+        {
+            char *pointer = uniconf__pointer(path, NULL, index);
+            if (pointer)
+            {
+                uniconf__diff(patch, pointer, before, after);
+                free(pointer);
+            }
+        }
+        for (; after; after = after->next, index++)
+        {
+            char *pointer = uniconf__pointer(path, NULL, index);
+            if (pointer)
+            {
+                uniconf__op(patch, "add", pointer, after);
+                free(pointer);
+            }
+        }
+        // remove the tail from the end, so the patch applies in order
+        int size = index;
+        for (; before; before = before->next)
+        {
+            size++;
+        }
+        for (int i = size - 1; i >= index; i--)
+        {
+            char *pointer = uniconf__pointer(path, NULL, i);
+            if (pointer)
+            {
+                uniconf__op(patch, "remove", pointer, NULL);
+                free(pointer);
+            }
+        }
+    }
+    else if (!previous)
+    {
+        uniconf__op(patch, "add", path, current);
+    }
+    else if (!current)
+    {
+        uniconf__op(patch, "remove", path, NULL);
+    }
+    else
+    {
+        uniconf__op(patch, "replace", path, current);
+    }
+}
+
+/**
+ * Make the JSON Patch (RFC 6902) from previous to current
+ * Only the subtrees with different hashes are visited.
+ *
+ * @param previous
+ * @param current
+ *
+ * @return cJSON* the array of operations, must be deleted
+ */
+cJSON *uniconf_diff(const cJSON *previous, const cJSON *current)
+{
+    cJSON *patch = cJSON_CreateArray();
+    if (patch)
+    {
+        uniconf__diff(patch, "", previous, current);
+    }
+    return patch;
+}
@@ -0,0 +1,265 @@
+#include "uniconf.internal.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The versions history
+ *
+ * Each construct keeps the previous version as the reverse patch from the new tree,
+ * so the retained version costs only what was changed, the unchanged subtrees are skipped
+ * by the structural hashes. The versions are named by their root hashes, as uniconf_version().
+ *
+ * The rollback copies the current tree, applies the patches down to the version
+ * and publishes the result as the construct does, nothing is reparsed.
+ * The history is read and changed under the construct lock, the rollback holds it from the copy to the publish.
+ * The rollback is the new version itself, so the rolled back one stays retained.
+ *
+ * The lazy and the compact trees are not kept: their contents are not in the nodes.
+ */
+
+typedef struct uniconf_version
+{
+    uint64_t version;
+    cJSON *patch; // from the newer one
+} uniconf_version_t;
+
+static int uniconf_history_depth = 0;
+static int uniconf_history_count = 0;
+static uniconf_version_t *uniconf_history = NULL; // the newest first
+static int uniconf_history_plain = 0;             // the current tree may be kept
+
+/**
+ * Drop the oldest versions above the depth
+ *
+ * @param depth
+ */
+static void uniconf__history_trim(int depth)
+{
+    while (uniconf_history_count > depth)
+    {
+        cJSON_Delete(uniconf_history[--uniconf_history_count].patch);
+    }
+    if (!uniconf_history_count)
+    {
+        FREE_AND_NULL(uniconf_history);
+    }
+}
+
+/**
+ * Set the count of the retained versions
+ *
+ * @param depth : 0 = off
+ */
+void uniconf_versions_keep(int depth)
+{
+    int locked = uniconf_build_enter();
+    if (locked >= 0)
+    {
+        uniconf_history_depth = (depth > 0) ? depth : 0;
+        uniconf__history_trim(uniconf_history_depth);
+    }
+    uniconf_build_leave(locked);
+}
+
+/**
+ * Keep the previous version
+ * Called under the construct lock when both trees are hashed.
+ *
+ * @param previous
+ * @param current
+ *
+ * @return int : <0 = error, 0 = not kept, 1 = kept
+ */
+int uniconf_history_push(cJSON *previous, cJSON *current)
+{
+    int plain = uniconf_history_plain;
+    uniconf_history_plain = !uniconf_lazy_mode() && !uniconf_list_compact_enabled();
+    if (!uniconf_history_plain)
+    {
+        uniconf__history_trim(0); // can't be patched
+    }
+    if (!uniconf_history_depth || !plain || !uniconf_history_plain || !previous || uniconf_equal(previous, current))
+    {
+        return 0;
+    }
+
+    cJSON *patch = uniconf_diff(current, previous);
+    if (!patch)
+    {
+        return -ENOMEM;
+    }
+    uniconf__history_trim(uniconf_history_depth - 1);
+    uniconf_version_t *history = realloc(uniconf_history, (uniconf_history_count + 1) * sizeof(uniconf_version_t));
+    if (!history)
+    {
+        cJSON_Delete(patch);
+        return -ENOMEM;
+    }
+    uniconf_history = history;
+    memmove(&uniconf_history[1], &uniconf_history[0], uniconf_history_count * sizeof(uniconf_version_t));
+    uniconf_history[0] = (uniconf_version_t){.version = uniconf_hash(previous), .patch = patch};
+    uniconf_history_count++;
+    return 1;
+}
+
+/**
+ * Get the retained versions
+ *
+ * @param versions : the newest first, may be NULL
+ * @param max
+ *
+ * @return int : the count of the retained versions, <0 = error
+ */
+int uniconf_versions(uint64_t *versions, int max)
+{
+    int locked = uniconf_build_enter();
+    if (locked < 0)
+    {
+        return locked;
+    }
+    for (int i = 0; versions && i < max && i < uniconf_history_count; i++)
+    {
+        versions[i] = uniconf_history[i].version;
+    }
+    int count = uniconf_history_count;
+    uniconf_build_leave(locked);
+    return count;
+}
+
+/**
+ * Unescape the JSON pointer token in place
+ *
+ * @param token
+ *
+ * @return char*
+ */
+static char *uniconf__history_token(char *token)
+{
+    char *out = token;
+    for (char *ptr = token; *ptr; ptr++)
+    {
+        if ('~' == ptr[0] && ('0' == ptr[1] || '1' == ptr[1]))
+        {
+            *out++ = ('0' == *++ptr) ? '~' : '/';
+        }
+        else
+        {
+            *out++ = *ptr;
+        }
+    }
+    *out = '\0';
+    return token;
+}
+
+/**
+ * Apply the operation of the patch made by uniconf_diff()
+ *
+ * @param root
+ * @param op
+ *
+ * @return cJSON* : the root, replaced for the "" path
+ */
+static cJSON *uniconf__history_op(cJSON *root, const cJSON *op)
+{
+    const char *name = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(op, "op"));
+    const char *path = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(op, "path"));
+    cJSON *value = cJSON_GetObjectItemCaseSensitive(op, "value");
+    char *the_path = path ? strdup(path) : NULL;
+    if (!name || !the_path)
+    {
+        free(the_path);
+        return root;
+    }
+    if (!*the_path)
+    {
+        free(the_path);
+        if (value)
+        {
+            cJSON_Delete(root);
+            root = cJSON_Duplicate(value, 1);
+        }
+        return root;
+    }
+
+    // the parent of the last token
+    cJSON *parent = root;
+    char *key = strrchr(the_path, '/');
+    *key++ = '\0';
+    for (char *sptr, *token = strtok_r(the_path, "/", &sptr); parent && token; token = strtok_r(NULL, "/", &sptr))
+    {
+        uniconf__history_token(token);
+        parent = cJSON_IsArray(parent) ? cJSON_GetArrayItem(parent, atoi(token)) : cJSON_GetObjectItemCaseSensitive(parent, token);
+    }
+    uniconf__history_token(key);
+
+    if (cJSON_IsArray(parent))
+    {
+        int index = atoi(key);
+        if (STR_EQUAL("remove", name))
+        {
+            cJSON_DeleteItemFromArray(parent, index);
+        }
+        else if (value && STR_EQUAL("replace", name))
+        {
+            cJSON_ReplaceItemInArray(parent, index, cJSON_Duplicate(value, 1));
+        }
+        else if (value)
+        {
+            cJSON_AddItemToArray(parent, cJSON_Duplicate(value, 1)); // the tail in order
+        }
+    }
+    else if (cJSON_IsObject(parent))
+    {
+        cJSON_DeleteItemFromObjectCaseSensitive(parent, key);
+        if (value && !STR_EQUAL("remove", name))
+        {
+            cJSON_AddItemToObject(parent, key, cJSON_Duplicate(value, 1));
+        }
+    }
+    free(the_path);
+    return root;
+}
+
+/**
+ * Make the tree of the retained version
+ * Under the construct lock, the patches are of the current tree.
+ *
+ * @param version
+ * @param current : the published root
+ *
+ * @return cJSON* | NULL = not retained
+ */
+cJSON *uniconf_history_tree(uint64_t version, const cJSON *current)
+{
+    int depth = 0;
+    while (depth < uniconf_history_count && uniconf_history[depth].version != version)
+    {
+        depth++;
+    }
+    if (depth == uniconf_history_count)
+    {
+        return NULL;
+    }
+    // the interned keys are of the current tree only
+    cJSON *root = uniconf_intern_own(cJSON_Duplicate(current, 1));
+    for (int i = 0; root && i <= depth; i++)
+    {
+        uniconf_EachChild(op, uniconf_history[i].patch)
+        {
+            root = uniconf__history_op(root, op);
+        }
+    }
+    return root;
+}
+
+/**
+ * Drop all the versions
+ *
+ */
+void uniconf_history_reset()
+{
+    uniconf__history_trim(0);
+    uniconf_history_plain = 0;
+}
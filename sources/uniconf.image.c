@@ -0,0 +1,558 @@
+#include "uniconf.internal.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The flat image of the tree
+ *
+ * The position-independent layout: the header, the nodes in breadth-first order
+ * (the children of a node are adjacent), the sorted keys of the objects and the strings.
+ * All the references are the offsets from the image start, so the image can be
+ * mapped at any address, shared between processes or stored to the file.
+ *
+ * The objects are searched by the binary search over their sorted keys,
+ * the array items are addressed directly.
+ * The interned keys (cJSON_StringIsConst) are stored once.
+ */
+
+#define ALIGN8(size) (((size) + 7) & ~(size_t)7)
+
+typedef struct uniconf_image_counts
+{
+    size_t nodes;
+    size_t sorted;
+    size_t strings;
+    uniconf_map_t *shared; // the counted interned keys
+} uniconf_image_counts_t;
+
+/**
+ * Count the nodes, keys and string bytes of the subtree
+ *
+ * @param node
+ * @param counts
+ */
+static void uniconf__image_count(const cJSON *node, uniconf_image_counts_t *counts)
+{
+    counts->nodes++;
+    if (node->string && (node->type & cJSON_StringIsConst))
+    {
+        void **slot = uniconf_map_slot(counts->shared, node->string);
+        if (!slot || !*slot)
+        {
+            counts->strings += strlen(node->string) + 1;
+        }
+        if (slot)
+        {
+            *slot = (void *)node;
+        }
+    }
+    else if (node->string)
+    {
+        counts->strings += strlen(node->string) + 1;
+    }
+    if ((cJSON_IsString(node) || cJSON_IsRaw(node)) && node->valuestring)
+    {
+        counts->strings += strlen(node->valuestring) + 1;
+    }
+    uniconf_ForEach(item, node)
+    {
+        counts->sorted += cJSON_IsObject(node);
+        uniconf__image_count(item, counts);
+    }
+    // the compact list entries become the items
+    size_t entries = cJSON_IsArray(node) ? uniconf_listset_count(node) : 0;
+    counts->nodes += entries;
+    for (size_t i = 0; i < entries; i++)
+    {
+        counts->strings += strlen(uniconf_listset_entry(node, i)) + 1;
+    }
+}
+
+/**
+ * Get the layout of the image
+ *
+ * @param root
+ * @param counts
+ *
+ * @return size_t the image size
+ */
+static size_t uniconf__image_layout(const cJSON *root, uniconf_image_counts_t *counts)
+{
+    *counts = (uniconf_image_counts_t){.shared = uniconf_map_create(0)};
+    uniconf__image_count(root, counts);
+    uniconf_map_destroy(counts->shared, NULL);
+    counts->shared = NULL;
+    return ALIGN8(sizeof(uniconf_image_t)) + counts->nodes * sizeof(uniconf_flat_t) + ALIGN8(counts->sorted * sizeof(uint32_t)) + 1 + counts->strings;
+}
+
+/**
+ * Get the size of the image of the tree
+ *
+ * @param root
+ *
+ * @return size_t : 0 = empty tree
+ */
+size_t uniconf_image_size(const cJSON *root)
+{
+    uniconf_image_counts_t counts;
+    return root ? uniconf__image_layout(root, &counts) : 0;
+}
+
+typedef struct uniconf_image_key
+{
+    const char *key;
+    uint32_t index;
+} uniconf_image_key_t;
+
+/**
+ * Order the keys, the first of the equal ones first
+ *
+ * @param a
+ * @param b
+ *
+ * @return int
+ */
+static int uniconf__image_compare(const void *a, const void *b)
+{
+    const uniconf_image_key_t *x = a;
+    const uniconf_image_key_t *y = b;
+    int ret = strcmp(x->key, y->key);
+    return ret ? ret : (x->index > y->index) - (x->index < y->index);
+}
+
+/**
+ * Write the image of the tree
+ *
+ * @param root
+ * @param base
+ * @param size : at least uniconf_image_size()
+ *
+ * @return int : <0 = error, >=0 = count of nodes
+ */
+int uniconf_image_write(const cJSON *root, void *base, size_t size)
+{
+    uniconf_image_counts_t counts;
+    if (!root || !base || size < uniconf__image_layout(root, &counts))
+    {
+        return -EINVAL;
+    }
+    if (counts.nodes > UINT32_MAX || size > UINT32_MAX)
+    {
+        return -EFBIG;
+    }
+
+    const cJSON **queue = malloc(counts.nodes * sizeof(cJSON *));
+    uniconf_image_key_t *keys = malloc((counts.sorted + 1) * sizeof(uniconf_image_key_t));
+    // the offsets of the written interned keys
+    uniconf_map_t *shared = uniconf_map_create(0);
+    if (!queue || !keys || !shared)
+    {
+        free(queue);
+        free(keys);
+        uniconf_map_destroy(shared, NULL);
+        return -ENOMEM;
+    }
+
+    char *start = base;
+    uniconf_image_t *image = base;
+    *image = (uniconf_image_t){
+        .magic = UNICONF_IMAGE_MAGIC,
+        .version = UNICONF_IMAGE_VERSION,
+        .size = size,
+        .hash = uniconf_hash(root),
+        .count = counts.nodes,
+        .nodes = ALIGN8(sizeof(uniconf_image_t)),
+    };
+    image->sorted = image->nodes + counts.nodes * sizeof(uniconf_flat_t);
+    image->strings = image->sorted + ALIGN8(counts.sorted * sizeof(uint32_t));
+
+    uniconf_flat_t *nodes = (uniconf_flat_t *)(start + image->nodes);
+    uint32_t *sorted = (uint32_t *)(start + image->sorted);
+    char *strings = start + image->strings;
+    *strings++ = '\0';
+
+    int ret = (int)counts.nodes;
+    size_t tail = 0;
+    size_t order = 0;
+    queue[tail++] = root;
+    for (size_t i = 0; i < tail; i++)
+    {
+        const cJSON *node = queue[i];
+        if (!node)
+        {
+            continue; // the compact list entry, written
+        }
+        uniconf_flat_t *flat = &nodes[i];
+        *flat = (uniconf_flat_t){.type = node->type & 0xFF, .number = node->valuedouble};
+        if (node->string && (node->type & cJSON_StringIsConst))
+        {
+            flat->key = (uint32_t)(uintptr_t)uniconf_map_get(shared, node->string);
+            if (!flat->key)
+            {
+                // counted once, so written once
+                void **slot = uniconf_map_slot(shared, node->string);
+                if (!slot)
+                {
+                    ret = -ENOMEM;
+                    break;
+                }
+                flat->key = strings - start;
+                *slot = (void *)(uintptr_t)flat->key;
+                strings = stpcpy(strings, node->string) + 1;
+            }
+        }
+        else if (node->string)
+        {
+            flat->key = strings - start;
+            strings = stpcpy(strings, node->string) + 1;
+        }
+        if ((cJSON_IsString(node) || cJSON_IsRaw(node)) && node->valuestring)
+        {
+            flat->value = strings - start;
+            strings = stpcpy(strings, node->valuestring) + 1;
+        }
+        else if (uniconf_IsComplex(node))
+        {
+            flat->value = tail;
+            uniconf_ForEach(item, node)
+            {
+                if (cJSON_IsObject(node))
+                {
+                    keys[flat->count] = (uniconf_image_key_t){.key = item->string ? item->string : "", .index = tail};
+                }
+                queue[tail++] = item;
+                flat->count++;
+            }
+            size_t entries = cJSON_IsArray(node) ? uniconf_listset_count(node) : 0;
+            for (size_t k = 0; k < entries; k++, flat->count++)
+            {
+                nodes[tail] = (uniconf_flat_t){.type = cJSON_String, .value = strings - start};
+                strings = stpcpy(strings, uniconf_listset_entry(node, k)) + 1;
+                queue[tail++] = NULL;
+            }
+            if (cJSON_IsObject(node))
+            {
+                qsort(keys, flat->count, sizeof(uniconf_image_key_t), uniconf__image_compare);
+                flat->order = order;
+                for (uint32_t k = 0; k < flat->count; k++)
+                {
+                    sorted[order++] = keys[k].index;
+                }
+            }
+        }
+    }
+
+    free(queue);
+    free(keys);
+    uniconf_map_destroy(shared, NULL);
+    return ret;
+}
+
+/**
+ * Is the offset of the string in the pool
+ *
+ * @param image
+ * @param offset
+ *
+ * @return int
+ */
+static int uniconf__image_string_valid(const uniconf_image_t *image, uint32_t offset)
+{
+    return !offset || (offset >= image->strings && offset < image->size);
+}
+
+/**
+ * Check the node of the image
+ * The children follow the node (breadth-first), so the walks can't loop.
+ *
+ * @param image
+ * @param index
+ *
+ * @return int
+ */
+static int uniconf__image_node_valid(const uniconf_image_t *image, uint32_t index)
+{
+    const uniconf_flat_t *flat = (const uniconf_flat_t *)((const char *)image + image->nodes) + index;
+    const uint32_t *sorted = (const uint32_t *)((const char *)image + image->sorted);
+    uint64_t keys = (image->strings - image->sorted) / sizeof(uint32_t);
+    if (!uniconf__image_string_valid(image, flat->key))
+    {
+        return 0;
+    }
+    switch (flat->type)
+    {
+    case cJSON_False:
+    case cJSON_True:
+    case cJSON_NULL:
+    case cJSON_Number:
+        return 1;
+    case cJSON_String:
+    case cJSON_Raw:
+        return uniconf__image_string_valid(image, flat->value);
+    case cJSON_Array:
+    case cJSON_Object:
+        if (flat->count && (flat->value <= index || (uint64_t)flat->value + flat->count > image->count))
+        {
+            return 0;
+        }
+        if (cJSON_Object == flat->type)
+        {
+            if ((uint64_t)flat->order + flat->count > keys)
+            {
+                return 0;
+            }
+            const uniconf_flat_t *nodes = (const uniconf_flat_t *)((const char *)image + image->nodes);
+            for (uint32_t k = 0; k < flat->count; k++)
+            {
+                uint32_t child = sorted[flat->order + k];
+                if (child < flat->value || child >= flat->value + flat->count || !nodes[child].key ||
+                    !uniconf__image_string_valid(image, nodes[child].key))
+                {
+                    return 0;
+                }
+                // ordered as uniconf__image_compare(), so each child once
+                if (k)
+                {
+                    uint32_t previous = sorted[flat->order + k - 1];
+                    int ret = strcmp((const char *)image + nodes[previous].key, (const char *)image + nodes[child].key);
+                    if (ret > 0 || (!ret && previous >= child))
+                    {
+                        return 0;
+                    }
+                }
+            }
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Check the image: the header and each node once
+ * The offsets and the indexes of the nodes are in range, the strings end in the image, the keys are sorted.
+ *
+ * @param base
+ * @param size : the mapped size
+ *
+ * @return const uniconf_image_t* | NULL
+ */
+const uniconf_image_t *uniconf_image_check(const void *base, size_t size)
+{
+    const uniconf_image_t *image = base;
+    if (!image || size < sizeof(uniconf_image_t) || UNICONF_IMAGE_MAGIC != image->magic || UNICONF_IMAGE_VERSION != image->version ||
+        image->size > size || !image->count || image->nodes < sizeof(uniconf_image_t) || (image->nodes & 7) ||
+        image->nodes + (uint64_t)image->count * sizeof(uniconf_flat_t) > image->sorted ||
+        (image->sorted & 3) || image->sorted > image->strings || image->strings >= image->size ||
+        ((const char *)image)[image->size - 1]) // the last string ends
+    {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < image->count; i++)
+    {
+        if (!uniconf__image_node_valid(image, i))
+        {
+            return NULL;
+        }
+    }
+    return image;
+}
+
+/**
+ * Get the node of the image
+ *
+ * @param image
+ * @param index : 0 = the root
+ *
+ * @return const uniconf_flat_t*
+ */
+const uniconf_flat_t *uniconf_image_node(const uniconf_image_t *image, uint32_t index)
+{
+    return (index < image->count) ? (const uniconf_flat_t *)((const char *)image + image->nodes) + index : NULL;
+}
+
+/**
+ * Get the string of the image
+ *
+ * @param image
+ * @param offset
+ *
+ * @return const char* | NULL
+ */
+const char *uniconf_image_string(const uniconf_image_t *image, uint32_t offset)
+{
+    return offset ? (const char *)image + offset : NULL;
+}
+
+/**
+ * Find the child of the node
+ *
+ * @param image
+ * @param flat
+ * @param name
+ *
+ * @return const uniconf_flat_t* | NULL
+ */
+static const uniconf_flat_t *uniconf__image_lookup(const uniconf_image_t *image, const uniconf_flat_t *flat, const char *name)
+{
+    if (cJSON_Array == flat->type)
+    {
+        long index = 0;
+        if (!uniconf_is_index(name, &index))
+        {
+            return NULL;
+        }
+        index = (index < 0) ? index + flat->count : index;
+        return (index >= 0 && index < flat->count) ? uniconf_image_node(image, flat->value + index) : NULL;
+    }
+    if (cJSON_Object == flat->type)
+    {
+        // the first of the equal keys, as cJSON_GetObjectItemCaseSensitive
+        const uint32_t *sorted = (const uint32_t *)((const char *)image + image->sorted) + flat->order;
+        uint32_t low = 0;
+        uint32_t high = flat->count;
+        while (low < high)
+        {
+            uint32_t middle = low + (high - low) / 2;
+            if (strcmp(uniconf_image_string(image, uniconf_image_node(image, sorted[middle])->key), name) < 0)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        if (low < flat->count)
+        {
+            const uniconf_flat_t *found = uniconf_image_node(image, sorted[low]);
+            return strcmp(uniconf_image_string(image, found->key), name) ? NULL : found;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Walk the path in the image
+ *
+ * @param image
+ * @param path : NULL or empty = the root
+ *
+ * @return const uniconf_flat_t* | NULL
+ */
+const uniconf_flat_t *uniconf_image_walk(const uniconf_image_t *image, const char *path)
+{
+    const uniconf_flat_t *flat = image ? uniconf_image_node(image, 0) : NULL;
+    if (flat && path && *path)
+    {
+        char *the_path = strdup(path);
+        if (!the_path)
+        {
+            return NULL;
+        }
+        for (char *sptr, *token = strtok_r(the_path, PATH_DELIM, &sptr); flat && token; token = strtok_r(NULL, PATH_DELIM, &sptr))
+        {
+            flat = uniconf__image_lookup(image, flat, token);
+        }
+        free(the_path);
+    }
+    return flat;
+}
+
+/**
+ * Fill the scalar view of the node, no allocations
+ *
+ * @param image
+ * @param flat
+ * @param view
+ *
+ * @return cJSON* the view | NULL for the complex nodes
+ */
+cJSON *uniconf_image_view(const uniconf_image_t *image, const uniconf_flat_t *flat, cJSON *view)
+{
+    if (!flat || !view || cJSON_Array == flat->type || cJSON_Object == flat->type)
+    {
+        return NULL;
+    }
+    *view = (cJSON){
+        .type = flat->type | cJSON_IsReference | cJSON_StringIsConst,
+        .valuedouble = flat->number,
+        .valueint = (flat->number >= INT32_MAX) ? INT32_MAX : (flat->number <= INT32_MIN) ? INT32_MIN : (int)flat->number,
+        .valuestring = (char *)uniconf_image_string(image, (cJSON_String == flat->type || cJSON_Raw == flat->type) ? flat->value : 0),
+        .string = (char *)uniconf_image_string(image, flat->key),
+    };
+    return view;
+}
+
+/**
+ * Build the subtree of the node, the strings stay in the image
+ *
+ * @param image
+ * @param flat
+ *
+ * @return cJSON* must be deleted before the image is unmapped
+ */
+cJSON *uniconf_image_tree(const uniconf_image_t *image, const uniconf_flat_t *flat)
+{
+    if (!flat)
+    {
+        return NULL;
+    }
+
+    cJSON *item = NULL;
+    switch (flat->type)
+    {
+    case cJSON_False:
+        item = cJSON_CreateFalse();
+        break;
+    case cJSON_True:
+        item = cJSON_CreateTrue();
+        break;
+    case cJSON_Number:
+        item = cJSON_CreateNumber(flat->number);
+        break;
+    case cJSON_String:
+    case cJSON_Raw:
+        item = cJSON_CreateStringReference(uniconf_image_string(image, flat->value));
+        if (item)
+        {
+            item->type = flat->type | cJSON_IsReference;
+        }
+        break;
+    case cJSON_Array:
+    case cJSON_Object:
+        item = (cJSON_Array == flat->type) ? cJSON_CreateArray() : cJSON_CreateObject();
+        for (uint32_t i = 0; item && i < flat->count; i++)
+        {
+            cJSON *child = uniconf_image_tree(image, uniconf_image_node(image, flat->value + i));
+            if (!child)
+            {
+                cJSON_Delete(item);
+                return NULL;
+            }
+            // link to the end, the first child's prev is the last one
+            if (item->child)
+            {
+                child->prev = item->child->prev;
+                item->child->prev->next = child;
+            }
+            else
+            {
+                item->child = child;
+            }
+            item->child->prev = child;
+        }
+        break;
+    default:
+        item = cJSON_CreateNull();
+        break;
+    }
+
+    if (item && flat->key)
+    {
+        item->string = (char *)uniconf_image_string(image, flat->key);
+        item->type |= cJSON_StringIsConst;
+    }
+    return item;
+}
@@ -0,0 +1,214 @@
+#include "uniconf.internal.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The per-object indexes
+ *
+ * Arrays of UNICONF_INDEX_THRESHOLD and more items get the pointer vector
+ * when the tree is constructed, so the item access is O(1) instead of the list walk.
+ * Smaller arrays and arrays created later are walked.
+ * The tree is read-only, the vector holds the items until the tree is retired.
+ * The vectors of the new tree are published with it, the replaced ones are freed by the next construct.
+ */
+
+typedef struct uniconf_vector
+{
+    int count;
+    cJSON *items[];
+} uniconf_vector_t;
+
+static uniconf_map_t *uniconf_vectors = NULL;
+static uniconf_map_t *uniconf_vectors_retired = NULL; // of the previous tree
+
+/**
+ * Get the vector of the array
+ *
+ * @param array
+ *
+ * @return uniconf_vector_t* | NULL
+ */
+static uniconf_vector_t *uniconf__vector(const cJSON *array)
+{
+    return uniconf_map_get(__atomic_load_n(&uniconf_vectors, __ATOMIC_ACQUIRE), array);
+}
+
+/**
+ * Build the vector of the array
+ *
+ * @param vectors
+ * @param array
+ * @param count
+ *
+ * @return int
+ */
+static int uniconf__vectorize(uniconf_map_t *vectors, cJSON *array, int count)
+{
+    uniconf_vector_t *vector = malloc(sizeof(uniconf_vector_t) + count * sizeof(cJSON *));
+    if (!vector)
+    {
+        return -ENOMEM;
+    }
+    vector->count = 0;
+    uniconf_EachChild(item, array)
+    {
+        vector->items[vector->count++] = item;
+    }
+
+    void **slot = uniconf_map_slot(vectors, array);
+    if (!slot)
+    {
+        free(vector);
+        return -ENOMEM;
+    }
+    free(*slot);
+    *slot = vector;
+    return 1;
+}
+
+/**
+ * Index the large arrays of the subtree
+ *
+ * @param vectors : created on the first one
+ * @param node
+ *
+ * @return int : the count of indexed arrays
+ */
+static int uniconf__index_build(uniconf_map_t **vectors, cJSON *node)
+{
+    int count = 0;
+    if (uniconf_IsComplex(node))
+    {
+        int size = 0;
+        uniconf_EachChild(item, node)
+        {
+            count += uniconf__index_build(vectors, item);
+            size++;
+        }
+        if (cJSON_IsArray(node) && size >= UNICONF_INDEX_THRESHOLD)
+        {
+            if (!*vectors)
+            {
+                *vectors = uniconf_map_create(0);
+            }
+            count += (*vectors && uniconf__vectorize(*vectors, node, size) > 0);
+        }
+    }
+    return count;
+}
+
+/**
+ * Index the large arrays of the new tree and publish the vectors
+ * The vectors of the replaced tree are kept until uniconf_index_release().
+ *
+ * @param root
+ *
+ * @return int : the count of indexed arrays
+ */
+int uniconf_index_build(cJSON *root)
+{
+    uniconf_map_t *vectors = NULL;
+    int count = uniconf__index_build(&vectors, root);
+    uniconf_map_destroy(uniconf_vectors_retired, free);
+    uniconf_vectors_retired = __atomic_exchange_n(&uniconf_vectors, vectors, __ATOMIC_ACQ_REL);
+    return count;
+}
+
+/**
+ * Free the vectors of the replaced tree
+ *
+ */
+void uniconf_index_release()
+{
+    uniconf_map_destroy(uniconf_vectors_retired, free);
+    uniconf_vectors_retired = NULL;
+}
+
+/**
+ * Drop all the indexes
+ *
+ */
+void uniconf_index_reset()
+{
+    uniconf_index_release();
+    uniconf_map_destroy(uniconf_vectors, free);
+    uniconf_vectors = NULL;
+}
+
+/**
+ * Is the path segment an array index
+ *
+ * @param name
+ * @param index
+ *
+ * @return int
+ */
+int uniconf_is_index(const char *name, long *index)
+{
+    if (name && (isdigit(name[0]) || ('-' == name[0] && isdigit(name[1]))))
+    {
+        char *end = NULL;
+        errno = 0;
+        long value = strtol(name, &end, 10);
+        if (!*end && !errno)
+        {
+            *index = value;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Count the array items
+ *
+ * @param array
+ *
+ * @return int
+ */
+int uniconf_size(const cJSON *array)
+{
+    uniconf_vector_t *vector = uniconf__vector(array);
+    return vector ? vector->count : cJSON_GetArraySize(array);
+}
+
+/**
+ * Get the array item by index
+ *
+ * @param array
+ * @param index : <0 = from the end
+ *
+ * @return cJSON*
+ */
+cJSON *uniconf_item(const cJSON *array, long index)
+{
+    if (!array)
+    {
+        return NULL;
+    }
+
+    uniconf_vector_t *vector = uniconf__vector(array);
+    if (vector)
+    {
+        index = (index < 0) ? index + vector->count : index;
+        return (index >= 0 && index < vector->count) ? vector->items[index] : NULL;
+    }
+
+    cJSON *item = array->child;
+    if (index < 0)
+    {
+        // walk back from the last one
+        item = item ? item->prev : NULL;
+        for (; item && ++index < 0; item = (item == array->child) ? NULL : item->prev)
+            ;
+    }
+    else
+    {
+        for (; item && index > 0; index--, item = item->next)
+            ;
+    }
+    return item;
+}
@@ -0,0 +1,366 @@
+#include "uniconf.internal.h"
+
+#include <errno.h>
+#include <string.h>
+#include <zlib.h>
+#ifdef UNICONF_ZSTD
+#include <zstd.h>
+#endif
+
+/**
+ * The compressed files
+ *
+ * The second extension chooses the decoder: "routes.json.gz" is the .json inflated by zlib,
+ * "deny.list.zst" is the .list decompressed by zstd (built with UNICONF_ZSTD).
+ * The compressed file is mapped and decompressed as the stream: the .yml, .env and .list parsers
+ * read it by chunks and lines, the others get the whole decompressed buffer.
+ */
+
+#define INFLATE_MIN_SIZE 4096
+#define INFLATE_MAX_GUESS (16 << 20)
+#define INFLATE_CHUNK (64 << 10)
+
+typedef struct uniconf_stream
+{
+    int (*decode)(struct uniconf_stream *stream, char *buffer, size_t size, size_t *length);
+    void (*end)(struct uniconf_stream *stream);
+    const char *data; // the compressed
+    size_t size;
+    size_t total; // decompressed
+    size_t limit; // of the total, 0 = unlimited
+    int error;    // <0 = stopped
+    int done;
+    z_stream zlib;
+#ifdef UNICONF_ZSTD
+    ZSTD_DStream *zstd;
+    ZSTD_inBuffer in;
+#endif
+    char *chunk; // of the lines
+    const char *ptr;
+    const char *last;
+} uniconf_stream_t;
+
+/**
+ * Inflate the next gzip|zlib data, the concatenated members too
+ *
+ * @param stream
+ * @param buffer
+ * @param size
+ * @param length : out, the decompressed
+ *
+ * @return int : <0 = error
+ */
+static int uniconf__inflate_gz(uniconf_stream_t *stream, char *buffer, size_t size, size_t *length)
+{
+    stream->zlib.next_out = (Bytef *)buffer;
+    stream->zlib.avail_out = size;
+    int ret = Z_OK;
+    while (Z_OK == ret && stream->zlib.avail_out && !stream->done)
+    {
+        ret = inflate(&stream->zlib, Z_NO_FLUSH);
+        if (Z_STREAM_END == ret)
+        {
+            stream->done = !stream->zlib.avail_in;
+            ret = stream->done ? Z_OK : inflateReset(&stream->zlib);
+        }
+        else if (Z_BUF_ERROR == ret)
+        {
+            ret = Z_DATA_ERROR; // truncated, the output has the room
+        }
+    }
+    *length = size - stream->zlib.avail_out;
+    return (Z_OK == ret) ? 0 : (Z_MEM_ERROR == ret) ? -ENOMEM : -EILSEQ;
+}
+
+/**
+ * Free the zlib state
+ *
+ * @param stream
+ */
+static void uniconf__inflate_gz_end(uniconf_stream_t *stream)
+{
+    inflateEnd(&stream->zlib);
+}
+
+#ifdef UNICONF_ZSTD
+/**
+ * Decompress the next zstd data, the frames one by one
+ *
+ * @param stream
+ * @param buffer
+ * @param size
+ * @param length : out, the decompressed
+ *
+ * @return int : <0 = error
+ */
+static int uniconf__inflate_zst(uniconf_stream_t *stream, char *buffer, size_t size, size_t *length)
+{
+    ZSTD_outBuffer out = {buffer, size, 0};
+    while (out.pos < out.size && !stream->done)
+    {
+        size_t ret = ZSTD_decompressStream(stream->zstd, &out, &stream->in);
+        if (ZSTD_isError(ret) || (stream->in.pos == stream->in.size && ret && out.pos < out.size))
+        {
+            *length = out.pos;
+            return -EILSEQ; // broken or truncated
+        }
+        stream->done = (stream->in.pos == stream->in.size && !ret);
+    }
+    *length = out.pos;
+    return 0;
+}
+
+/**
+ * Free the zstd state
+ *
+ * @param stream
+ */
+static void uniconf__inflate_zst_end(uniconf_stream_t *stream)
+{
+    ZSTD_freeDStream(stream->zstd);
+}
+#endif
+
+/**
+ * Is the extension of the compressed file
+ *
+ * @param extension : without the dot
+ *
+ * @return int
+ */
+int uniconf_compressed(const char *extension)
+{
+#ifdef UNICONF_ZSTD
+    if (extension && STR_EQUAL("zst", extension))
+    {
+        return 1;
+    }
+#endif
+    return extension && STR_EQUAL("gz", extension);
+}
+
+/**
+ * Start decompressing the data
+ *
+ * @param extension : of the compression
+ * @param data : lives while the stream is read
+ * @param size
+ * @param limit : of the decompressed length, 0 = unlimited
+ *
+ * @return uniconf_stream_t* : must be closed | NULL = error, errno is set
+ */
+uniconf_stream_t *uniconf_stream_open(const char *extension, const char *data, size_t size, size_t limit)
+{
+    if (!uniconf_compressed(extension))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    uniconf_stream_t *stream = calloc(1, sizeof(uniconf_stream_t));
+    if (!stream)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    *stream = (uniconf_stream_t){.data = data, .size = size, .limit = limit};
+#ifdef UNICONF_ZSTD
+    if (STR_EQUAL("zst", extension))
+    {
+        stream->zstd = ZSTD_createDStream();
+        if (!stream->zstd)
+        {
+            free(stream);
+            errno = ENOMEM;
+            return NULL;
+        }
+        ZSTD_initDStream(stream->zstd);
+        stream->in = (ZSTD_inBuffer){data, size, 0};
+        stream->decode = uniconf__inflate_zst;
+        stream->end = uniconf__inflate_zst_end;
+        return stream;
+    }
+#endif
+    if (Z_OK != inflateInit2(&stream->zlib, 15 + 32)) // the header is detected
+    {
+        free(stream);
+        errno = ENOMEM;
+        return NULL;
+    }
+    stream->zlib.next_in = (Bytef *)data;
+    stream->zlib.avail_in = size;
+    stream->decode = uniconf__inflate_gz;
+    stream->end = uniconf__inflate_gz_end;
+    return stream;
+}
+
+/**
+ * Read the next decompressed data
+ *
+ * @param stream
+ * @param buffer
+ * @param size
+ *
+ * @return ssize_t : >0 = the length, 0 = the end, <0 = error, -EFBIG = over the limit
+ */
+ssize_t uniconf_stream_read(uniconf_stream_t *stream, char *buffer, size_t size)
+{
+    if (stream->error || stream->done || !size)
+    {
+        return stream->error;
+    }
+    size_t length = 0;
+    int ret = stream->decode(stream, buffer, size, &length);
+    stream->total += length;
+    if (ret < 0 || (stream->limit && stream->total > stream->limit))
+    {
+        stream->error = (ret < 0) ? ret : -EFBIG;
+        return stream->error;
+    }
+    return (ssize_t)length;
+}
+
+/**
+ * Read the next decompressed line, as uniconf_getline
+ *
+ * @param stream
+ * @param line : the reused copy
+ * @param size : the allocated size
+ *
+ * @return char* : the line with '\n', if any | NULL = the end or error
+ */
+char *uniconf_stream_getline(uniconf_stream_t *stream, char **line, size_t *size)
+{
+    size_t len = 0;
+    for (;;)
+    {
+        if (stream->ptr >= stream->last)
+        {
+            if (!stream->chunk && !(stream->chunk = malloc(INFLATE_CHUNK)))
+            {
+                stream->error = -ENOMEM;
+            }
+            ssize_t read = stream->chunk ? uniconf_stream_read(stream, stream->chunk, INFLATE_CHUNK) : 0;
+            if (read <= 0)
+            {
+                return len ? *line : NULL; // the last line without '\n'
+            }
+            stream->ptr = stream->chunk;
+            stream->last = stream->chunk + read;
+        }
+        const char *eol = memchr(stream->ptr, '\n', stream->last - stream->ptr);
+        size_t part = (eol ? eol + 1 : stream->last) - stream->ptr;
+        if (len + part + 1 > *size)
+        {
+            char *grown = realloc(*line, len + part + 1);
+            if (!grown)
+            {
+                stream->error = -ENOMEM;
+                return NULL;
+            }
+            *line = grown;
+            *size = len + part + 1;
+        }
+        memcpy(*line + len, stream->ptr, part);
+        len += part;
+        (*line)[len] = '\0';
+        stream->ptr += part;
+        if (eol)
+        {
+            return *line;
+        }
+    }
+}
+
+/**
+ * Get the decompressed length
+ *
+ * @param stream
+ *
+ * @return size_t
+ */
+size_t uniconf_stream_length(const uniconf_stream_t *stream)
+{
+    return stream->total;
+}
+
+/**
+ * Get the error of the stream
+ *
+ * @param stream
+ *
+ * @return int : <0 = the error stopped it, -EFBIG = over the limit, 0 = none
+ */
+int uniconf_stream_error(const uniconf_stream_t *stream)
+{
+    return stream->error;
+}
+
+/**
+ * Free the stream
+ *
+ * @param stream
+ */
+void uniconf_stream_close(uniconf_stream_t *stream)
+{
+    if (stream)
+    {
+        stream->end(stream);
+        free(stream->chunk);
+        free(stream);
+    }
+}
+
+/**
+ * Decompress the data
+ *
+ * @param extension : of the compression
+ * @param data
+ * @param size
+ * @param length : out
+ * @param limit : of the length, 0 = unlimited
+ *
+ * @return char* : '\0' terminated, must be freed | NULL = error, errno is set, EFBIG = over the limit
+ */
+char *uniconf_inflate(const char *extension, const char *data, size_t size, size_t *length, size_t limit)
+{
+    uniconf_stream_t *stream = uniconf_stream_open(extension, data, size, limit);
+    if (!stream)
+    {
+        return NULL;
+    }
+    // the config text is ~4 times larger
+    size_t capacity = INFLATE_MIN_SIZE;
+    while (capacity < size * 4 && capacity < INFLATE_MAX_GUESS && (!limit || capacity <= limit))
+    {
+        capacity <<= 1;
+    }
+    char *buffer = NULL;
+    ssize_t read = 0;
+    *length = 0;
+    do
+    {
+        if (*length == capacity || !buffer)
+        {
+            capacity <<= !!buffer;
+            capacity = (limit && capacity > limit + 1) ? limit + 1 : capacity; // the limit + 1 stops it
+            char *grown = realloc(buffer, capacity + 1);
+            if (!grown)
+            {
+                read = -ENOMEM;
+                break;
+            }
+            buffer = grown;
+        }
+        read = uniconf_stream_read(stream, buffer + *length, capacity - *length);
+        *length += (read > 0) ? (size_t)read : 0;
+    } while (read > 0);
+    uniconf_stream_close(stream);
+    if (read < 0)
+    {
+        FREE_AND_NULL(buffer);
+        errno = (int)-read;
+        return NULL;
+    }
+    buffer[*length] = '\0';
+    return buffer;
+}
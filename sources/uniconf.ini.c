@@ -14,17 +14,19 @@
  * Trailing comments start with // or ##
  *
  * @param root
- * @param filepath
+ * @param buffer
+ * @param length
+ * @param source
  * @param branch
  * @return int
  */
-int uniconf_ini(cJSON *root, const char *filepath, const char *branch)
+int uniconf_ini(cJSON *root, const char *buffer, size_t length, const char *source, const char *branch)
 {
     int count = 0;
     cJSON *node = uniconf_node(root, branch);
     if (node)
     {
-        uniconf_FileByLine(filepath, line)
+        uniconf_BufferByLine(buffer, length, line)
         {
             if (!uniconf_is_commented(line, "#"))
             {
@@ -36,7 +38,7 @@ int uniconf_ini(cJSON *root, const char *filepath, const char *branch)
                     }
                     else
                     {
-                        uniconf_error_file(filepath, _lineno, "section name error");
+                        uniconf_error_file(source, _lineno, "section name error");
                     }
                 }
                 else
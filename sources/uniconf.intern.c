@@ -0,0 +1,394 @@
+#include "uniconf.internal.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The interned keys
+ *
+ * In the interning mode each construct gets the pool of the unique key strings.
+ * The object keys point into the pool and are flagged cJSON_StringIsConst,
+ * so the repeated "host", "port"... take one copy and cJSON_Delete doesn't free them.
+ * The pool lives as long as its tree: the previous one is released by the next construct.
+ *
+ * The keys interned in the same pool are equal only when their pointers are,
+ * so the construct-time lookups compare the pointers first.
+ */
+
+typedef struct uniconf_intern_chunk
+{
+    struct uniconf_intern_chunk *next;
+    size_t used;
+    size_t size;
+    char data[];
+} uniconf_intern_chunk_t;
+
+typedef struct uniconf_intern_entry
+{
+    uint64_t hash;
+    const char *key;
+} uniconf_intern_entry_t;
+
+struct uniconf_intern_pool
+{
+    size_t count;
+    size_t mask;
+    uniconf_intern_entry_t *entries;
+    uniconf_intern_chunk_t *chunks;
+};
+
+#define INTERN_MIN_SIZE 64
+#define INTERN_CHUNK_SIZE 4096
+
+static int uniconf_intern_mode = 0;
+static uniconf_intern_pool_t *uniconf_intern_current = NULL;
+static uniconf_intern_pool_t *uniconf_intern_previous = NULL;
+// the lazy branches are interned after the construct
+static pthread_mutex_t uniconf_intern_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Enable|disable the key interning for the next constructs
+ *
+ * @param enabled
+ */
+void uniconf_intern_keys(int enabled)
+{
+    uniconf_intern_mode = enabled;
+}
+
+/**
+ * Hash the key (FNV-1a)
+ *
+ * @param key
+ * @param len : the key length, out
+ *
+ * @return uint64_t
+ */
+static uint64_t uniconf__intern_hash(const char *key, size_t *len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    const unsigned char *ptr = (const unsigned char *)key;
+    for (; *ptr; ptr++)
+    {
+        h ^= *ptr;
+        h *= 0x100000001b3ULL;
+    }
+    *len = (const char *)ptr - key;
+    return h;
+}
+
+/**
+ * Free the pool
+ *
+ * @param pool
+ */
+void uniconf_intern_pool_free(uniconf_intern_pool_t *pool)
+{
+    if (pool)
+    {
+        while (pool->chunks)
+        {
+            uniconf_intern_chunk_t *next = pool->chunks->next;
+            free(pool->chunks);
+            pool->chunks = next;
+        }
+        free(pool->entries);
+        free(pool);
+    }
+}
+
+/**
+ * Create the pool
+ *
+ * @return uniconf_intern_pool_t* | NULL = no memory
+ */
+uniconf_intern_pool_t *uniconf_intern_pool()
+{
+    uniconf_intern_pool_t *pool = calloc(1, sizeof(uniconf_intern_pool_t));
+    if (pool)
+    {
+        pool->mask = INTERN_MIN_SIZE - 1;
+        pool->entries = calloc(INTERN_MIN_SIZE, sizeof(uniconf_intern_entry_t));
+        if (!pool->entries)
+        {
+            FREE_AND_NULL(pool);
+        }
+    }
+    return pool;
+}
+
+/**
+ * Double the table
+ *
+ * @param pool
+ *
+ * @return int : 0 = no memory
+ */
+static int uniconf__intern_grow(uniconf_intern_pool_t *pool)
+{
+    size_t size = (pool->mask + 1) * 2;
+    uniconf_intern_entry_t *entries = calloc(size, sizeof(uniconf_intern_entry_t));
+    if (!entries)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i <= pool->mask; i++)
+    {
+        if (pool->entries[i].key)
+        {
+            size_t slot = pool->entries[i].hash & (size - 1);
+            while (entries[slot].key)
+            {
+                slot = (slot + 1) & (size - 1);
+            }
+            entries[slot] = pool->entries[i];
+        }
+    }
+    free(pool->entries);
+    pool->entries = entries;
+    pool->mask = size - 1;
+    return 1;
+}
+
+/**
+ * Copy the key to the pool chunks
+ *
+ * @param pool
+ * @param key
+ * @param len
+ *
+ * @return const char* | NULL
+ */
+static const char *uniconf__intern_copy(uniconf_intern_pool_t *pool, const char *key, size_t len)
+{
+    uniconf_intern_chunk_t *chunk = pool->chunks;
+    if (!chunk || chunk->size - chunk->used < len + 1)
+    {
+        size_t size = (len + 1 > INTERN_CHUNK_SIZE) ? len + 1 : INTERN_CHUNK_SIZE;
+        chunk = malloc(sizeof(uniconf_intern_chunk_t) + size);
+        if (!chunk)
+        {
+            return NULL;
+        }
+        chunk->used = 0;
+        chunk->size = size;
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
+    }
+    char *copy = chunk->data + chunk->used;
+    memcpy(copy, key, len + 1);
+    chunk->used += len + 1;
+    return copy;
+}
+
+/**
+ * Get the copy of the key interned in the pool
+ *
+ * @param pool
+ * @param key
+ *
+ * @return const char* : NULL = no memory
+ */
+const char *uniconf_intern_in(uniconf_intern_pool_t *pool, const char *key)
+{
+    if (!pool || !key || ((pool->count + 1) * 4 > (pool->mask + 1) * 3 && !uniconf__intern_grow(pool)))
+    {
+        return NULL;
+    }
+    size_t len = 0;
+    uint64_t hash = uniconf__intern_hash(key, &len);
+    size_t slot = hash & pool->mask;
+    for (; pool->entries[slot].key; slot = (slot + 1) & pool->mask)
+    {
+        if (pool->entries[slot].hash == hash && !strcmp(pool->entries[slot].key, key))
+        {
+            return pool->entries[slot].key;
+        }
+    }
+    const char *interned = uniconf__intern_copy(pool, key, len);
+    if (interned)
+    {
+        pool->entries[slot] = (uniconf_intern_entry_t){.hash = hash, .key = interned};
+        pool->count++;
+    }
+    return interned;
+}
+
+/**
+ * Get the interned copy of the key
+ *
+ * @param key
+ *
+ * @return const char* : NULL = interning is off or no memory
+ */
+const char *uniconf_intern(const char *key)
+{
+    const char *interned = NULL;
+    if (key && uniconf_intern_mode && !uniconf_layer_constructing())
+    {
+        pthread_mutex_lock(&uniconf_intern_mutex);
+        if (!uniconf_intern_current)
+        {
+            uniconf_intern_current = uniconf_intern_pool();
+        }
+        interned = uniconf_intern_in(uniconf_intern_current, key);
+        pthread_mutex_unlock(&uniconf_intern_mutex);
+    }
+    return interned;
+}
+
+/**
+ * Count the interned keys of the current tree
+ *
+ * @return size_t
+ */
+size_t uniconf_intern_count()
+{
+    pthread_mutex_lock(&uniconf_intern_mutex);
+    size_t count = uniconf_intern_current ? uniconf_intern_current->count : 0;
+    pthread_mutex_unlock(&uniconf_intern_mutex);
+    return count;
+}
+
+/**
+ * Add the named item to the object, the name is interned if enabled, the origin is recorded
+ *
+ * @param object
+ * @param name
+ * @param item : deleted on failure
+ *
+ * @return cJSON* : the item | NULL
+ */
+cJSON *uniconf_add(cJSON *object, const char *name, cJSON *item)
+{
+    const char *key = uniconf_intern(name);
+    if (item && (key ? cJSON_AddItemToObjectCS(object, key, item) : cJSON_AddItemToObject(object, name, item)))
+    {
+        return uniconf_added(item);
+    }
+    cJSON_Delete(item);
+    return NULL;
+}
+
+/**
+ * Get the named child while constructing, as cJSON_GetObjectItemCaseSensitive
+ * The name is interned, so the interned keys of the tree are compared by the pointers only,
+ * the others (e.g. the branch replaced by the .json) by the strings.
+ *
+ * @param object
+ * @param name
+ *
+ * @return cJSON*
+ */
+cJSON *uniconf_intern_child(const cJSON *object, const char *name)
+{
+    const char *key = uniconf_intern(name);
+    if (!key)
+    {
+        return cJSON_GetObjectItemCaseSensitive(object, name);
+    }
+    if (object)
+    {
+        uniconf_EachChild(item, object)
+        {
+            if (item->string == key || (item->string && !(item->type & cJSON_StringIsConst) && !strcmp(item->string, key)))
+            {
+                return item;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Intern the keys of the parsed subtree
+ *
+ * @param node
+ */
+void uniconf_intern_tree(cJSON *node)
+{
+    if (node && uniconf_intern_mode && !uniconf_layer_constructing())
+    {
+        uniconf_EachChild(item, node)
+        {
+            if (item->string && !(item->type & cJSON_StringIsConst))
+            {
+                const char *key = uniconf_intern(item->string);
+                if (key)
+                {
+                    free(item->string);
+                    item->string = (char *)key;
+                    item->type |= cJSON_StringIsConst;
+                }
+            }
+            uniconf_intern_tree(item);
+        }
+    }
+}
+
+/**
+ * Give the copy its own keys, so it may outlive the tree
+ *
+ * @param node : the cJSON_Duplicate of the tree part
+ *
+ * @return cJSON*
+ */
+cJSON *uniconf_intern_own(cJSON *node)
+{
+    if (node)
+    {
+        if (node->string && (node->type & cJSON_StringIsConst))
+        {
+            char *key = strdup(node->string);
+            if (key)
+            {
+                node->string = key;
+                node->type &= ~cJSON_StringIsConst;
+            }
+        }
+        uniconf_EachChild(item, node)
+        {
+            uniconf_intern_own(item);
+        }
+    }
+    return node;
+}
+
+/**
+ * Start the pool of the new tree, the current one is kept for the previous tree
+ *
+ */
+void uniconf_intern_begin()
+{
+    pthread_mutex_lock(&uniconf_intern_mutex);
+    uniconf_intern_pool_free(uniconf_intern_previous);
+    uniconf_intern_previous = uniconf_intern_current;
+    uniconf_intern_current = NULL;
+    pthread_mutex_unlock(&uniconf_intern_mutex);
+}
+
+/**
+ * Free the pool of the previous tree
+ *
+ */
+void uniconf_intern_release()
+{
+    pthread_mutex_lock(&uniconf_intern_mutex);
+    uniconf_intern_pool_free(uniconf_intern_previous);
+    uniconf_intern_previous = NULL;
+    pthread_mutex_unlock(&uniconf_intern_mutex);
+}
+
+/**
+ * Free all the pools
+ *
+ */
+void uniconf_intern_reset()
+{
+    uniconf_intern_release();
+    pthread_mutex_lock(&uniconf_intern_mutex);
+    uniconf_intern_pool_free(uniconf_intern_current);
+    uniconf_intern_current = NULL;
+    pthread_mutex_unlock(&uniconf_intern_mutex);
+}
@@ -18,9 +18,24 @@
 
 #include "uniconf.h"
 #include <cjson/cJSON.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <sys/types.h>
 
 // common utils
+cJSON *uniconf_root_mutable();
+int uniconf_constructing();
+unsigned long uniconf_reader_enter();
+void uniconf_reader_leave(unsigned long epoch);
+void uniconf_readers_drain();
+int uniconf_readers_advance(unsigned long *epoch);
+int uniconf_readers_gone(unsigned long epoch);
+int uniconf_build_lock();
+void uniconf_build_unlock();
+int uniconf_build_enter();
+void uniconf_build_leave(int locked);
+int uniconf_load(cJSON *root, const char *path);
+int uniconf_scan(cJSON *node, const char *pathname);
 char *uniconf_makepath(const char *path, const char *name);
 int uniconf_check(const char *path, const char *name);
 int uniconf_is_commented(char *line, const char *prefix);
@@ -28,21 +43,245 @@ char *uniconf_string(char *str, char *trail);
 char *uniconf_unquote(char *str);
 cJSON *uniconf_node(cJSON *root, const char *name);
 cJSON *uniconf_nodeNULL(cJSON *root, const char *name);
+cJSON *uniconf_lookup(cJSON *object, const char *name);
+cJSON *uniconf_walk(cJSON *node, const char *path);
+double uniconf_strtod(const char *str, char **end);
 char *uniconf_substitute(cJSON *root, const char *str);
+size_t uniconf_substitute_count();
 cJSON *uniconf_vardata(cJSON *root, char *varname);
 int uniconf_set(cJSON *node, char *name, char *value);
+cJSON *uniconf_added(cJSON *node);
+int uniconf_boolean(cJSON *object);
+
+// side tables
+typedef struct uniconf_map uniconf_map_t;
+uniconf_map_t *uniconf_map_create(size_t hint);
+void uniconf_map_destroy(uniconf_map_t *map, void (*release)(void *));
+void *uniconf_map_get(const uniconf_map_t *map, const void *key);
+void **uniconf_map_slot(uniconf_map_t *map, const void *key);
+void *uniconf_map_remove(uniconf_map_t *map, const void *key);
+size_t uniconf_map_count(const uniconf_map_t *map);
+void uniconf_map_each(const uniconf_map_t *map, void (*visit)(const void *key, void *value, void *data), void *data);
+
+// indexes
+#define UNICONF_INDEX_THRESHOLD 64
+int uniconf_index_build(cJSON *root);
+void uniconf_index_release();
+void uniconf_index_reset();
+int uniconf_is_index(const char *name, long *index);
+int uniconf_size(const cJSON *array);
+cJSON *uniconf_item(const cJSON *array, long index);
+
+// interned keys
+typedef struct uniconf_intern_pool uniconf_intern_pool_t;
+uniconf_intern_pool_t *uniconf_intern_pool();
+const char *uniconf_intern_in(uniconf_intern_pool_t *pool, const char *key);
+void uniconf_intern_pool_free(uniconf_intern_pool_t *pool);
+const char *uniconf_intern(const char *key);
+cJSON *uniconf_add(cJSON *object, const char *name, cJSON *item);
+cJSON *uniconf_intern_child(const cJSON *object, const char *name);
+void uniconf_intern_tree(cJSON *node);
+cJSON *uniconf_intern_own(cJSON *node);
+void uniconf_intern_begin();
+void uniconf_intern_release();
+void uniconf_intern_reset();
+
+// case-insensitive keys
+int uniconf_fold_enabled();
+int uniconf_fold_build(cJSON *root);
+cJSON *uniconf_fold_child(const cJSON *object, const char *name);
+void uniconf_fold_release();
+void uniconf_fold_reset();
+
+// compact lists
+int uniconf_list_compact_enabled();
+void uniconf_listset_reset();
+void uniconf_listset_drop(const cJSON *tree);
+uint64_t uniconf_listset_hash(const cJSON *node);
+size_t uniconf_listset_count(const cJSON *node);
+const char *uniconf_listset_entry(const cJSON *node, size_t index);
+
+// lazy branches
+int uniconf_lazy_mode();
+int uniconf_lazy_register(cJSON *node, const char *pathname);
+int uniconf_lazy_pending_node(const cJSON *node);
+int uniconf_lazy_paths(const cJSON *node, char ***paths);
+cJSON *uniconf_lazy_load(cJSON *node);
+void uniconf_lazy_drop(const cJSON *tree);
+void uniconf_lazy_reset();
+void uniconf_bind_reset();
+
+// layers
+int uniconf_layer_constructing();
+int uniconf_layered();
+cJSON *uniconf_layer_walk(const char *path, cJSON **tree);
+const char *uniconf_layer_name(const cJSON *tree);
+void uniconf_layer_reset();
+uint64_t uniconf_layer_hash();
+
+// provenance
+void uniconf_whence_begin(const cJSON *tree);
+void uniconf_whence_end();
+void uniconf_whence_drop(const cJSON *tree);
+uint64_t uniconf_whence_enter(const char *source);
+void uniconf_whence_leave(uint64_t previous);
+int uniconf_whence_line(int line);
+cJSON *uniconf_whence_mark(cJSON *node);
+void uniconf_whence_reset();
+
+// budgets
+void uniconf_budget_begin();
+int uniconf_budget_end();
+int uniconf_budget_error();
+int uniconf_budget_check();
+size_t uniconf_budget_file_limit();
+int uniconf_budget_file(const char *source, size_t length);
+int uniconf_budget_node();
+int uniconf_budget_depth(const char *source, int line, int depth);
+int uniconf_budget_expansion(const char *str, size_t length);
+
+// asynchronous construct
+size_t uniconf_count(const char *path);
+void uniconf_async_parsed(size_t length);
+
+// access profile
+void uniconf_access_count(const cJSON *node);
+void uniconf_access_rebuild(const cJSON *previous, cJSON *current);
+void uniconf_access_reset();
+
+// tracing
+int uniconf_tracing();
+uint64_t uniconf_trace_clock();
+void uniconf_trace_emit(uniconf_trace_event_t event, const char *path, const char *parser, size_t size, int result, uint64_t nanoseconds);
+
+#ifdef UNICONF_SDT
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define UNICONF_SEMAPHORE(name) uniconf_##name##_semaphore
+extern unsigned short UNICONF_SEMAPHORE(file__start), UNICONF_SEMAPHORE(file__done), UNICONF_SEMAPHORE(scan),
+    UNICONF_SEMAPHORE(substitute), UNICONF_SEMAPHORE(miss), UNICONF_SEMAPHORE(lookup);
+#define UNICONF_PROBING(name) (__builtin_expect(UNICONF_SEMAPHORE(name), 0) || uniconf_tracing())
+#define UNICONF_PROBE(name, ...) STAP_PROBEV(uniconf, name, __VA_ARGS__)
+#else
+#define UNICONF_PROBING(name) uniconf_tracing()
+#define UNICONF_PROBE(name, ...)
+#endif
+
+// fire the probe and the callback
+#define UNICONF_TRACE(name, event, path, parser, size, result, nanoseconds)                            \
+    do                                                                                                 \
+    {                                                                                                  \
+        UNICONF_PROBE(name, (path), (parser), (size_t)(size), (int)(result), (uint64_t)(nanoseconds)); \
+        uniconf_trace_emit((event), (path), (parser), (size), (result), (nanoseconds));                \
+    } while (0)
+
+// images
+#define UNICONF_IMAGE_MAGIC 0x4e534355 // "UCSN"
+#define UNICONF_IMAGE_VERSION 1
+
+typedef struct uniconf_image
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t generation;
+    uint64_t size;
+    uint64_t hash;
+    uint32_t count;   // of the nodes, the root is the first
+    uint32_t nodes;   // the offsets from the image start
+    uint32_t sorted;  // the object keys order
+    uint32_t strings; // the strings pool
+} uniconf_image_t;
+
+typedef struct uniconf_flat
+{
+    uint32_t type;
+    uint32_t key;   // the string offset, 0 = none
+    uint32_t value; // the string offset | the first child index
+    uint32_t count; // of the children
+    uint32_t order; // the first of the sorted keys
+    uint32_t reserved;
+    double number;
+} uniconf_flat_t;
+
+size_t uniconf_image_size(const cJSON *root);
+int uniconf_image_write(const cJSON *root, void *base, size_t size);
+const uniconf_image_t *uniconf_image_check(const void *base, size_t size);
+const uniconf_flat_t *uniconf_image_node(const uniconf_image_t *image, uint32_t index);
+const char *uniconf_image_string(const uniconf_image_t *image, uint32_t offset);
+const uniconf_flat_t *uniconf_image_walk(const uniconf_image_t *image, const char *path);
+cJSON *uniconf_image_view(const uniconf_image_t *image, const uniconf_flat_t *flat, cJSON *view);
+cJSON *uniconf_image_tree(const uniconf_image_t *image, const uniconf_flat_t *flat);
+
+// shared snapshots
+int uniconf_shm_attached();
+cJSON *uniconf_shm_object(const char *path, cJSON *view);
+cJSON *uniconf_shm_base_object(const char *path, cJSON *view);
+
+// environment
+const char *uniconf_environ_get(const char *name);
+void uniconf_environ_close();
+int uniconf_environ_override(cJSON *root);
+
+// hashes
+uint64_t uniconf_hash_build(cJSON *root);
+void uniconf_hash_release();
+void uniconf_hash_reset();
+
+// versions
+int uniconf_history_push(cJSON *previous, cJSON *current);
+cJSON *uniconf_history_tree(uint64_t version, const cJSON *current);
+void uniconf_history_reset();
+
+// subscriptions
+int uniconf_notify(cJSON *previous, cJSON *current);
+int uniconf_notify_view(cJSON *(*walk)(const void *view, const char *path), const void *previous, const void *current);
 
 // errors
 void uniconf_error(const char *format, ...);
 void uniconf_error_file(const char *filename, int line, const char *message, ...);
+cJSON *uniconf_error_redirect(cJSON *errors);
 
 // parsers
-int uniconf_env(cJSON *root, const char *filepath, const char *branch);
-int uniconf_ini(cJSON *root, const char *filepath, const char *branch);
-int uniconf_list(cJSON *root, const char *filepath, const char *branch);
-int uniconf_json(cJSON *root, const char *filepath, const char *branch);
-int uniconf_conf(cJSON *root, const char *filepath, const char *branch);
-int uniconf_yml(cJSON *root, const char *filepath, const char *branch);
+char *uniconf_read(const char *filepath, size_t *length, int *mapped);
+void uniconf_read_free(char *buffer, size_t length, int mapped);
+char *uniconf_getline(char **line, size_t *size, const char **ptr, const char *end);
+uint32_t *uniconf_json_quotes(const char *buffer, size_t length, size_t *count);
+int uniconf_compressed(const char *extension);
+char *uniconf_inflate(const char *extension, const char *data, size_t size, size_t *length, size_t limit);
+
+// the decompressed stream
+typedef struct uniconf_stream uniconf_stream_t;
+typedef int (*uniconf_stream_parser_f)(cJSON *root, uniconf_stream_t *stream, const char *source, const char *branch);
+uniconf_stream_t *uniconf_stream_open(const char *extension, const char *data, size_t size, size_t limit);
+ssize_t uniconf_stream_read(uniconf_stream_t *stream, char *buffer, size_t size);
+char *uniconf_stream_getline(uniconf_stream_t *stream, char **line, size_t *size);
+size_t uniconf_stream_length(const uniconf_stream_t *stream);
+int uniconf_stream_error(const uniconf_stream_t *stream);
+void uniconf_stream_close(uniconf_stream_t *stream);
+uniconf_stream_parser_f uniconf_parser_stream(const char *extension);
+
+// the lines of the buffer or of the stream
+typedef struct uniconf_lines
+{
+    const char *ptr;
+    const char *end;
+    uniconf_stream_t *stream; // NULL = of the buffer
+} uniconf_lines_t;
+char *uniconf_lines_get(uniconf_lines_t *lines, char **line, size_t *size);
+
+int uniconf_parse(cJSON *root, uniconf_parser_f parser, const char *format, const char *buffer, size_t length, const char *source, const char *branch);
+int uniconf_parse_compressed(cJSON *root, const char *format, const char *compression, const char *data, size_t size, const char *source, const char *branch);
+int uniconf_sources(cJSON *root, const uniconf_source_t *sources, size_t count);
+
+int uniconf_env(cJSON *root, const char *buffer, size_t length, const char *source, const char *branch);
+int uniconf_ini(cJSON *root, const char *buffer, size_t length, const char *source, const char *branch);
+int uniconf_list(cJSON *root, const char *buffer, size_t length, const char *source, const char *branch);
+int uniconf_json(cJSON *root, const char *buffer, size_t length, const char *source, const char *branch);
+int uniconf_conf(cJSON *root, const char *buffer, size_t length, const char *source, const char *branch);
+int uniconf_yml(cJSON *root, const char *buffer, size_t length, const char *source, const char *branch);
+int uniconf_env_stream(cJSON *root, uniconf_stream_t *stream, const char *source, const char *branch);
+int uniconf_list_stream(cJSON *root, uniconf_stream_t *stream, const char *source, const char *branch);
+int uniconf_yml_stream(cJSON *root, uniconf_stream_t *stream, const char *source, const char *branch);
 
 #define FREE_AND_NULL(var) \
     if (var)               \
@@ -53,17 +292,26 @@ int uniconf_yml(cJSON *root, const char *filepath, const char *branch);
 
 #define STR_EQUAL(a,b) (!strcmp(a,b))
 
-#define uniconf_FileByLine(filepath, linevar)        \
-    FILE *_file = NULL;                              \
-    if (filepath && (_file = fopen(filepath, "rt"))) \
-    {                                                \
-        char *linevar = NULL;                        \
-        size_t _len = 0;                             \
-        for (int _lineno = 1; -1 != getline(&linevar, &_len, _file); _lineno++)
+// the children as they are, without loading the lazy branches
+#define uniconf_EachChild(element, node) for (cJSON *element = (node) ? (node)->child : NULL; element != NULL; element = element->next)
+
+// the writable copies of the buffer lines, the line number is the provenance position, stops on the exceeded budget
+#define uniconf_BufferByLine(buffer, length, linevar)  \
+    {                                                  \
+        const char *_ptr = (buffer);                   \
+        const char *_end = _ptr + (length);            \
+        char *linevar = NULL;                          \
+        size_t _len = 0;                               \
+        for (int _lineno = uniconf_whence_line(1); !uniconf_budget_error() && uniconf_getline(&linevar, &_len, &_ptr, _end); _lineno = uniconf_whence_line(_lineno + 1))
+
+#define uniconf_LinesByLine(lines, linevar) \
+    {                                       \
+        char *linevar = NULL;               \
+        size_t _len = 0;                    \
+        for (int _lineno = uniconf_whence_line(1); !uniconf_budget_error() && uniconf_lines_get((lines), &linevar, &_len); _lineno = uniconf_whence_line(_lineno + 1))
 
 #define uniconf_EndByLine(linevar) \
     free(linevar);                 \
-    fclose(_file);                 \
     }
 
 #endif // UNICONF_INTERNAL_H
@@ -6,7 +6,498 @@
 #include <stdio.h>
 #include <string.h>
 
-static void uniconf_json_substitute(cJSON *json);
+/**
+ * The .json parser
+ *
+ * The tokenizer reads the buffer once and creates the nodes of the value directly,
+ * the merge relinks them into the branch, so the file is never held as the second tree
+ * and never duplicated. The errors are reported with the line and the column.
+ * The strings with '$' are remembered and substituted when the file is in the tree,
+ * so the references to the later keys of the same file are resolved as well.
+ * The large files are indexed first, the string ends are taken from the index.
+ */
+
+#define JSON_NESTING_LIMIT 1000
+#define JSON_INDEX_THRESHOLD (1 << 20)
+
+typedef struct uniconf_json_reader
+{
+    const char *buffer;
+    const char *ptr;
+    const char *end;
+    const char *line_start;
+    int line;
+    int depth;
+    const char *error;
+    cJSON **pending; // the strings to substitute
+    size_t pending_count;
+    size_t pending_size;
+    uint32_t *quotes; // the structural index or NULL
+    size_t quotes_count;
+    size_t quote;
+} uniconf_json_reader_t;
+
+static cJSON *uniconf__json_value(uniconf_json_reader_t *reader);
+
+/**
+ * Fail at the current position
+ *
+ * @param reader
+ * @param message
+ *
+ * @return cJSON* : NULL
+ */
+static cJSON *uniconf__json_fail(uniconf_json_reader_t *reader, const char *message)
+{
+    if (!reader->error)
+    {
+        reader->error = message;
+    }
+    return NULL;
+}
+
+/**
+ * Skip the whitespace, count the lines
+ *
+ * @param reader
+ *
+ * @return int : the next char, 0 = the end
+ */
+static int uniconf__json_skip(uniconf_json_reader_t *reader)
+{
+    for (; reader->ptr < reader->end; reader->ptr++)
+    {
+        if ('\n' == *reader->ptr)
+        {
+            reader->line++;
+            reader->line_start = reader->ptr + 1;
+        }
+        else if (' ' != *reader->ptr && '\t' != *reader->ptr && '\r' != *reader->ptr)
+        {
+            return (unsigned char)*reader->ptr;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Read 4 hex digits
+ *
+ * @param ptr
+ *
+ * @return long : <0 = not hex
+ */
+static long uniconf__json_hex(const char *ptr)
+{
+    long code = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int digit = ptr[i];
+        if (!isxdigit(digit))
+        {
+            return -1;
+        }
+        code = code * 16 + (isdigit(digit) ? digit - '0' : tolower(digit) - 'a' + 10);
+    }
+    return code;
+}
+
+/**
+ * Put the code point as UTF-8
+ *
+ * @param out
+ * @param code
+ *
+ * @return char* : after the bytes
+ */
+static char *uniconf__json_utf8(char *out, long code)
+{
+    if (code < 0x80)
+    {
+        *out++ = code;
+    }
+    else if (code < 0x800)
+    {
+        *out++ = 0xC0 | (code >> 6);
+        *out++ = 0x80 | (code & 0x3F);
+    }
+    else if (code < 0x10000)
+    {
+        *out++ = 0xE0 | (code >> 12);
+        *out++ = 0x80 | ((code >> 6) & 0x3F);
+        *out++ = 0x80 | (code & 0x3F);
+    }
+    else
+    {
+        *out++ = 0xF0 | (code >> 18);
+        *out++ = 0x80 | ((code >> 12) & 0x3F);
+        *out++ = 0x80 | ((code >> 6) & 0x3F);
+        *out++ = 0x80 | (code & 0x3F);
+    }
+    return out;
+}
+
+/**
+ * Read the string on the quote
+ *
+ * @param reader
+ *
+ * @return char* : must be freed | NULL = error
+ */
+static char *uniconf__json_string(uniconf_json_reader_t *reader)
+{
+    const char *start = ++reader->ptr;
+    const char *close = start;
+    size_t at = reader->quote;
+    while (reader->quotes && at < reader->quotes_count && reader->buffer + reader->quotes[at] < start - 1)
+    {
+        at++; // after the error
+    }
+    if (reader->quotes && at + 1 < reader->quotes_count && reader->buffer + reader->quotes[at] == start - 1)
+    {
+        close = reader->buffer + reader->quotes[at + 1];
+        reader->quote = at + 2;
+    }
+    else
+    {
+        while (close < reader->end && '"' != *close)
+        {
+            close += ('\\' == *close) ? 2 : 1;
+        }
+    }
+    if (close >= reader->end)
+    {
+        uniconf__json_fail(reader, "unterminated string");
+        return NULL;
+    }
+    // the escapes only shrink
+    char *result = malloc(close - start + 1);
+    if (!result)
+    {
+        uniconf__json_fail(reader, "out of memory");
+        return NULL;
+    }
+    char *out = result;
+    if (!memchr(start, '\\', close - start))
+    {
+        for (const char *ptr = memchr(start, '\n', close - start); ptr; ptr = memchr(ptr + 1, '\n', close - ptr - 1))
+        {
+            reader->line++;
+            reader->line_start = ptr + 1;
+        }
+        memcpy(result, start, close - start);
+        out += close - start;
+        start = close;
+    }
+    for (const char *ptr = start; ptr < close; ptr++)
+    {
+        if ('\\' != *ptr)
+        {
+            if ('\n' == *ptr)
+            {
+                reader->line++;
+                reader->line_start = ptr + 1;
+            }
+            *out++ = *ptr;
+            continue;
+        }
+        reader->ptr = ptr;
+        switch (*++ptr)
+        {
+        case 'b':
+            *out++ = '\b';
+            break;
+        case 'f':
+            *out++ = '\f';
+            break;
+        case 'n':
+            *out++ = '\n';
+            break;
+        case 'r':
+            *out++ = '\r';
+            break;
+        case 't':
+            *out++ = '\t';
+            break;
+        case '"':
+        case '\\':
+        case '/':
+            *out++ = *ptr;
+            break;
+        case 'u':
+        {
+            long code = (close - ptr > 4) ? uniconf__json_hex(ptr + 1) : -1;
+            ptr += 4;
+            if (code >= 0xD800 && code < 0xDC00)
+            {
+                // the surrogate pair
+                long low = (close - ptr > 6 && '\\' == ptr[1] && 'u' == ptr[2]) ? uniconf__json_hex(ptr + 3) : -1;
+                code = (low >= 0xDC00 && low < 0xE000) ? 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00) : -1;
+                ptr += 6;
+            }
+            else if (code >= 0xDC00 && code < 0xE000)
+            {
+                code = -1;
+            }
+            if (code < 0)
+            {
+                free(result);
+                uniconf__json_fail(reader, "invalid unicode escape");
+                return NULL;
+            }
+            out = uniconf__json_utf8(out, code);
+        }
+        break;
+        default:
+            free(result);
+            uniconf__json_fail(reader, "invalid escape");
+            return NULL;
+        }
+    }
+    *out = '\0';
+    reader->ptr = close + 1;
+    return result;
+}
+
+/**
+ * Read the number
+ *
+ * @param reader
+ *
+ * @return cJSON*
+ */
+static cJSON *uniconf__json_number(uniconf_json_reader_t *reader)
+{
+    const char *ptr = reader->ptr;
+    ptr += ('-' == *ptr);
+    if (ptr >= reader->end || !isdigit(*ptr))
+    {
+        return uniconf__json_fail(reader, "unexpected character");
+    }
+    ptr += ('0' == *ptr) ? 1 : 0;
+    while (ptr < reader->end && isdigit(*ptr))
+    {
+        ptr++;
+    }
+    if (ptr < reader->end && '.' == *ptr)
+    {
+        if (++ptr >= reader->end || !isdigit(*ptr))
+        {
+            return uniconf__json_fail(reader, "invalid number");
+        }
+        while (ptr < reader->end && isdigit(*ptr))
+        {
+            ptr++;
+        }
+    }
+    if (ptr < reader->end && ('e' == *ptr || 'E' == *ptr))
+    {
+        ptr++;
+        ptr += (ptr < reader->end && ('+' == *ptr || '-' == *ptr));
+        if (ptr >= reader->end || !isdigit(*ptr))
+        {
+            return uniconf__json_fail(reader, "invalid number");
+        }
+        while (ptr < reader->end && isdigit(*ptr))
+        {
+            ptr++;
+        }
+    }
+
+    char *text = strndup(reader->ptr, ptr - reader->ptr);
+    if (!text)
+    {
+        return uniconf__json_fail(reader, "out of memory");
+    }
+    reader->ptr = ptr;
+    cJSON *item = cJSON_CreateNumber(uniconf_strtod(text, NULL));
+    free(text);
+    return item ? item : uniconf__json_fail(reader, "out of memory");
+}
+
+/**
+ * Read the literal
+ *
+ * @param reader
+ * @param literal
+ * @param item : deleted on failure
+ *
+ * @return cJSON*
+ */
+static cJSON *uniconf__json_literal(uniconf_json_reader_t *reader, const char *literal, cJSON *item)
+{
+    size_t len = strlen(literal);
+    if ((size_t)(reader->end - reader->ptr) < len || strncmp(reader->ptr, literal, len))
+    {
+        cJSON_Delete(item);
+        return uniconf__json_fail(reader, "invalid literal");
+    }
+    reader->ptr += len;
+    return item ? item : uniconf__json_fail(reader, "out of memory");
+}
+
+/**
+ * Create the string node, remember it for the substitution
+ *
+ * @param reader
+ *
+ * @return cJSON*
+ */
+static cJSON *uniconf__json_string_item(uniconf_json_reader_t *reader)
+{
+    char *value = uniconf__json_string(reader);
+    if (!value)
+    {
+        return NULL;
+    }
+    cJSON *item = cJSON_CreateString(value);
+    if (item && strchr(value, '$'))
+    {
+        if (reader->pending_count == reader->pending_size)
+        {
+            size_t size = reader->pending_size ? reader->pending_size * 2 : 16;
+            cJSON **pending = realloc(reader->pending, size * sizeof(cJSON *));
+            if (!pending)
+            {
+                cJSON_Delete(item);
+                item = NULL;
+            }
+            else
+            {
+                reader->pending = pending;
+                reader->pending_size = size;
+            }
+        }
+        if (item)
+        {
+            reader->pending[reader->pending_count++] = item;
+        }
+    }
+    free(value);
+    return item ? item : uniconf__json_fail(reader, "out of memory");
+}
+
+/**
+ * Read the object members or the array items
+ *
+ * @param reader
+ * @param container
+ * @param close : '}' | ']'
+ *
+ * @return cJSON* : the container | NULL = error, deleted
+ */
+static cJSON *uniconf__json_container(uniconf_json_reader_t *reader, cJSON *container, char close)
+{
+    if (!container)
+    {
+        return uniconf__json_fail(reader, "out of memory");
+    }
+    if (++reader->depth > JSON_NESTING_LIMIT || uniconf_budget_depth(NULL, reader->line, reader->depth) < 0)
+    {
+        cJSON_Delete(container);
+        return uniconf__json_fail(reader, "too deep nesting");
+    }
+    reader->ptr++;
+    int next = uniconf__json_skip(reader);
+    if (close == next)
+    {
+        reader->ptr++;
+        reader->depth--;
+        return container;
+    }
+    while (next)
+    {
+        if (uniconf_budget_error())
+        {
+            uniconf__json_fail(reader, "stopped by the budget");
+            break;
+        }
+        char *key = NULL;
+        if ('}' == close)
+        {
+            if ('"' != next)
+            {
+                uniconf__json_fail(reader, "expected the key");
+                break;
+            }
+            if (!(key = uniconf__json_string(reader)))
+            {
+                break;
+            }
+            if (':' != uniconf__json_skip(reader))
+            {
+                free(key);
+                uniconf__json_fail(reader, "expected ':'");
+                break;
+            }
+            reader->ptr++;
+        }
+        int line = reader->line; // of the key or the item
+        cJSON *item = uniconf__json_value(reader);
+        if (item)
+        {
+            uniconf_whence_line(line);
+            item = key ? uniconf_add(container, key, item) : (cJSON_AddItemToArray(container, item) ? uniconf_added(item) : NULL);
+            if (!item)
+            {
+                uniconf__json_fail(reader, "out of memory");
+            }
+        }
+        free(key);
+        if (!item)
+        {
+            break;
+        }
+
+        next = uniconf__json_skip(reader);
+        if (close == next)
+        {
+            reader->ptr++;
+            reader->depth--;
+            return container;
+        }
+        if (',' != next)
+        {
+            uniconf__json_fail(reader, ('}' == close) ? "expected ',' or '}'" : "expected ',' or ']'");
+            break;
+        }
+        reader->ptr++;
+        next = uniconf__json_skip(reader);
+    }
+    uniconf__json_fail(reader, "unexpected end");
+    cJSON_Delete(container);
+    return NULL;
+}
+
+/**
+ * Read the value
+ *
+ * @param reader
+ *
+ * @return cJSON* | NULL = error
+ */
+static cJSON *uniconf__json_value(uniconf_json_reader_t *reader)
+{
+    switch (uniconf__json_skip(reader))
+    {
+    case '{':
+        return uniconf__json_container(reader, cJSON_CreateObject(), '}');
+    case '[':
+        return uniconf__json_container(reader, cJSON_CreateArray(), ']');
+    case '"':
+        return uniconf__json_string_item(reader);
+    case 't':
+        return uniconf__json_literal(reader, "true", cJSON_CreateTrue());
+    case 'f':
+        return uniconf__json_literal(reader, "false", cJSON_CreateFalse());
+    case 'n':
+        return uniconf__json_literal(reader, "null", cJSON_CreateNull());
+    case 0:
+        return uniconf__json_fail(reader, "unexpected end");
+    default:
+        return uniconf__json_number(reader);
+    }
+}
 
 /**
  * Parse the .json file
@@ -14,84 +505,80 @@ static void uniconf_json_substitute(cJSON *json);
  * Each $() will be substituted
  *
  * @param root
- * @param filepath
+ * @param buffer
+ * @param length
+ * @param source
  * @param branch
  * @return int
  */
-int uniconf_json(cJSON *root, const char *filepath, const char *branch)
+int uniconf_json(cJSON *root, const char *buffer, size_t length, const char *source, const char *branch)
 {
     int count = 0;
-    FILE *file = NULL;
 
-    if (root && filepath && (file = fopen(filepath, "rt")))
+    if (root && buffer)
     {
-        char *buffer = NULL;
-        size_t len = 0;
-        getdelim(&buffer, &len, '\0', file);
-        fclose(file);
-
-        cJSON *json = cJSON_Parse(buffer);
+        uniconf_json_reader_t reader = {.buffer = buffer, .ptr = buffer, .end = buffer + length, .line_start = buffer, .line = 1};
+        if (length >= JSON_INDEX_THRESHOLD && length < UINT32_MAX)
+        {
+            reader.quotes = uniconf_json_quotes(buffer, length, &reader.quotes_count);
+        }
+        cJSON *json = uniconf__json_value(&reader);
+        FREE_AND_NULL(reader.quotes);
+        if (json && uniconf__json_skip(&reader))
+        {
+            uniconf__json_fail(&reader, "unexpected data after the value");
+            cJSON_Delete(json);
+            json = NULL;
+        }
         if (!json)
         {
-            uniconf_error_file(filepath, 0, "%s", cJSON_GetErrorPtr());
+            reader.pending_count = 0;
+            uniconf_error_file(source, reader.line, "column %d: %s", (int)(reader.ptr - reader.line_start) + 1, reader.error);
         }
         else
         {
+            uniconf_whence_line(0);
             cJSON *node = uniconf_nodeNULL(root, branch);
-            if (cJSON_IsNull(node))
+            int joined = (node->type & 0xFF) == (json->type & 0xFF); // not the key flags
+            if (cJSON_IsNull(node) || (joined && !cJSON_IsObject(node) && !cJSON_IsArray(node)))
             {
-                // replace
-                cJSON_ReplaceItemInObject(root, branch, json);
-                uniconf_json_substitute(json);
+                uniconf_added(json);
+                // replace the empty branch|the scalar, the branch key is kept
+                json->string = node->string;
+                json->type |= node->type & cJSON_StringIsConst;
+                node->string = NULL;
+                cJSON_ReplaceItemViaPointer(root, node, json);
+                json = NULL;
                 count++;
             }
-            else if (node->type != json->type)
+            else if (!joined)
             {
-                uniconf_error_file(filepath, 0, "ERROR: wrong join (%d-%d)", node->type, json->type);
+                uniconf_error_file(source, 0, "ERROR: wrong join (%d-%d)", node->type & 0xFF, json->type & 0xFF);
+                reader.pending_count = 0;
             }
             else
             {
-                // merge
-                for (cJSON *element = json->child; element != NULL; element = element->next)
+                // merge, the nodes are moved
+                while (json->child)
                 {
-                    if (cJSON_IsObject(node))
-                    {
-                        cJSON_AddItemToObject(node, element->string, cJSON_Duplicate(element, 1));
-                    }
-                    else if (cJSON_IsArray(node))
-                    {
-                        cJSON_AddItemToArray(node, cJSON_Duplicate(element, 1));
-                    }
+                    cJSON_AddItemToArray(node, cJSON_DetachItemViaPointer(json, json->child));
                     count++;
                 }
-                uniconf_json_substitute(root);
-                cJSON_Delete(json);
             }
         }
-        if (buffer)
-        {
-            free(buffer);
-        }
-    }
-    return count;
-}
 
-static void uniconf_json_substitute(cJSON *json)
-{
-    if (cJSON_IsObject(json) || cJSON_IsArray(json))
-    {
-        for (cJSON *element = json->child; element != NULL; element = element->next)
+        // the pending strings are in the branch, unless not joined
+        for (size_t i = 0; i < reader.pending_count; i++)
         {
-            uniconf_json_substitute(element);
-        }
-    }
-    else if (cJSON_IsString(json))
-    {
-        char *expanded = uniconf_substitute(NULL, cJSON_GetStringValue(json));
-        if (expanded)
-        {
-            cJSON_SetValuestring(json, expanded);
-            free(expanded);
+            char *expanded = uniconf_substitute(NULL, reader.pending[i]->valuestring);
+            if (expanded)
+            {
+                cJSON_SetValuestring(reader.pending[i], expanded);
+                free(expanded);
+            }
         }
+        free(reader.pending);
+        cJSON_Delete(json);
     }
+    return count;
 }
@@ -0,0 +1,426 @@
+#include "uniconf.internal.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The layers over the constructed tree
+ *
+ * Each layer is constructed from its own path into its own tree, the layers added later are above.
+ * The getters take the path from the topmost layer having it, then from the constructed tree,
+ * so e.g. the host-local layer is reconstructed without touching the defaults.
+ * The objects are not merged: the object comes from one layer, its missing children fall through
+ * only when they are got by their own paths.
+ *
+ * The layer trees are plain: not lazy, not interned, not compact, not indexed,
+ * as the side tables belong to the constructed tree.
+ * The variables of the layer are resolved in the layer, then in the ones below.
+ *
+ * The layers are constructed under the lock of the construct and published as the whole array,
+ * the replaced layer is freed after the getters reading it. The errors of the layer are kept apart.
+ * The subscribers are notified of the paths got through the layers that have changed,
+ * the version folds the hashes of the layer trees.
+ */
+
+typedef struct uniconf_layer
+{
+    char *name;
+    cJSON *root;
+    uint64_t hash; // of the root
+    cJSON *errors; // of the last construct
+} uniconf_layer_t;
+
+typedef struct uniconf_layers
+{
+    int count;
+    uniconf_layer_t items[]; // the base first
+} uniconf_layers_t;
+
+static uniconf_layers_t *uniconf_layers = NULL; // replaced as the whole
+// while constructing, of the constructing thread
+static __thread int uniconf_layer_index = -1;
+static __thread cJSON *uniconf_layer_root = NULL;
+
+/**
+ * Get the published layers
+ *
+ * @return uniconf_layers_t* | NULL
+ */
+static uniconf_layers_t *uniconf__layers()
+{
+    return __atomic_load_n(&uniconf_layers, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Is the layer being constructed by this thread
+ *
+ * @return int
+ */
+int uniconf_layer_constructing()
+{
+    return NULL != uniconf_layer_root;
+}
+
+/**
+ * Are there the layers
+ *
+ * @return int
+ */
+int uniconf_layered()
+{
+    uniconf_layers_t *layers = uniconf__layers();
+    return (layers && layers->count > 0) || uniconf_layer_root;
+}
+
+/**
+ * Find the layer
+ *
+ * @param layers
+ * @param name
+ *
+ * @return int : the index, <0 = not found
+ */
+static int uniconf__layer_find(const uniconf_layers_t *layers, const char *name)
+{
+    for (int i = 0; layers && name && i < layers->count; i++)
+    {
+        if (!strcmp(layers->items[i].name, name))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Copy the layers
+ *
+ * @param layers
+ * @param count : of the copy, the items over the copied ones are empty
+ *
+ * @return uniconf_layers_t* | NULL = no memory
+ */
+static uniconf_layers_t *uniconf__layers_copy(const uniconf_layers_t *layers, int count)
+{
+    uniconf_layers_t *copy = calloc(1, sizeof(uniconf_layers_t) + count * sizeof(uniconf_layer_t));
+    if (copy)
+    {
+        copy->count = count;
+        if (layers)
+        {
+            memcpy(copy->items, layers->items, ((count < layers->count) ? count : layers->count) * sizeof(uniconf_layer_t));
+        }
+    }
+    return copy;
+}
+
+/**
+ * Walk the path through the layers from the top one, then the constructed tree
+ *
+ * @param layers
+ * @param top : the index of the top one
+ * @param path
+ * @param tree : the tree having the path, out | NULL
+ *
+ * @return cJSON*
+ */
+static cJSON *uniconf__layers_walk(const uniconf_layers_t *layers, int top, const char *path, cJSON **tree)
+{
+    for (int i = top; layers && i >= 0; i--)
+    {
+        cJSON *node = uniconf_walk(layers->items[i].root, path);
+        if (node)
+        {
+            if (tree)
+            {
+                *tree = layers->items[i].root;
+            }
+            return node;
+        }
+    }
+    if (tree)
+    {
+        *tree = uniconf_root_mutable();
+    }
+    return uniconf_walk(uniconf_root_mutable(), path);
+}
+
+/**
+ * Walk the layers as the view of the subscriptions
+ *
+ * @param view : the layers | NULL
+ * @param path
+ *
+ * @return cJSON*
+ */
+static cJSON *uniconf__layers_view(const void *view, const char *path)
+{
+    const uniconf_layers_t *layers = view;
+    return uniconf__layers_walk(layers, layers ? layers->count - 1 : -1, path, NULL);
+}
+
+/**
+ * Publish the layers, notify the subscribers, free the replaced array after the getters reading it
+ * The trees of the replaced array are still alive.
+ *
+ * @param layers
+ */
+static void uniconf__layers_publish(uniconf_layers_t *layers)
+{
+    uniconf_layers_t *replaced = __atomic_exchange_n(&uniconf_layers, layers, __ATOMIC_ACQ_REL);
+    uniconf_readers_drain();
+    uniconf_notify_view(uniconf__layers_view, replaced, layers);
+    free(replaced);
+}
+
+/**
+ * Free the layer tree, not read anymore
+ *
+ * @param root
+ */
+static void uniconf__layer_free(cJSON *root)
+{
+    uniconf_whence_drop(root);
+    cJSON_Delete(root);
+}
+
+/**
+ * Construct|reconstruct the layer, the new one is on the top
+ * The layer is built aside and published complete, the replaced tree is freed after the getters.
+ *
+ * @param name
+ * @param format : the path
+ * @param ...
+ *
+ * @return int : >=0 - success count, <0 - error number
+ */
+int uniconf_layer(const char *name, const char *format, ...)
+{
+    if (!name || !*name || !format || uniconf_layer_constructing())
+    {
+        return -EINVAL;
+    }
+    char *path = NULL;
+    va_list ap;
+    va_start(ap, format);
+    vasprintf(&path, format, ap);
+    va_end(ap);
+    if (!path)
+    {
+        return -ENOMEM;
+    }
+    if (!uniconf_get_root())
+    {
+        uniconf_construct(NULL); // the base below
+    }
+    int ret = uniconf_build_lock();
+    if (ret)
+    {
+        free(path);
+        return ret; // from the subscriber
+    }
+
+    uniconf_layers_t *layers = uniconf__layers();
+    int count = layers ? layers->count : 0;
+    int index = uniconf__layer_find(layers, name);
+    uniconf_layers_t *updated = uniconf__layers_copy(layers, (index < 0) ? count + 1 : count);
+    if (updated && index < 0)
+    {
+        index = count;
+        updated->items[index].name = strdup(name);
+    }
+    if (!updated || !updated->items[index].name)
+    {
+        free(updated);
+        uniconf_build_unlock();
+        free(path);
+        return -ENOMEM;
+    }
+
+    uniconf_layer_index = index;
+    uniconf_layer_root = cJSON_CreateObject();
+    cJSON *errors = cJSON_CreateArray();
+    cJSON *target = uniconf_error_redirect(errors);
+    uniconf_whence_begin(uniconf_layer_root);
+    uniconf_budget_begin();
+    ret = uniconf_layer_root ? uniconf_load(uniconf_layer_root, path) : -ENOMEM;
+    int exceeded = uniconf_budget_end();
+    ret = exceeded ? exceeded : ret;
+    uniconf_whence_end();
+    uniconf_environ_close();
+    uniconf_error_redirect(target);
+
+    uniconf_layer_t replaced = (index < count) ? layers->items[index] : (uniconf_layer_t){0};
+    cJSON *root = uniconf_layer_root;
+    if (ret >= 0)
+    {
+        updated->items[index].root = root;
+        updated->items[index].hash = uniconf_hash(root);
+    }
+    updated->items[index].errors = errors;
+    // the callbacks read the published layers
+    uniconf_layer_root = NULL;
+    uniconf_layer_index = -1;
+    uniconf__layers_publish(updated);
+    uniconf__layer_free((ret >= 0) ? replaced.root : root);
+    cJSON_Delete(replaced.errors);
+    uniconf_build_unlock();
+    free(path);
+    return ret;
+}
+
+/**
+ * Remove the layer
+ *
+ * @param name
+ *
+ * @return int : <0 = error, -ENOENT = not found
+ */
+int uniconf_layer_remove(const char *name)
+{
+    if (uniconf_layer_constructing())
+    {
+        return -EINVAL;
+    }
+    int ret = uniconf_build_lock();
+    if (ret)
+    {
+        return ret; // from the subscriber
+    }
+    uniconf_layers_t *layers = uniconf__layers();
+    int index = uniconf__layer_find(layers, name);
+    uniconf_layers_t *updated = (index < 0) ? NULL : uniconf__layers_copy(layers, layers->count - 1);
+    if (!updated)
+    {
+        uniconf_build_unlock();
+        return (index < 0) ? -ENOENT : -ENOMEM;
+    }
+    uniconf_layer_t removed = layers->items[index];
+    memcpy(&updated->items[index], &layers->items[index + 1], (layers->count - index - 1) * sizeof(uniconf_layer_t));
+    uniconf__layers_publish(updated);
+    free(removed.name);
+    uniconf__layer_free(removed.root);
+    cJSON_Delete(removed.errors);
+    uniconf_build_unlock();
+    return 0;
+}
+
+/**
+ * Get the tree of the layer
+ *
+ * @param name
+ *
+ * @return uniconf_t | NULL
+ */
+uniconf_t uniconf_layer_get(const char *name)
+{
+    uniconf_layers_t *layers = uniconf__layers();
+    int index = uniconf__layer_find(layers, name);
+    return (index < 0) ? NULL : layers->items[index].root;
+}
+
+/**
+ * Get the errors of the last construct of the layer
+ *
+ * @param name
+ *
+ * @return char* : the JSON array, must be freed | NULL = none
+ */
+char *uniconf_layer_errors(const char *name)
+{
+    unsigned long epoch = uniconf_reader_enter();
+    uniconf_layers_t *layers = uniconf__layers();
+    int index = uniconf__layer_find(layers, name);
+    cJSON *errors = (index < 0) ? NULL : layers->items[index].errors;
+    char *printed = cJSON_GetArraySize(errors) ? cJSON_PrintUnformatted(errors) : NULL;
+    uniconf_reader_leave(epoch);
+    return printed;
+}
+
+/**
+ * Get the name of the layer tree
+ *
+ * @param tree
+ *
+ * @return const char* | NULL = not a layer
+ */
+const char *uniconf_layer_name(const cJSON *tree)
+{
+    uniconf_layers_t *layers = uniconf__layers();
+    for (int i = 0; tree && layers && i < layers->count; i++)
+    {
+        if (layers->items[i].root == tree)
+        {
+            return layers->items[i].name;
+        }
+    }
+    return (tree && tree == uniconf_layer_root && layers && uniconf_layer_index < layers->count)
+               ? layers->items[uniconf_layer_index].name
+               : NULL;
+}
+
+/**
+ * Walk the path through the layers from the top, then the constructed tree
+ * While the layer is constructed, its new tree and the layers below are walked.
+ *
+ * @param path
+ * @param tree : the tree having the path, out | NULL
+ *
+ * @return cJSON*
+ */
+cJSON *uniconf_layer_walk(const char *path, cJSON **tree)
+{
+    uniconf_layers_t *layers = uniconf__layers();
+    int top = layers ? layers->count - 1 : -1;
+    if (uniconf_layer_root)
+    {
+        cJSON *node = uniconf_walk(uniconf_layer_root, path);
+        if (node)
+        {
+            if (tree)
+            {
+                *tree = uniconf_layer_root;
+            }
+            return node;
+        }
+        top = uniconf_layer_index - 1;
+    }
+    return uniconf__layers_walk(layers, top, path, tree);
+}
+
+/**
+ * Get the hash of the layer trees, from the base
+ *
+ * @return uint64_t : 0 = none
+ */
+uint64_t uniconf_layer_hash()
+{
+    uniconf_layers_t *layers = uniconf__layers();
+    uint64_t hash = 0;
+    for (int i = 0; layers && i < layers->count; i++)
+    {
+        if (layers->items[i].root)
+        {
+            hash = (hash ^ layers->items[i].hash) * 0x100000001b3ULL + 1; // FNV, by the order
+        }
+    }
+    return hash;
+}
+
+/**
+ * Remove all the layers
+ *
+ */
+void uniconf_layer_reset()
+{
+    uniconf_layers_t *layers = uniconf__layers();
+    for (int i = 0; layers && i < layers->count; i++)
+    {
+        free(layers->items[i].name);
+        uniconf__layer_free(layers->items[i].root);
+        cJSON_Delete(layers->items[i].errors);
+    }
+    FREE_AND_NULL(uniconf_layers);
+}
@@ -0,0 +1,306 @@
+#include "uniconf.internal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The lazy loading of the directory branches
+ *
+ * In the lazy mode the construct registers each subdirectory as the placeholder
+ * with only its path recorded. The branch is parsed on the first lookup or uniconf_ForEach,
+ * once, under the lock. The lock is recursive, the branch being loaded may refer to the others.
+ * The table of the placeholders is read under the reader lock, the loads register the nested ones.
+ * The errors of the loads go to their own list, not to the "errors" of the tree being read.
+ * The placeholders of the replaced tree stay loadable until the next construct.
+ *
+ * The branches loaded later are not indexed and not hashed at the construct,
+ * their hashes are computed on demand.
+ */
+
+typedef enum
+{
+    UNICONF_LAZY_PENDING,
+    UNICONF_LAZY_LOADING,
+    UNICONF_LAZY_DONE,
+} uniconf_lazy_e;
+
+typedef struct uniconf_branch
+{
+    int state;
+    int count;
+    char **paths;
+} uniconf_branch_t;
+
+static int uniconf_lazy_enabled = 0;
+static int uniconf_lazy_pending = 0;
+static uniconf_map_t *uniconf_branches = NULL;
+static pthread_rwlock_t uniconf_branches_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t uniconf_lazy_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static cJSON *uniconf_lazy_log = NULL; // the errors of the loads
+
+/**
+ * Enable|disable the lazy mode for the next constructs
+ *
+ * @param enabled
+ */
+void uniconf_lazy(int enabled)
+{
+    uniconf_lazy_enabled = enabled;
+}
+
+/**
+ * Is the lazy mode on
+ *
+ * @return int
+ */
+int uniconf_lazy_mode()
+{
+    return uniconf_lazy_enabled && !uniconf_layer_constructing();
+}
+
+/**
+ * Free the branch record
+ *
+ * @param data
+ */
+static void uniconf__branch_free(void *data)
+{
+    uniconf_branch_t *branch = data;
+    if (branch)
+    {
+        for (int i = 0; i < branch->count; i++)
+        {
+            free(branch->paths[i]);
+        }
+        free(branch->paths);
+        free(branch);
+    }
+}
+
+/**
+ * Register the directory as the placeholder of the node
+ *
+ * @param node
+ * @param pathname
+ *
+ * @return int : <0 = error, 0 = registered
+ */
+int uniconf_lazy_register(cJSON *node, const char *pathname)
+{
+    int ret = -ENOMEM;
+    pthread_rwlock_wrlock(&uniconf_branches_lock);
+    if (!uniconf_branches)
+    {
+        uniconf_branches = uniconf_map_create(0);
+    }
+    void **slot = uniconf_branches ? uniconf_map_slot(uniconf_branches, node) : NULL;
+    // several directories may share the branch: "net" and "net.d"
+    uniconf_branch_t *branch = slot ? *slot : NULL;
+    if (slot && !branch)
+    {
+        if ((branch = calloc(1, sizeof(uniconf_branch_t))))
+        {
+            *slot = branch;
+            __atomic_add_fetch(&uniconf_lazy_pending, 1, __ATOMIC_RELEASE);
+        }
+        else
+        {
+            uniconf_map_remove(uniconf_branches, node);
+        }
+    }
+    char **paths = branch ? realloc(branch->paths, (branch->count + 1) * sizeof(char *)) : NULL;
+    if (paths)
+    {
+        branch->paths = paths;
+        if ((branch->paths[branch->count] = strdup(pathname)))
+        {
+            branch->count++;
+            ret = 0;
+        }
+    }
+    pthread_rwlock_unlock(&uniconf_branches_lock);
+    return ret;
+}
+
+/**
+ * Find the placeholder record of the node
+ *
+ * @param node
+ *
+ * @return uniconf_branch_t* | NULL
+ */
+static uniconf_branch_t *uniconf__branch(const cJSON *node)
+{
+    pthread_rwlock_rdlock(&uniconf_branches_lock);
+    uniconf_branch_t *branch = uniconf_map_get(uniconf_branches, node);
+    pthread_rwlock_unlock(&uniconf_branches_lock);
+    return branch; // freed only with the tree
+}
+
+/**
+ * Is the node the branch not loaded yet
+ *
+ * @param node
+ *
+ * @return int
+ */
+int uniconf_lazy_pending_node(const cJSON *node)
+{
+    if (node && __atomic_load_n(&uniconf_lazy_pending, __ATOMIC_ACQUIRE))
+    {
+        uniconf_branch_t *branch = uniconf__branch(node);
+        return branch && UNICONF_LAZY_DONE != __atomic_load_n(&branch->state, __ATOMIC_ACQUIRE);
+    }
+    return 0;
+}
+
+/**
+ * Get the directories of the branch not loaded yet
+ *
+ * @param node
+ * @param paths : out, live as long as the tree
+ *
+ * @return int : the count, 0 = loaded|not the branch
+ */
+int uniconf_lazy_paths(const cJSON *node, char ***paths)
+{
+    uniconf_branch_t *branch = uniconf_lazy_pending_node(node) ? uniconf__branch(node) : NULL;
+    *paths = branch ? branch->paths : NULL;
+    return branch ? branch->count : 0;
+}
+
+/**
+ * Load the branch if it is the placeholder
+ *
+ * @param node
+ *
+ * @return cJSON* the node
+ */
+cJSON *uniconf_lazy_load(cJSON *node)
+{
+    if (!node || !__atomic_load_n(&uniconf_lazy_pending, __ATOMIC_ACQUIRE))
+    {
+        return node; // the fast path
+    }
+
+    uniconf_branch_t *branch = uniconf__branch(node);
+    if (!branch || UNICONF_LAZY_DONE == __atomic_load_n(&branch->state, __ATOMIC_ACQUIRE))
+    {
+        return node;
+    }
+
+    pthread_mutex_lock(&uniconf_lazy_mutex);
+    // the same thread re-entering while loading sees the partial branch
+    if (UNICONF_LAZY_PENDING == branch->state)
+    {
+        branch->state = UNICONF_LAZY_LOADING;
+        if (!uniconf_lazy_log)
+        {
+            uniconf_lazy_log = cJSON_CreateArray();
+        }
+        cJSON *errors = uniconf_error_redirect(uniconf_lazy_log);
+        for (int i = 0; i < branch->count; i++)
+        {
+            int ret = uniconf_scan(node, branch->paths[i]);
+            if (ret < 0)
+            {
+                uniconf_error("ERROR: branch '%s' failed to load: %s", branch->paths[i], strerror(-ret));
+            }
+        }
+        uniconf_error_redirect(errors);
+        if (!uniconf_constructing() && !uniconf_layer_constructing())
+        {
+            uniconf_environ_close(); // of this load
+        }
+        __atomic_store_n(&branch->state, UNICONF_LAZY_DONE, __ATOMIC_RELEASE);
+        __atomic_sub_fetch(&uniconf_lazy_pending, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&uniconf_lazy_mutex);
+    return node;
+}
+
+/**
+ * Get the first child, loading the branch
+ *
+ * @param node
+ *
+ * @return const cJSON*
+ */
+const cJSON *uniconf_children(const cJSON *node)
+{
+    node = uniconf_lazy_load((cJSON *)node);
+    return node ? node->child : NULL;
+}
+
+/**
+ * Forget the placeholders of the subtree
+ *
+ * @param node
+ */
+static void uniconf__lazy_drop(const cJSON *node)
+{
+    uniconf_branch_t *branch = uniconf_map_remove(uniconf_branches, node);
+    if (branch)
+    {
+        if (UNICONF_LAZY_DONE != branch->state)
+        {
+            __atomic_sub_fetch(&uniconf_lazy_pending, 1, __ATOMIC_RELEASE);
+        }
+        uniconf__branch_free(branch);
+    }
+    uniconf_EachChild(item, node)
+    {
+        uniconf__lazy_drop(item);
+    }
+}
+
+/**
+ * Forget the placeholders of the replaced tree and the errors of the loads, before the construct
+ *
+ * @param tree : NULL = none
+ */
+void uniconf_lazy_drop(const cJSON *tree)
+{
+    pthread_mutex_lock(&uniconf_lazy_mutex);
+    if (tree && uniconf_branches)
+    {
+        pthread_rwlock_wrlock(&uniconf_branches_lock);
+        uniconf__lazy_drop(tree);
+        pthread_rwlock_unlock(&uniconf_branches_lock);
+    }
+    cJSON_Delete(uniconf_lazy_log);
+    uniconf_lazy_log = NULL;
+    pthread_mutex_unlock(&uniconf_lazy_mutex);
+}
+
+/**
+ * Forget all the placeholders
+ *
+ */
+void uniconf_lazy_reset()
+{
+    pthread_mutex_lock(&uniconf_lazy_mutex);
+    pthread_rwlock_wrlock(&uniconf_branches_lock);
+    uniconf_map_destroy(uniconf_branches, uniconf__branch_free);
+    uniconf_branches = NULL;
+    __atomic_store_n(&uniconf_lazy_pending, 0, __ATOMIC_RELEASE);
+    pthread_rwlock_unlock(&uniconf_branches_lock);
+    cJSON_Delete(uniconf_lazy_log);
+    uniconf_lazy_log = NULL;
+    pthread_mutex_unlock(&uniconf_lazy_mutex);
+}
+
+/**
+ * Get the errors of the branches loaded since the construct
+ *
+ * @return char* : the JSON array, must be freed | NULL = none
+ */
+char *uniconf_lazy_errors()
+{
+    pthread_mutex_lock(&uniconf_lazy_mutex);
+    char *errors = cJSON_GetArraySize(uniconf_lazy_log) ? cJSON_PrintUnformatted(uniconf_lazy_log) : NULL;
+    pthread_mutex_unlock(&uniconf_lazy_mutex);
+    return errors;
+}
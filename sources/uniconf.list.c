@@ -2,34 +2,591 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 
 /**
- * Parse the .list file
+ * The compact lists
+ *
+ * In the compact mode the .list entries are not the cJSON nodes: the branch array stays empty
+ * and the entries go to one string pool with the sorted offsets, kept in the side table.
+ * The membership and prefix lookups are binary searches.
+ * The entries are unique and sorted, the nested arrays are flattened.
+ */
+
+typedef struct uniconf_listset
+{
+    char *pool;
+    size_t used;
+    size_t size;
+    uint32_t *offsets; // sorted
+    size_t count;
+    size_t capacity;
+    uint64_t hash;
+} uniconf_listset_t;
+
+static int uniconf_list_compact_mode = 0;
+static uniconf_map_t *uniconf_listsets = NULL;
+static pthread_rwlock_t uniconf_listsets_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/**
+ * Enable|disable the compact mode for the next constructs
+ *
+ * @param enabled
+ */
+void uniconf_list_compact(int enabled)
+{
+    uniconf_list_compact_mode = enabled;
+}
+
+/**
+ * Is the compact mode on
+ *
+ * @return int
+ */
+int uniconf_list_compact_enabled()
+{
+    return uniconf_list_compact_mode && !uniconf_layer_constructing();
+}
+
+/**
+ * Free the set
+ *
+ * @param data
+ */
+static void uniconf__listset_free(void *data)
+{
+    uniconf_listset_t *set = data;
+    if (set)
+    {
+        free(set->pool);
+        free(set->offsets);
+        free(set);
+    }
+}
+
+/**
+ * Drop all the sets
+ *
+ */
+void uniconf_listset_reset()
+{
+    pthread_rwlock_wrlock(&uniconf_listsets_lock);
+    uniconf_map_destroy(uniconf_listsets, uniconf__listset_free);
+    uniconf_listsets = NULL;
+    pthread_rwlock_unlock(&uniconf_listsets_lock);
+}
+
+/**
+ * Drop the sets of the subtree
+ *
+ * @param node
+ */
+static void uniconf__listset_drop(const cJSON *node)
+{
+    if (cJSON_IsArray(node))
+    {
+        uniconf__listset_free(uniconf_map_remove(uniconf_listsets, node));
+    }
+    uniconf_EachChild(child, node)
+    {
+        if (uniconf_IsComplex(child))
+        {
+            uniconf__listset_drop(child);
+        }
+    }
+}
+
+/**
+ * Drop the sets of the tree, before the tree is deleted
+ *
+ * @param tree
+ */
+void uniconf_listset_drop(const cJSON *tree)
+{
+    pthread_rwlock_wrlock(&uniconf_listsets_lock);
+    if (tree && uniconf_map_count(uniconf_listsets))
+    {
+        uniconf__listset_drop(tree);
+    }
+    pthread_rwlock_unlock(&uniconf_listsets_lock);
+}
+
+/**
+ * Get the set of the node
+ * The sets are created by the construct, so the readers don't lock each other.
+ *
+ * @param node
+ *
+ * @return const uniconf_listset_t* | NULL
+ */
+static const uniconf_listset_t *uniconf__listset(const cJSON *node)
+{
+    if (!node || !uniconf_listsets)
+    {
+        return NULL;
+    }
+    pthread_rwlock_rdlock(&uniconf_listsets_lock);
+    const uniconf_listset_t *set = uniconf_map_get(uniconf_listsets, node);
+    pthread_rwlock_unlock(&uniconf_listsets_lock);
+    return set;
+}
+
+/**
+ * Add the entry to the set
+ *
+ * @param set
+ * @param value
+ *
+ * @return int : <0 = error
+ */
+static int uniconf__listset_add(uniconf_listset_t *set, const char *value)
+{
+    size_t len = strlen(value) + 1;
+    if (set->used + len > UINT32_MAX)
+    {
+        return -EFBIG;
+    }
+    if (set->used + len > set->size)
+    {
+        size_t size = set->size ? set->size : 4096;
+        while (size < set->used + len)
+        {
+            size <<= 1;
+        }
+        char *pool = realloc(set->pool, size);
+        if (!pool)
+        {
+            return -ENOMEM;
+        }
+        set->pool = pool;
+        set->size = size;
+    }
+    if (set->count == set->capacity)
+    {
+        size_t capacity = set->capacity ? set->capacity << 1 : 1024;
+        uint32_t *offsets = realloc(set->offsets, capacity * sizeof(uint32_t));
+        if (!offsets)
+        {
+            return -ENOMEM;
+        }
+        set->offsets = offsets;
+        set->capacity = capacity;
+    }
+    memcpy(set->pool + set->used, value, len);
+    set->offsets[set->count++] = set->used;
+    set->used += len;
+    return 0;
+}
+
+/**
+ * Order the entries
+ *
+ * @param a
+ * @param b
+ * @param pool
+ *
+ * @return int
+ */
+static int uniconf__listset_compare(const void *a, const void *b, void *pool)
+{
+    return strcmp((char *)pool + *(const uint32_t *)a, (char *)pool + *(const uint32_t *)b);
+}
+
+/**
+ * Sort, drop the duplicates and hash the entries
+ *
+ * @param set
+ */
+static void uniconf__listset_finish(uniconf_listset_t *set)
+{
+    qsort_r(set->offsets, set->count, sizeof(uint32_t), uniconf__listset_compare, set->pool);
+
+    size_t count = 0;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < set->count; i++)
+    {
+        const char *entry = set->pool + set->offsets[i];
+        if (count && !strcmp(set->pool + set->offsets[count - 1], entry))
+        {
+            continue;
+        }
+        set->offsets[count++] = set->offsets[i];
+        for (const unsigned char *ptr = (const unsigned char *)entry;; ptr++)
+        {
+            h ^= *ptr;
+            h *= 0x100000001b3ULL;
+            if (!*ptr)
+            {
+                break;
+            }
+        }
+    }
+    set->count = count;
+    set->hash = h ? h : 1;
+}
+
+/**
+ * Parse the .list file to the set of the node
+ *
+ * @param node
+ * @param lines
+ *
+ * @return int : <0 = error, >=0 = count of the entries
+ */
+static int uniconf__list_compact(cJSON *node, uniconf_lines_t *lines)
+{
+    pthread_rwlock_wrlock(&uniconf_listsets_lock);
+    if (!uniconf_listsets)
+    {
+        uniconf_listsets = uniconf_map_create(0);
+    }
+    void **slot = uniconf_map_slot(uniconf_listsets, node);
+    if (slot && !*slot)
+    {
+        *slot = calloc(1, sizeof(uniconf_listset_t));
+    }
+    uniconf_listset_t *set = slot ? *slot : NULL;
+
+    int ret = set ? 0 : -ENOMEM;
+    size_t before = set ? set->count : 0;
+    uniconf_LinesByLine(lines, line)
+    {
+        char *value = strtok(line, "\r\n");
+        value = value ? uniconf_unquote(value) : NULL;
+        if (ret >= 0 && value && *value && !strchr("[]#", value[0]))
+        {
+            ret = uniconf__listset_add(set, value);
+        }
+    }
+    uniconf_EndByLine(line);
+
+    if (set)
+    {
+        uniconf__listset_finish(set);
+        ret = (ret < 0) ? ret : (int)(set->count - before);
+    }
+    pthread_rwlock_unlock(&uniconf_listsets_lock);
+    return ret;
+}
+
+/**
+ * Get the hash of the set of the node
+ *
+ * @param node
+ *
+ * @return uint64_t : 0 = no set
+ */
+uint64_t uniconf_listset_hash(const cJSON *node)
+{
+    const uniconf_listset_t *set = uniconf__listset(node);
+    return set ? set->hash : 0;
+}
+
+/**
+ * Count the entries of the set of the node
+ *
+ * @param node
+ *
+ * @return size_t
+ */
+size_t uniconf_listset_count(const cJSON *node)
+{
+    const uniconf_listset_t *set = uniconf__listset(node);
+    return set ? set->count : 0;
+}
+
+/**
+ * Get the entry of the set by the sorted index
+ *
+ * @param node
+ * @param index
+ *
+ * @return const char* | NULL
+ */
+const char *uniconf_listset_entry(const cJSON *node, size_t index)
+{
+    const uniconf_listset_t *set = uniconf__listset(node);
+    return (set && index < set->count) ? set->pool + set->offsets[index] : NULL;
+}
+
+/**
+ * Compare the entry with the first len chars of the value
+ *
+ * @param entry
+ * @param value
+ * @param len
+ * @param prefix : the entries starting with the value are equal
+ *
+ * @return int
+ */
+static int uniconf__listset_compare_n(const char *entry, const char *value, size_t len, int prefix)
+{
+    int cmp = strncmp(entry, value, len);
+    return (cmp || prefix) ? cmp : ('\0' != entry[len]);
+}
+
+/**
+ * Find the first entry compared greater than the limit
+ *
+ * @param set
+ * @param value
+ * @param len
+ * @param prefix
+ * @param limit : -1 = the first not less, 0 = the first greater
+ *
+ * @return size_t the index, count = none
+ */
+static size_t uniconf__listset_bound(const uniconf_listset_t *set, const char *value, size_t len, int prefix, int limit)
+{
+    size_t low = 0;
+    size_t high = set->count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (uniconf__listset_compare_n(set->pool + set->offsets[middle], value, len, prefix) > limit)
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+    return low;
+}
+
+/**
+ * Find the value in the list node
+ *
+ * @param node
+ * @param value
+ *
+ * @return int
+ */
+static int uniconf__list_contains(const cJSON *node, const char *value)
+{
+    if (!node || !value)
+    {
+        return 0;
+    }
+    const uniconf_listset_t *set = uniconf__listset(node);
+    if (set)
+    {
+        size_t len = strlen(value);
+        size_t at = uniconf__listset_bound(set, value, len, 0, -1);
+        if (at < set->count && !strcmp(set->pool + set->offsets[at], value))
+        {
+            return 1;
+        }
+    }
+    uniconf_ForEach(item, node)
+    {
+        if (cJSON_IsString(item) && !strcmp(item->valuestring, value))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Is the value in the list
+ * O(log n) for the compact lists, the walk for the others.
+ *
+ * @param path
+ * @param value
+ *
+ * @return int
+ */
+int uniconf_listContains(const char *path, const char *value)
+{
+    unsigned long epoch = uniconf_reader_enter();
+    int found = uniconf__list_contains(uniconf_getObject("%s", path), value);
+    uniconf_reader_leave(epoch);
+    return found;
+}
+
+/**
+ * Find the longest prefix of the value in the list node
+ *
+ * @param node
+ * @param value : "example.com/path" matches the "example.com/" entry
+ *
+ * @return const char* the entry | NULL
+ */
+static const char *uniconf__list_match(const cJSON *node, const char *value)
+{
+    if (!node || !value)
+    {
+        return NULL;
+    }
+    const char *found = NULL;
+    const uniconf_listset_t *set = uniconf__listset(node);
+    if (set)
+    {
+        // the greatest entry not greater than the value is the prefix or shares the shorter one
+        for (size_t len = strlen(value); set->count && !found;)
+        {
+            size_t at = uniconf__listset_bound(set, value, len, 0, 0);
+            if (!at)
+            {
+                break;
+            }
+            const char *entry = set->pool + set->offsets[at - 1];
+            size_t common = 0;
+            while (common < len && entry[common] == value[common])
+            {
+                common++;
+            }
+            if (!entry[common])
+            {
+                found = entry;
+            }
+            else if (!common)
+            {
+                break;
+            }
+            len = common;
+        }
+    }
+    uniconf_ForEach(item, node)
+    {
+        size_t len = cJSON_IsString(item) ? strlen(item->valuestring) : 0;
+        if (len && !strncmp(item->valuestring, value, len) && (!found || len > strlen(found)))
+        {
+            found = item->valuestring;
+        }
+    }
+    return found;
+}
+
+/**
+ * Find the longest entry that is the prefix of the value
+ * The compact lists take O(log n) per the distinct common prefix.
+ *
+ * @param path
+ * @param value : "example.com/path" matches the "example.com/" entry
+ *
+ * @return const char* the entry | NULL
+ */
+const char *uniconf_listMatch(const char *path, const char *value)
+{
+    unsigned long epoch = uniconf_reader_enter();
+    const char *found = uniconf__list_match(uniconf_getObject("%s", path), value);
+    uniconf_reader_leave(epoch);
+    return found;
+}
+
+/**
+ * Find the entries of the list node starting with the prefix
+ *
+ * @param node
+ * @param prefix
+ * @param entries : up to max entries or NULL
+ * @param max
+ *
+ * @return int the count of all found
+ */
+static int uniconf__list_prefix(const cJSON *node, const char *prefix, const char **entries, int max)
+{
+    if (!node || !prefix)
+    {
+        return 0;
+    }
+    int count = 0;
+    size_t len = strlen(prefix);
+    const uniconf_listset_t *set = uniconf__listset(node);
+    if (set)
+    {
+        size_t first = uniconf__listset_bound(set, prefix, len, 1, -1);
+        size_t last = uniconf__listset_bound(set, prefix, len, 1, 0);
+        for (size_t i = first; entries && i < last && count < max; i++, count++)
+        {
+            entries[count] = set->pool + set->offsets[i];
+        }
+        count = last - first;
+    }
+    uniconf_ForEach(item, node)
+    {
+        if (cJSON_IsString(item) && !strncmp(item->valuestring, prefix, len))
+        {
+            if (entries && count < max)
+            {
+                entries[count] = item->valuestring;
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Find the entries starting with the prefix
+ * O(log n) for the compact lists, sorted.
+ *
+ * @param path
+ * @param prefix
+ * @param entries : up to max entries or NULL
+ * @param max
+ *
+ * @return int the count of all found
+ */
+int uniconf_listPrefix(const char *path, const char *prefix, const char **entries, int max)
+{
+    unsigned long epoch = uniconf_reader_enter();
+    int count = uniconf__list_prefix(uniconf_getObject("%s", path), prefix, entries, max);
+    uniconf_reader_leave(epoch);
+    return count;
+}
+
+/**
+ * Count the entries of the list
+ *
+ * @param path
+ *
+ * @return int
+ */
+int uniconf_listSize(const char *path)
+{
+    unsigned long epoch = uniconf_reader_enter();
+    uniconf_t node = uniconf_getObject("%s", path);
+    int size = node ? (int)uniconf_listset_count(node) + uniconf_size(node) : 0;
+    uniconf_reader_leave(epoch);
+    return size;
+}
+
+/**
+ * Parse the lines of the .list file
  *
  * @param root
- * @param filepath
+ * @param lines
+ * @param source
  * @param branch
  *
  * @return int
  */
-int uniconf_list(cJSON *root, const char *filepath, const char *branch)
+static int uniconf__list(cJSON *root, uniconf_lines_t *lines, const char *source, const char *branch)
 {
     int count = 0;
-    cJSON *node = cJSON_GetObjectItemCaseSensitive(root, branch);
+    cJSON *node = uniconf_intern_child(root, branch);
     if (!node)
     {
-        node = cJSON_AddArrayToObject(root, branch);
+        node = uniconf_add(root, branch, cJSON_CreateArray());
     }
     if (!cJSON_IsArray(node))
     {
-        uniconf_error("ERROR: error type for file '%s' at branch '%s'", filepath, branch);
+        uniconf_error("ERROR: error type for file '%s' at branch '%s'", source, branch);
+    }
+    else if (uniconf_list_compact_enabled())
+    {
+        count = uniconf__list_compact(node, lines);
     }
     else
     {
-        uniconf_FileByLine(filepath, line)
+        uniconf_LinesByLine(lines, line)
         {
             char *value = uniconf_unquote(strtok(line, "\r\n"));
             if (value)
@@ -39,7 +596,7 @@ int uniconf_list(cJSON *root, const char *filepath, const char *branch)
                     cJSON *item = cJSON_CreateArray();
                     if (cJSON_AddItemToArray(node, item))
                     {
-                        node = item;
+                        node = uniconf_added(item);
                     }
                 }
                 else if (strchr("[]#", value[0]))
@@ -53,6 +610,7 @@ int uniconf_list(cJSON *root, const char *filepath, const char *branch)
                     {
                         if (cJSON_AddItemToArray(node, item))
                         {
+                            uniconf_added(item);
                             count++;
                         }
                         else
@@ -68,3 +626,36 @@ int uniconf_list(cJSON *root, const char *filepath, const char *branch)
 
     return count;
 }
+
+/**
+ * Parse the .list file
+ *
+ * @param root
+ * @param buffer
+ * @param length
+ * @param source
+ * @param branch
+ *
+ * @return int
+ */
+int uniconf_list(cJSON *root, const char *buffer, size_t length, const char *source, const char *branch)
+{
+    uniconf_lines_t lines = {.ptr = buffer, .end = buffer + length};
+    return uniconf__list(root, &lines, source, branch);
+}
+
+/**
+ * Parse the .list file while decompressing
+ *
+ * @param root
+ * @param stream
+ * @param source
+ * @param branch
+ *
+ * @return int
+ */
+int uniconf_list_stream(cJSON *root, uniconf_stream_t *stream, const char *source, const char *branch)
+{
+    uniconf_lines_t lines = {.stream = stream};
+    return uniconf__list(root, &lines, source, branch);
+}
@@ -0,0 +1,254 @@
+#include "uniconf.internal.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The side table keyed by node address
+ *
+ * Open addressing with linear probing and backward shift deletion,
+ * keeps the per-node data out of the cJSON nodes.
+ */
+
+typedef struct uniconf_map_entry
+{
+    const void *key;
+    void *value;
+} uniconf_map_entry_t;
+
+struct uniconf_map
+{
+    size_t count;
+    size_t mask;
+    uniconf_map_entry_t *entries;
+};
+
+#define MAP_MIN_SIZE 16
+
+/**
+ * Mix the address bits
+ *
+ * @param key
+ *
+ * @return size_t
+ */
+static size_t uniconf__map_hash(const void *key)
+{
+    uint64_t x = (uint64_t)(uintptr_t)key;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+/**
+ * Create the map
+ *
+ * @param hint : expected count
+ *
+ * @return uniconf_map_t*
+ */
+uniconf_map_t *uniconf_map_create(size_t hint)
+{
+    uniconf_map_t *map = calloc(1, sizeof(uniconf_map_t));
+    if (map)
+    {
+        size_t size = MAP_MIN_SIZE;
+        while (size < hint * 2)
+        {
+            size <<= 1;
+        }
+        map->mask = size - 1;
+        map->entries = calloc(size, sizeof(uniconf_map_entry_t));
+        if (!map->entries)
+        {
+            FREE_AND_NULL(map);
+        }
+    }
+    return map;
+}
+
+/**
+ * Destroy the map
+ *
+ * @param map
+ * @param release : the value destructor or NULL
+ */
+void uniconf_map_destroy(uniconf_map_t *map, void (*release)(void *))
+{
+    if (map)
+    {
+        if (release)
+        {
+            for (size_t i = 0; i <= map->mask; i++)
+            {
+                if (map->entries[i].key)
+                {
+                    release(map->entries[i].value);
+                }
+            }
+        }
+        free(map->entries);
+        free(map);
+    }
+}
+
+/**
+ * Double the table
+ *
+ * @param map
+ *
+ * @return int
+ */
+static int uniconf__map_grow(uniconf_map_t *map)
+{
+    size_t size = (map->mask + 1) << 1;
+    uniconf_map_entry_t *entries = calloc(size, sizeof(uniconf_map_entry_t));
+    if (!entries)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i <= map->mask; i++)
+    {
+        if (map->entries[i].key)
+        {
+            size_t at = uniconf__map_hash(map->entries[i].key) & (size - 1);
+            while (entries[at].key)
+            {
+                at = (at + 1) & (size - 1);
+            }
+            entries[at] = map->entries[i];
+        }
+    }
+    free(map->entries);
+    map->entries = entries;
+    map->mask = size - 1;
+    return 1;
+}
+
+/**
+ * Get the value
+ *
+ * @param map
+ * @param key
+ *
+ * @return void* | NULL
+ */
+void *uniconf_map_get(const uniconf_map_t *map, const void *key)
+{
+    if (map && key)
+    {
+        for (size_t at = uniconf__map_hash(key) & map->mask; map->entries[at].key; at = (at + 1) & map->mask)
+        {
+            if (key == map->entries[at].key)
+            {
+                return map->entries[at].value;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Get|create the value slot
+ *
+ * @param map
+ * @param key
+ *
+ * @return void** | NULL
+ */
+void **uniconf_map_slot(uniconf_map_t *map, const void *key)
+{
+    if (!map || !key)
+    {
+        return NULL;
+    }
+    if ((map->count + 1) * 4 > (map->mask + 1) * 3 && !uniconf__map_grow(map))
+    {
+        return NULL;
+    }
+
+    size_t at = uniconf__map_hash(key) & map->mask;
+    for (; map->entries[at].key; at = (at + 1) & map->mask)
+    {
+        if (key == map->entries[at].key)
+        {
+            return &map->entries[at].value;
+        }
+    }
+    map->entries[at].key = key;
+    map->entries[at].value = NULL;
+    map->count++;
+    return &map->entries[at].value;
+}
+
+/**
+ * Remove the key
+ *
+ * @param map
+ * @param key
+ *
+ * @return void* the removed value | NULL
+ */
+void *uniconf_map_remove(uniconf_map_t *map, const void *key)
+{
+    if (!map || !key)
+    {
+        return NULL;
+    }
+
+    size_t at = uniconf__map_hash(key) & map->mask;
+    for (; map->entries[at].key && key != map->entries[at].key; at = (at + 1) & map->mask)
+        ;
+    if (!map->entries[at].key)
+    {
+        return NULL;
+    }
+
+    void *value = map->entries[at].value;
+    // shift back the following cluster
+    size_t hole = at;
+    for (size_t next = (hole + 1) & map->mask; map->entries[next].key; next = (next + 1) & map->mask)
+    {
+        size_t home = uniconf__map_hash(map->entries[next].key) & map->mask;
+        if (((next - home) & map->mask) >= ((next - hole) & map->mask))
+        {
+            map->entries[hole] = map->entries[next];
+            hole = next;
+        }
+    }
+    map->entries[hole].key = NULL;
+    map->entries[hole].value = NULL;
+    map->count--;
+    return value;
+}
+
+/**
+ * Count the entries
+ *
+ * @param map
+ *
+ * @return size_t
+ */
+size_t uniconf_map_count(const uniconf_map_t *map)
+{
+    return map ? map->count : 0;
+}
+
+/**
+ * Visit the entries, in no order
+ *
+ * @param map
+ * @param visit : of the key, the value and the data
+ * @param data
+ */
+void uniconf_map_each(const uniconf_map_t *map, void (*visit)(const void *key, void *value, void *data), void *data)
+{
+    for (size_t i = 0; map && i <= map->mask; i++)
+    {
+        if (map->entries[i].key)
+        {
+            visit(map->entries[i].key, map->entries[i].value, data);
+        }
+    }
+}
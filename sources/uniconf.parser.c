@@ -0,0 +1,233 @@
+#include "uniconf.internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * The parsers by the extension
+ *
+ * The parser gets the read-only buffer, the length and the source name for the messages,
+ * the buffer is followed by '\0'. The files are mapped when the page tail gives the '\0',
+ * read to the memory otherwise, so the file must be replaced (renamed), not truncated while parsed.
+ * The parsers are registered before the constructs, the lookup is one hash probe.
+ * The built-in .yml, .env and .list parsers read the compressed files while decompressing.
+ */
+
+#define PARSERS_SIZE 64 // power of 2
+#define PARSER_EXT_MAX 16
+
+typedef struct uniconf_parser_entry
+{
+    uint64_t hash;
+    char extension[PARSER_EXT_MAX];
+    uniconf_parser_f parser;
+} uniconf_parser_entry_t;
+
+static uniconf_parser_entry_t uniconf_parsers[PARSERS_SIZE];
+static pthread_once_t uniconf_parsers_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Hash the extension (FNV-1a)
+ *
+ * @param extension
+ *
+ * @return uint64_t
+ */
+static uint64_t uniconf__parser_hash(const char *extension)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (const unsigned char *ptr = (const unsigned char *)extension; *ptr; ptr++)
+    {
+        h ^= *ptr;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/**
+ * Get the slot of the extension
+ *
+ * @param extension
+ * @param hash
+ *
+ * @return uniconf_parser_entry_t* : the entry or the free slot, NULL = full
+ */
+static uniconf_parser_entry_t *uniconf__parser_slot(const char *extension, uint64_t hash)
+{
+    for (size_t i = 0, at = hash & (PARSERS_SIZE - 1); i < PARSERS_SIZE; i++, at = (at + 1) & (PARSERS_SIZE - 1))
+    {
+        uniconf_parser_entry_t *entry = &uniconf_parsers[at];
+        if (!entry->extension[0] || (entry->hash == hash && !strcmp(entry->extension, extension)))
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Set the parser of the slot
+ *
+ * @param extension
+ * @param parser
+ *
+ * @return int : <0 = error
+ */
+static int uniconf__parser_set(const char *extension, uniconf_parser_f parser)
+{
+    if (!extension || !*extension)
+    {
+        return -EINVAL;
+    }
+    if (strlen(extension) >= PARSER_EXT_MAX)
+    {
+        return -ENAMETOOLONG;
+    }
+    uint64_t hash = uniconf__parser_hash(extension);
+    uniconf_parser_entry_t *entry = uniconf__parser_slot(extension, hash);
+    if (!entry)
+    {
+        return -ENOSPC;
+    }
+    if (!entry->extension[0])
+    {
+        entry->hash = hash;
+        strcpy(entry->extension, extension);
+    }
+    // the removed ones keep the slot, so the probes don't break
+    entry->parser = parser;
+    return 0;
+}
+
+/**
+ * Register the built-in parsers
+ *
+ */
+static void uniconf__parser_init()
+{
+    uniconf__parser_set("env", uniconf_env);
+    uniconf__parser_set("ini", uniconf_ini);
+    uniconf__parser_set("list", uniconf_list);
+    uniconf__parser_set("conf", uniconf_conf);
+    uniconf__parser_set("json", uniconf_json);
+    uniconf__parser_set("yml", uniconf_yml);
+    uniconf__parser_set("yaml", uniconf_yml);
+}
+
+/**
+ * Register|replace the parser of the extension
+ *
+ * @param extension : without the dot
+ * @param parser : NULL = ignore the extension
+ *
+ * @return int : <0 = error
+ */
+int uniconf_parser_register(const char *extension, uniconf_parser_f parser)
+{
+    pthread_once(&uniconf_parsers_once, uniconf__parser_init);
+    return uniconf__parser_set(extension, parser);
+}
+
+/**
+ * Get the parser of the extension
+ *
+ * @param extension : without the dot
+ *
+ * @return uniconf_parser_f | NULL
+ */
+uniconf_parser_f uniconf_parser_find(const char *extension)
+{
+    pthread_once(&uniconf_parsers_once, uniconf__parser_init);
+    if (!extension || !*extension)
+    {
+        return NULL;
+    }
+    uniconf_parser_entry_t *entry = uniconf__parser_slot(extension, uniconf__parser_hash(extension));
+    return entry ? entry->parser : NULL;
+}
+
+/**
+ * Get the parser of the extension reading the decompressed stream
+ * Only the built-in ones not replaced, the others get the whole buffer.
+ *
+ * @param extension : without the dot
+ *
+ * @return uniconf_stream_parser_f | NULL
+ */
+uniconf_stream_parser_f uniconf_parser_stream(const char *extension)
+{
+    uniconf_parser_f parser = uniconf_parser_find(extension);
+    return (uniconf_yml == parser)    ? uniconf_yml_stream
+           : (uniconf_env == parser)  ? uniconf_env_stream
+           : (uniconf_list == parser) ? uniconf_list_stream
+                                      : NULL;
+}
+
+/**
+ * Get the contents of the file
+ *
+ * @param filepath
+ * @param length : out
+ * @param mapped : out, 1 = mmap, 0 = malloc
+ *
+ * @return char* : '\0' terminated | NULL
+ */
+char *uniconf_read(const char *filepath, size_t *length, int *mapped)
+{
+    int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    char *buffer = NULL;
+    struct stat info;
+    if (!fstat(fd, &info))
+    {
+        *length = info.st_size;
+        *mapped = info.st_size && (info.st_size % sysconf(_SC_PAGESIZE));
+        if (*mapped)
+        {
+            // the rest of the last page is zeroed
+            buffer = mmap(NULL, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+            buffer = (MAP_FAILED == buffer) ? NULL : buffer;
+        }
+        else if ((buffer = malloc(*length + 1)))
+        {
+            size_t done = 0;
+            ssize_t ret = 0;
+            while (done < *length && (ret = read(fd, buffer + done, *length - done)) > 0)
+            {
+                done += ret;
+            }
+            *length = done;
+            buffer[done] = '\0';
+        }
+    }
+    close(fd);
+    return buffer;
+}
+
+/**
+ * Release the contents of the file
+ *
+ * @param buffer
+ * @param length
+ * @param mapped
+ */
+void uniconf_read_free(char *buffer, size_t length, int mapped)
+{
+    if (buffer && mapped)
+    {
+        munmap(buffer, length);
+    }
+    else
+    {
+        free(buffer);
+    }
+}
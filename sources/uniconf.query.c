@@ -0,0 +1,785 @@
+#include "uniconf.internal.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The JSONPath-like query language
+ *
+ * $.upstreams.*.port
+ * routes[?(enabled)].path
+ * servers[0:10:2].host
+ * items[-1]
+ * map['dotted.key']
+ * routes[?(@.weight >= 3)]
+ *
+ * The expression is compiled once into the program of steps,
+ * every execution walks the tree with the preallocated cursor.
+ */
+
+typedef enum
+{
+    UNICONF_STEP_KEY,
+    UNICONF_STEP_ANY,
+    UNICONF_STEP_INDEX,
+    UNICONF_STEP_SLICE,
+    UNICONF_STEP_FILTER,
+} uniconf_step_e;
+
+typedef enum
+{
+    UNICONF_CMP_TRUTH,
+    UNICONF_CMP_EQ,
+    UNICONF_CMP_NE,
+    UNICONF_CMP_LT,
+    UNICONF_CMP_LE,
+    UNICONF_CMP_GT,
+    UNICONF_CMP_GE,
+} uniconf_cmp_e;
+
+typedef enum
+{
+    UNICONF_LIT_STRING,
+    UNICONF_LIT_NUMBER,
+    UNICONF_LIT_TRUE,
+    UNICONF_LIT_FALSE,
+    UNICONF_LIT_NULL,
+} uniconf_lit_e;
+
+typedef struct uniconf_filter
+{
+    char *buffer;  // the split relative path
+    char **tokens; // pointers into the buffer
+    int count;
+    int negate;
+    uniconf_cmp_e cmp;
+    uniconf_lit_e type;
+    char *text;
+    double number;
+} uniconf_filter_t;
+
+typedef struct uniconf_step
+{
+    uniconf_step_e op;
+    char *name;
+    long start;
+    long end;
+    long step;
+    int has_start;
+    int has_end;
+    uniconf_filter_t filter;
+} uniconf_step_t;
+
+struct uniconf_query
+{
+    char *source;
+    int count;
+    uniconf_step_t *steps;
+};
+
+typedef struct uniconf_frame
+{
+    cJSON *parent;
+    cJSON *item;
+    long index;
+    long stop;
+    int state;
+} uniconf_frame_t;
+
+struct uniconf_cursor
+{
+    const uniconf_query_t *query;
+    cJSON *root;
+    int level;
+    int done;
+    uniconf_frame_t frames[];
+};
+
+#define QUERY_DELIM PATH_DELIM
+
+static int uniconf__compile(uniconf_query_t *query, const char *text);
+static int uniconf__bracket(uniconf_step_t *step, char *text);
+static int uniconf__filter(uniconf_filter_t *filter, char *text);
+static int uniconf__match(const uniconf_filter_t *filter, cJSON *item);
+static cJSON *uniconf__step(const uniconf_step_t *step, uniconf_frame_t *frame);
+
+/**
+ * Compile the query expression into the reusable program
+ *
+ * @param format
+ * @param ...
+ *
+ * @return uniconf_query_t* | NULL on syntax error
+ */
+uniconf_query_t *uniconf_query_compile(const char *format, ...)
+{
+    uniconf_query_t *query = NULL;
+    if (format)
+    {
+        char *text = NULL;
+        va_list ap;
+        va_start(ap, format);
+        vasprintf(&text, format, ap);
+        va_end(ap);
+
+        if (text && (query = calloc(1, sizeof(uniconf_query_t))))
+        {
+            query->source = text;
+            text = NULL;
+            if (uniconf__compile(query, query->source) < 0)
+            {
+                uniconf_query_free(query);
+                query = NULL;
+            }
+        }
+        FREE_AND_NULL(text);
+    }
+    return query;
+}
+
+/**
+ * Free the compiled query
+ *
+ * @param query
+ */
+void uniconf_query_free(uniconf_query_t *query)
+{
+    if (query)
+    {
+        for (int i = 0; i < query->count; i++)
+        {
+            FREE_AND_NULL(query->steps[i].name);
+            FREE_AND_NULL(query->steps[i].filter.buffer);
+            FREE_AND_NULL(query->steps[i].filter.tokens);
+            FREE_AND_NULL(query->steps[i].filter.text);
+        }
+        FREE_AND_NULL(query->steps);
+        FREE_AND_NULL(query->source);
+        free(query);
+    }
+}
+
+/**
+ * Start the query over the tree
+ * The only allocation per execution is the cursor itself.
+ *
+ * @param query
+ * @param root : NULL = the config root
+ *
+ * @return uniconf_cursor_t*
+ */
+uniconf_cursor_t *uniconf_query_exec(const uniconf_query_t *query, uniconf_t root)
+{
+    uniconf_cursor_t *cursor = NULL;
+    if (query)
+    {
+        cursor = malloc(sizeof(uniconf_cursor_t) + (query->count + 1) * sizeof(uniconf_frame_t));
+        if (cursor)
+        {
+            cursor->query = query;
+            cursor->root = root ? (cJSON *)root : uniconf_root_mutable(); // the lazy branches are loaded
+            uniconf_cursor_rewind(cursor);
+        }
+    }
+    return cursor;
+}
+
+/**
+ * Restart the cursor from the first match
+ *
+ * @param cursor
+ */
+void uniconf_cursor_rewind(uniconf_cursor_t *cursor)
+{
+    if (cursor)
+    {
+        cursor->level = 0;
+        cursor->done = (NULL == cursor->root);
+        cursor->frames[0] = (uniconf_frame_t){.parent = cursor->root};
+    }
+}
+
+/**
+ * Get the next match
+ *
+ * @param cursor
+ *
+ * @return uniconf_t | NULL when exhausted
+ */
+uniconf_t uniconf_cursor_next(uniconf_cursor_t *cursor)
+{
+    if (!cursor || cursor->done)
+    {
+        return NULL;
+    }
+
+    const uniconf_query_t *query = cursor->query;
+    if (!query->count)
+    {
+        cursor->done = 1;
+        return cursor->root;
+    }
+
+    while (cursor->level >= 0)
+    {
+        uniconf_frame_t *frame = &cursor->frames[cursor->level];
+        cJSON *item = uniconf__step(&query->steps[cursor->level], frame);
+        if (!item)
+        {
+            cursor->level--;
+        }
+        else if (cursor->level == query->count - 1)
+        {
+            return uniconf_lazy_load(item);
+        }
+        else
+        {
+            cursor->level++;
+            cursor->frames[cursor->level] = (uniconf_frame_t){.parent = item};
+        }
+    }
+    cursor->done = 1;
+    return NULL;
+}
+
+/**
+ * Close the cursor
+ *
+ * @param cursor
+ */
+void uniconf_cursor_close(uniconf_cursor_t *cursor)
+{
+    free(cursor);
+}
+
+/**
+ * Advance one step of the program inside its parent
+ *
+ * @param step
+ * @param frame
+ *
+ * @return cJSON* | NULL when the step is exhausted
+ */
+static cJSON *uniconf__step(const uniconf_step_t *step, uniconf_frame_t *frame)
+{
+    cJSON *parent = frame->parent;
+    switch (step->op)
+    {
+    case UNICONF_STEP_KEY:
+        if (!frame->state++)
+        {
+            return uniconf_lookup(parent, step->name);
+        }
+        break;
+    case UNICONF_STEP_INDEX:
+        if (!frame->state++ && cJSON_IsArray(parent))
+        {
+            return uniconf_item(parent, step->start);
+        }
+        break;
+    case UNICONF_STEP_ANY:
+    case UNICONF_STEP_FILTER:
+        if (uniconf_IsComplex(parent))
+        {
+            frame->item = frame->state++ ? (frame->item ? frame->item->next : NULL)
+                                         : (cJSON *)uniconf_children(parent);
+            while (frame->item && (UNICONF_STEP_FILTER == step->op) && !uniconf__match(&step->filter, frame->item))
+            {
+                frame->item = frame->item->next;
+            }
+            return frame->item;
+        }
+        break;
+    case UNICONF_STEP_SLICE:
+        if (cJSON_IsArray(parent))
+        {
+            if (!frame->state++)
+            {
+                // python-like bounds
+                long size = uniconf_size(parent);
+                long lower = (step->step > 0) ? 0 : -1;
+                long upper = (step->step > 0) ? size : size - 1;
+                long start = step->has_start ? step->start : (step->step > 0 ? lower : upper);
+                long stop = step->has_end ? step->end : (step->step > 0 ? upper : lower);
+                start = (start < 0) ? start + size : start;
+                stop = (stop < 0 && step->has_end) ? stop + size : stop;
+                start = (start < lower) ? lower : (start > upper) ? upper : start;
+                stop = (stop < lower) ? lower : (stop > upper) ? upper : stop;
+
+                frame->index = start;
+                frame->stop = stop;
+                frame->item = ((step->step > 0) ? (start < stop) : (start > stop))
+                                  ? uniconf_item(parent, start)
+                                  : NULL;
+            }
+            else if (frame->item)
+            {
+                frame->index += step->step;
+                if ((step->step > 0) ? (frame->index < frame->stop) : (frame->index > frame->stop))
+                {
+                    for (long i = 0; frame->item && i < labs(step->step); i++)
+                    {
+                        // the first item's prev is the last one, never wrap around
+                        frame->item = (step->step > 0) ? frame->item->next
+                                                       : ((frame->item == parent->child) ? NULL : frame->item->prev);
+                    }
+                }
+                else
+                {
+                    frame->item = NULL;
+                }
+            }
+            return frame->item;
+        }
+        break;
+    }
+    return NULL;
+}
+
+/**
+ * Is the node "set"
+ *
+ * @param item
+ *
+ * @return int
+ */
+static int uniconf__truth(cJSON *item)
+{
+    if (!item || cJSON_IsNull(item) || cJSON_IsFalse(item))
+    {
+        return 0;
+    }
+    if (cJSON_IsString(item) || cJSON_IsNumber(item))
+    {
+        return 0 != uniconf_boolean(item);
+    }
+    return 1;
+}
+
+/**
+ * Check the filter against the candidate
+ *
+ * @param filter
+ * @param item
+ *
+ * @return int
+ */
+static int uniconf__match(const uniconf_filter_t *filter, cJSON *item)
+{
+    for (int i = 0; item && i < filter->count; i++)
+    {
+        item = uniconf_lookup(item, filter->tokens[i]);
+    }
+
+    if (UNICONF_CMP_TRUTH == filter->cmp)
+    {
+        return filter->negate ? !uniconf__truth(item) : uniconf__truth(item);
+    }
+    if (!item)
+    {
+        return 0;
+    }
+
+    int diff = 0;
+    switch (filter->type)
+    {
+    case UNICONF_LIT_NUMBER:
+    {
+        double value = 0;
+        if (cJSON_IsNumber(item))
+        {
+            value = item->valuedouble;
+        }
+        else if (cJSON_IsString(item) && *item->valuestring)
+        {
+            char *end = NULL;
+            value = uniconf_strtod(item->valuestring, &end);
+            if (*end)
+            {
+                return UNICONF_CMP_NE == filter->cmp;
+            }
+        }
+        else
+        {
+            return UNICONF_CMP_NE == filter->cmp;
+        }
+        diff = (value > filter->number) - (value < filter->number);
+    }
+    break;
+    case UNICONF_LIT_STRING:
+        if (!cJSON_IsString(item))
+        {
+            return UNICONF_CMP_NE == filter->cmp;
+        }
+        diff = strcmp(item->valuestring, filter->text);
+        break;
+    case UNICONF_LIT_TRUE:
+    case UNICONF_LIT_FALSE:
+        diff = (uniconf__truth(item) != (UNICONF_LIT_TRUE == filter->type));
+        break;
+    case UNICONF_LIT_NULL:
+        diff = !cJSON_IsNull(item);
+        break;
+    }
+
+    switch (filter->cmp)
+    {
+    case UNICONF_CMP_EQ:
+        return 0 == diff;
+    case UNICONF_CMP_NE:
+        return 0 != diff;
+    case UNICONF_CMP_LT:
+        return diff < 0;
+    case UNICONF_CMP_LE:
+        return diff <= 0;
+    case UNICONF_CMP_GT:
+        return diff > 0;
+    case UNICONF_CMP_GE:
+        return diff >= 0;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Find the closing bracket, skipping quotes and parentheses
+ *
+ * @param ptr : on '['
+ *
+ * @return char* on ']' | NULL
+ */
+static char *uniconf__closing(char *ptr)
+{
+    int depth = 0;
+    char quoted = '\0';
+    for (ptr++; *ptr; ptr++)
+    {
+        if (quoted)
+        {
+            if ('\\' == *ptr && ptr[1])
+            {
+                ptr++;
+            }
+            else if (quoted == *ptr)
+            {
+                quoted = '\0';
+            }
+        }
+        else if (strchr("'\"`", *ptr))
+        {
+            quoted = *ptr;
+        }
+        else if ('(' == *ptr)
+        {
+            depth++;
+        }
+        else if (')' == *ptr)
+        {
+            depth--;
+        }
+        else if (']' == *ptr && !depth)
+        {
+            return ptr;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Append the empty step
+ *
+ * @param query
+ *
+ * @return uniconf_step_t*
+ */
+static uniconf_step_t *uniconf__append(uniconf_query_t *query)
+{
+    uniconf_step_t *steps = realloc(query->steps, (query->count + 1) * sizeof(uniconf_step_t));
+    if (!steps)
+    {
+        return NULL;
+    }
+    query->steps = steps;
+    uniconf_step_t *step = &steps[query->count++];
+    memset(step, 0, sizeof(uniconf_step_t));
+    step->step = 1;
+    return step;
+}
+
+/**
+ * Compile the expression into steps
+ *
+ * @param query
+ * @param text
+ *
+ * @return int : <0 = error, >=0 = steps
+ */
+static int uniconf__compile(uniconf_query_t *query, const char *text)
+{
+    char *buffer = strdup(text);
+    if (!buffer)
+    {
+        return -ENOMEM;
+    }
+
+    int ret = 0;
+    char *ptr = buffer;
+    if ('$' == *ptr)
+    {
+        ptr++;
+    }
+    while (ret >= 0 && *ptr)
+    {
+        if (strchr(QUERY_DELIM, *ptr))
+        {
+            ptr++;
+            continue;
+        }
+
+        uniconf_step_t *step = uniconf__append(query);
+        if (!step)
+        {
+            ret = -ENOMEM;
+        }
+        else if ('[' == *ptr)
+        {
+            char *close = uniconf__closing(ptr);
+            if (close)
+            {
+                *close = '\0';
+                ret = uniconf__bracket(step, ptr + 1);
+                ptr = close + 1;
+            }
+            else
+            {
+                ret = -EINVAL;
+            }
+        }
+        else
+        {
+            size_t len = strcspn(ptr, QUERY_DELIM "[");
+            if (1 == len && '*' == *ptr)
+            {
+                step->op = UNICONF_STEP_ANY;
+            }
+            else
+            {
+                step->op = UNICONF_STEP_KEY;
+                step->name = strndup(ptr, len);
+                ret = step->name ? ret : -ENOMEM;
+            }
+            ptr += len;
+        }
+    }
+
+    if (ret < 0)
+    {
+        uniconf_error("ERROR: query '%s' syntax error at %d", text, (int)(ptr - buffer));
+    }
+    free(buffer);
+    return ret < 0 ? ret : query->count;
+}
+
+/**
+ * Trim spaces in place
+ *
+ * @param str
+ *
+ * @return char*
+ */
+static char *uniconf__trim(char *str)
+{
+    while (isspace(*str))
+    {
+        str++;
+    }
+    char *end = strchr(str, '\0');
+    while (end > str && isspace(end[-1]))
+    {
+        *--end = '\0';
+    }
+    return str;
+}
+
+/**
+ * Read the integer
+ *
+ * @param text
+ * @param value
+ *
+ * @return int : 1 = found, 0 = empty, <0 = error
+ */
+static int uniconf__integer(char *text, long *value)
+{
+    text = uniconf__trim(text);
+    if (!*text)
+    {
+        return 0;
+    }
+    char *end = NULL;
+    *value = strtol(text, &end, 10);
+    return *end ? -EINVAL : 1;
+}
+
+/**
+ * Compile the [...] step
+ *
+ * @param step
+ * @param text : the content between brackets
+ *
+ * @return int
+ */
+static int uniconf__bracket(uniconf_step_t *step, char *text)
+{
+    text = uniconf__trim(text);
+    if (STR_EQUAL("*", text))
+    {
+        step->op = UNICONF_STEP_ANY;
+    }
+    else if ('?' == text[0])
+    {
+        step->op = UNICONF_STEP_FILTER;
+        return uniconf__filter(&step->filter, text + 1);
+    }
+    else if (*text && strchr("'\"`", text[0]))
+    {
+        step->op = UNICONF_STEP_KEY;
+        step->name = strdup(uniconf_unquote(text));
+    }
+    else if (strchr(text, ':'))
+    {
+        char *second = strchr(text, ':');
+        *second++ = '\0';
+        char *third = strchr(second, ':');
+        if (third)
+        {
+            *third++ = '\0';
+        }
+        step->op = UNICONF_STEP_SLICE;
+        step->has_start = uniconf__integer(text, &step->start);
+        step->has_end = uniconf__integer(second, &step->end);
+        if (third && (uniconf__integer(third, &step->step) < 0 || !step->step))
+        {
+            return -EINVAL;
+        }
+        return (step->has_start < 0 || step->has_end < 0) ? -EINVAL : 1;
+    }
+    else if (1 == uniconf__integer(text, &step->start))
+    {
+        step->op = UNICONF_STEP_INDEX;
+    }
+    else if (*text)
+    {
+        step->op = UNICONF_STEP_KEY;
+        step->name = strdup(text);
+    }
+    else
+    {
+        return -EINVAL;
+    }
+    return (UNICONF_STEP_KEY != step->op || step->name) ? 1 : -ENOMEM;
+}
+
+/**
+ * Compile the ?(...) filter
+ *
+ * @param filter
+ * @param text
+ *
+ * @return int
+ */
+static int uniconf__filter(uniconf_filter_t *filter, char *text)
+{
+    text = uniconf__trim(text);
+    size_t len = strlen(text);
+    if (len < 2 || '(' != text[0] || ')' != text[len - 1])
+    {
+        return -EINVAL;
+    }
+    text[len - 1] = '\0';
+    text = uniconf__trim(text + 1);
+
+    if ('!' == text[0] && '=' != text[1])
+    {
+        filter->negate = 1;
+        text = uniconf__trim(text + 1);
+    }
+
+    // split "path op literal"
+    char *op = strpbrk(text, "=!<>");
+    if (op)
+    {
+        static const struct
+        {
+            const char *text;
+            uniconf_cmp_e cmp;
+        } ops[] = {{"==", UNICONF_CMP_EQ}, {"!=", UNICONF_CMP_NE}, {"<=", UNICONF_CMP_LE}, {">=", UNICONF_CMP_GE}, {"<", UNICONF_CMP_LT}, {">", UNICONF_CMP_GT}, {"=", UNICONF_CMP_EQ}};
+        for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+        {
+            if (op == strstr(op, ops[i].text))
+            {
+                filter->cmp = ops[i].cmp;
+                *op = '\0';
+                op += strlen(ops[i].text);
+                break;
+            }
+        }
+        if (UNICONF_CMP_TRUTH == filter->cmp || filter->negate)
+        {
+            return -EINVAL;
+        }
+
+        char *literal = uniconf__trim(op);
+        char *end = NULL;
+        filter->number = uniconf_strtod(literal, &end);
+        if (*literal && !*end)
+        {
+            filter->type = UNICONF_LIT_NUMBER;
+        }
+        else if (STR_EQUAL("true", literal))
+        {
+            filter->type = UNICONF_LIT_TRUE;
+        }
+        else if (STR_EQUAL("false", literal))
+        {
+            filter->type = UNICONF_LIT_FALSE;
+        }
+        else if (STR_EQUAL("null", literal))
+        {
+            filter->type = UNICONF_LIT_NULL;
+        }
+        else
+        {
+            filter->type = UNICONF_LIT_STRING;
+            if (!(filter->text = strdup(uniconf_unquote(literal))))
+            {
+                return -ENOMEM;
+            }
+        }
+    }
+
+    // the relative path, '@' is the candidate itself
+    text = uniconf__trim(text);
+    if ('@' == text[0])
+    {
+        text++;
+    }
+    if (!(filter->buffer = strdup(text)))
+    {
+        return -ENOMEM;
+    }
+    for (char *sptr, *token = strtok_r(filter->buffer, QUERY_DELIM, &sptr); token; token = strtok_r(NULL, QUERY_DELIM, &sptr))
+    {
+        char **tokens = realloc(filter->tokens, (filter->count + 1) * sizeof(char *));
+        if (!tokens)
+        {
+            return -ENOMEM;
+        }
+        filter->tokens = tokens;
+        filter->tokens[filter->count++] = token;
+    }
+    return (filter->count || UNICONF_CMP_TRUTH != filter->cmp) ? 1 : -EINVAL;
+}
@@ -0,0 +1,685 @@
+#include "uniconf.internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * The shared snapshots for the multi-process workers
+ *
+ * The publisher writes the image of the constructed tree to the new POSIX shm segment
+ * "<name>.<generation>" and then bumps the generation in the control segment "<name>".
+ * The workers map the control read-only and check the generation on each getter call:
+ * when it changes, the new segment is mapped, no locks between the processes.
+ *
+ * The previous mapping is kept until the next one, so the strings and objects
+ * got from the getters stay valid for one more publication. Then it is unmapped
+ * only when the getters that could read it have left, the remap is in the getter and doesn't wait.
+ * The getters load the current mapping with no lock, the lock is taken only to map the new generation
+ * and to build the objects. The getters return the scalars with no allocations, the objects are built
+ * on demand with the strings left in the segment, once per generation.
+ *
+ * The same image stored to the file is the compiled snapshot, attached the same way.
+ * The image embedded to the binary as the const data is mounted with no mapping at all,
+ * as the whole view or as the base under the constructed tree and the layers.
+ */
+
+#define UNICONF_CONTROL_MAGIC 0x4c434355 // "UCCL"
+
+typedef struct uniconf_control
+{
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t generation;
+} uniconf_control_t;
+
+typedef struct uniconf_mapping
+{
+    void *base;
+    size_t size;
+    uint64_t generation;
+    uniconf_map_t *objects;        // built of the image nodes
+    int embedded;                  // the const data of the binary, not unmapped
+    struct uniconf_mapping *next;  // of the deferred ones
+    unsigned long epoch;           // of the getters that may read the deferred one
+    int advanced;                  // the epoch is finished
+} uniconf_mapping_t;
+
+static char *uniconf_shm_name = NULL;
+static uniconf_control_t *uniconf_shm_control = NULL;
+static uniconf_mapping_t *uniconf_shm_current = NULL;
+static uniconf_mapping_t *uniconf_shm_retired = NULL;
+static uniconf_mapping_t *uniconf_shm_deferred = NULL;
+static uniconf_mapping_t uniconf_shm_embedded = {0};
+static uniconf_mapping_t uniconf_shm_base_image = {0};
+static uniconf_mapping_t *uniconf_shm_base = NULL; // the mounted base
+static pthread_mutex_t uniconf_shm_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Make the segment name
+ *
+ * @param name
+ * @param generation : 0 = the control segment
+ *
+ * @return char* must be freed
+ */
+static char *uniconf__shm_segment(const char *name, uint64_t generation)
+{
+    char *segment = NULL;
+    const char *slash = ('/' == name[0]) ? "" : "/";
+    if (generation)
+    {
+        asprintf(&segment, "%s%s.%llu", slash, name, (unsigned long long)generation);
+    }
+    else
+    {
+        asprintf(&segment, "%s%s", slash, name);
+    }
+    return segment;
+}
+
+/**
+ * Unlink the segment
+ *
+ * @param name
+ * @param generation
+ */
+static void uniconf__shm_unlink(const char *name, uint64_t generation)
+{
+    char *segment = uniconf__shm_segment(name, generation);
+    if (segment)
+    {
+        shm_unlink(segment);
+        free(segment);
+    }
+}
+
+/**
+ * Publish the constructed tree
+ *
+ * @param name : the shm name
+ *
+ * @return int : <0 = error, >0 = the generation
+ */
+int uniconf_publish(const char *name)
+{
+    uniconf_t root = uniconf_get_root();
+    size_t size = uniconf_image_size(root);
+    if (!name || !*name || !size)
+    {
+        return -EINVAL;
+    }
+
+    char *segment = uniconf__shm_segment(name, 0);
+    int fd = segment ? shm_open(segment, O_CREAT | O_RDWR, 0644) : -1;
+    FREE_AND_NULL(segment);
+    if (fd < 0)
+    {
+        return -errno;
+    }
+    uniconf_control_t *control = MAP_FAILED;
+    if (0 == ftruncate(fd, sizeof(uniconf_control_t)))
+    {
+        control = mmap(NULL, sizeof(uniconf_control_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    int ret = (MAP_FAILED == control) ? -errno : 0;
+    close(fd);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    control->magic = UNICONF_CONTROL_MAGIC;
+
+    uint64_t generation = __atomic_load_n(&control->generation, __ATOMIC_ACQUIRE) + 1;
+    segment = uniconf__shm_segment(name, generation);
+    fd = segment ? shm_open(segment, O_CREAT | O_TRUNC | O_RDWR, 0644) : -1;
+    if (fd < 0)
+    {
+        ret = -errno;
+    }
+    else
+    {
+        void *base = MAP_FAILED;
+        if (0 == ftruncate(fd, size))
+        {
+            base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        ret = (MAP_FAILED == base) ? -errno : uniconf_image_write(root, base, size);
+        if (MAP_FAILED != base)
+        {
+            ((uniconf_image_t *)base)->generation = generation;
+            munmap(base, size);
+        }
+        close(fd);
+    }
+
+    if (ret >= 0)
+    {
+        // visible to the workers
+        __atomic_store_n(&control->generation, generation, __ATOMIC_RELEASE);
+        if (generation > 2)
+        {
+            uniconf__shm_unlink(name, generation - 2); // the mapped ones live until unmapped
+        }
+        ret = (int)generation;
+    }
+    else if (segment)
+    {
+        shm_unlink(segment);
+    }
+    FREE_AND_NULL(segment);
+    munmap(control, sizeof(uniconf_control_t));
+    return ret;
+}
+
+/**
+ * Remove the published segments
+ *
+ * @param name
+ *
+ * @return int : <0 = error
+ */
+int uniconf_unpublish(const char *name)
+{
+    if (!name || !*name)
+    {
+        return -EINVAL;
+    }
+    char *segment = uniconf__shm_segment(name, 0);
+    int fd = segment ? shm_open(segment, O_RDONLY, 0) : -1;
+    if (fd < 0)
+    {
+        FREE_AND_NULL(segment);
+        return -errno;
+    }
+    uniconf_control_t *control = mmap(NULL, sizeof(uniconf_control_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED != control)
+    {
+        uint64_t generation = __atomic_load_n(&control->generation, __ATOMIC_ACQUIRE);
+        for (uint64_t i = 0; i < 2 && i < generation; i++)
+        {
+            uniconf__shm_unlink(name, generation - i);
+        }
+        munmap(control, sizeof(uniconf_control_t));
+    }
+    shm_unlink(segment);
+    free(segment);
+    return 0;
+}
+
+/**
+ * Free the mapping and the objects built of it
+ *
+ * @param mapping
+ */
+static void uniconf__shm_release(uniconf_mapping_t *mapping)
+{
+    if (mapping)
+    {
+        uniconf_map_destroy(mapping->objects, (void (*)(void *))cJSON_Delete);
+        mapping->objects = NULL;
+        if (!mapping->embedded)
+        {
+            munmap(mapping->base, mapping->size);
+            free(mapping);
+        }
+    }
+}
+
+/**
+ * Defer the release of the retired mapping until the getters that could read it have left
+ * Under the mutex, in the getter: doesn't wait, the released ones are collected on the next remap.
+ *
+ * @param mapping : or NULL = only collect
+ */
+static void uniconf__shm_defer(uniconf_mapping_t *mapping)
+{
+    if (mapping)
+    {
+        mapping->advanced = uniconf_readers_advance(&mapping->epoch);
+        mapping->next = uniconf_shm_deferred;
+        uniconf_shm_deferred = mapping;
+    }
+    for (uniconf_mapping_t **link = &uniconf_shm_deferred; *link;)
+    {
+        uniconf_mapping_t *deferred = *link;
+        if (!deferred->advanced)
+        {
+            deferred->advanced = uniconf_readers_advance(&deferred->epoch);
+        }
+        if (deferred->advanced && uniconf_readers_gone(deferred->epoch))
+        {
+            *link = deferred->next;
+            uniconf__shm_release(deferred);
+        }
+        else
+        {
+            link = &deferred->next;
+        }
+    }
+}
+
+/**
+ * Map the published generation if it is new
+ * Under the mutex.
+ *
+ * @return int : <0 = error, 0 = not changed, 1 = remapped
+ */
+static int uniconf__shm_remap()
+{
+    for (int tries = 0; tries < 3; tries++)
+    {
+        uint64_t generation = __atomic_load_n(&uniconf_shm_control->generation, __ATOMIC_ACQUIRE);
+        if (uniconf_shm_current && uniconf_shm_current->generation == generation)
+        {
+            return 0;
+        }
+        if (!generation)
+        {
+            return -ENOENT;
+        }
+
+        char *segment = uniconf__shm_segment(uniconf_shm_name, generation);
+        int fd = segment ? shm_open(segment, O_RDONLY, 0) : -1;
+        FREE_AND_NULL(segment);
+        if (fd < 0)
+        {
+            continue; // replaced by the next one meanwhile
+        }
+        struct stat st;
+        void *base = (0 == fstat(fd, &st)) ? mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (MAP_FAILED == base)
+        {
+            return -errno;
+        }
+
+        const uniconf_image_t *image = uniconf_image_check(base, st.st_size);
+        uniconf_mapping_t *mapping = (image && generation == image->generation) ? calloc(1, sizeof(uniconf_mapping_t)) : NULL;
+        if (!mapping)
+        {
+            munmap(base, st.st_size);
+            return image ? -ENOMEM : -EINVAL;
+        }
+        *mapping = (uniconf_mapping_t){.base = base, .size = st.st_size, .generation = generation};
+
+        uniconf__shm_defer(uniconf_shm_retired);
+        uniconf_shm_retired = uniconf_shm_current;
+        __atomic_store_n(&uniconf_shm_current, mapping, __ATOMIC_RELEASE);
+        return 1;
+    }
+    return -EAGAIN;
+}
+
+/**
+ * Attach to the published snapshot, the getters read it
+ *
+ * @param name : the shm name
+ *
+ * @return int : <0 = error, >0 = the generation
+ */
+int uniconf_attach(const char *name)
+{
+    if (!name || !*name)
+    {
+        return -EINVAL;
+    }
+    uniconf_detach();
+
+    char *segment = uniconf__shm_segment(name, 0);
+    int fd = segment ? shm_open(segment, O_RDONLY, 0) : -1;
+    FREE_AND_NULL(segment);
+    if (fd < 0)
+    {
+        return -errno;
+    }
+    uniconf_control_t *control = mmap(NULL, sizeof(uniconf_control_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == control)
+    {
+        return -errno;
+    }
+    if (UNICONF_CONTROL_MAGIC != control->magic)
+    {
+        munmap(control, sizeof(uniconf_control_t));
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&uniconf_shm_mutex);
+    uniconf_shm_name = strdup(name);
+    __atomic_store_n(&uniconf_shm_control, control, __ATOMIC_RELEASE);
+    int ret = uniconf__shm_remap();
+    ret = (ret < 0) ? ret : (int)uniconf_shm_current->generation;
+    pthread_mutex_unlock(&uniconf_shm_mutex);
+
+    if (ret < 0)
+    {
+        uniconf_detach();
+    }
+    return ret;
+}
+
+/**
+ * Detach from the snapshot or the compiled file, the getters read the constructed tree again
+ * The mappings are released after the getters reading them.
+ *
+ */
+void uniconf_detach()
+{
+    pthread_mutex_lock(&uniconf_shm_mutex);
+    uniconf_control_t *control = __atomic_exchange_n(&uniconf_shm_control, NULL, __ATOMIC_ACQ_REL);
+    uniconf_mapping_t *current = __atomic_exchange_n(&uniconf_shm_current, NULL, __ATOMIC_ACQ_REL);
+    uniconf_mapping_t *retired = uniconf_shm_retired;
+    uniconf_mapping_t *deferred = uniconf_shm_deferred;
+    uniconf_shm_retired = NULL;
+    uniconf_shm_deferred = NULL;
+    FREE_AND_NULL(uniconf_shm_name);
+    pthread_mutex_unlock(&uniconf_shm_mutex);
+
+    // not under the mutex, the getters take it
+    uniconf_readers_drain();
+    if (control)
+    {
+        munmap(control, sizeof(uniconf_control_t));
+    }
+    uniconf__shm_release(current);
+    uniconf__shm_release(retired);
+    while (deferred)
+    {
+        uniconf_mapping_t *next = deferred->next;
+        uniconf__shm_release(deferred);
+        deferred = next;
+    }
+}
+
+/**
+ * Get the image of the constructed tree
+ *
+ * @param size : out
+ *
+ * @return void* : must be freed | NULL
+ */
+void *uniconf_compile_image(size_t *size)
+{
+    uniconf_t root = uniconf_get_root();
+    *size = uniconf_image_size(root);
+    void *base = *size ? calloc(1, *size) : NULL;
+    if (base && uniconf_image_write(root, base, *size) < 0)
+    {
+        FREE_AND_NULL(base);
+    }
+    return base;
+}
+
+/**
+ * Write the constructed tree to the compiled snapshot file
+ * The file is replaced at once.
+ *
+ * @param filepath
+ *
+ * @return int : <0 = error, >=0 = count of nodes
+ */
+int uniconf_compile(const char *filepath)
+{
+    size_t size = 0;
+    void *base = filepath ? uniconf_compile_image(&size) : NULL;
+    if (!base)
+    {
+        return (filepath && size) ? -ENOMEM : -EINVAL;
+    }
+
+    char *temp = NULL;
+    int ret = (int)((const uniconf_image_t *)base)->count;
+    if (asprintf(&temp, "%s.tmp", filepath) < 0)
+    {
+        ret = -ENOMEM;
+        temp = NULL;
+    }
+    if (ret >= 0)
+    {
+        FILE *file = fopen(temp, "wb");
+        if (!file || 1 != fwrite(base, size, 1, file))
+        {
+            ret = -errno;
+        }
+        if (file && fclose(file) && ret >= 0)
+        {
+            ret = -errno;
+        }
+        if (ret >= 0 && rename(temp, filepath))
+        {
+            ret = -errno;
+        }
+        if (ret < 0)
+        {
+            unlink(temp);
+        }
+    }
+    free(temp);
+    free(base);
+    return ret;
+}
+
+/**
+ * Attach to the compiled snapshot file, the getters read it
+ *
+ * @param filepath
+ *
+ * @return int : <0 = error, >=0 = count of nodes
+ */
+int uniconf_attach_file(const char *filepath)
+{
+    if (!filepath)
+    {
+        return -EINVAL;
+    }
+    uniconf_detach();
+
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0)
+    {
+        return -errno;
+    }
+    struct stat st;
+    void *base = (0 == fstat(fd, &st) && st.st_size) ? mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    int ret = (MAP_FAILED == base) ? -(errno ? errno : EINVAL) : 0;
+    close(fd);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    const uniconf_image_t *image = uniconf_image_check(base, st.st_size);
+    uniconf_mapping_t *mapping = image ? calloc(1, sizeof(uniconf_mapping_t)) : NULL;
+    if (!mapping)
+    {
+        munmap(base, st.st_size);
+        return image ? -ENOMEM : -EINVAL;
+    }
+    *mapping = (uniconf_mapping_t){.base = base, .size = st.st_size};
+
+    pthread_mutex_lock(&uniconf_shm_mutex);
+    __atomic_store_n(&uniconf_shm_current, mapping, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&uniconf_shm_mutex);
+    return (int)image->count;
+}
+
+/**
+ * Mount the embedded image, the getters read it
+ * Nothing is mapped or copied, the image must live while mounted.
+ *
+ * @param image : 8 bytes aligned, e.g. of `uniconf embed`
+ * @param size
+ *
+ * @return int : <0 = error, >=0 = count of nodes
+ */
+int uniconf_mount(const void *image, size_t size)
+{
+    if (!image || ((uintptr_t)image & 7))
+    {
+        return -EINVAL;
+    }
+    const uniconf_image_t *checked = uniconf_image_check(image, size);
+    if (!checked)
+    {
+        return -EINVAL;
+    }
+    uniconf_detach();
+
+    pthread_mutex_lock(&uniconf_shm_mutex);
+    uniconf_shm_embedded = (uniconf_mapping_t){.base = (void *)image, .size = size, .embedded = 1};
+    __atomic_store_n(&uniconf_shm_current, &uniconf_shm_embedded, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&uniconf_shm_mutex);
+    return (int)checked->count;
+}
+
+/**
+ * Mount the embedded image as the base: the paths not found in the layers and the constructed tree
+ * are got from it. Nothing is mapped or copied, the image must live while mounted.
+ *
+ * @param image : 8 bytes aligned, e.g. of `uniconf embed`, NULL = unmount
+ * @param size
+ *
+ * @return int : <0 = error, >=0 = count of nodes
+ */
+int uniconf_mount_base(const void *image, size_t size)
+{
+    const uniconf_image_t *checked = (image && !((uintptr_t)image & 7)) ? uniconf_image_check(image, size) : NULL;
+    if (image && !checked)
+    {
+        return -EINVAL;
+    }
+
+    // the objects of the replaced one are released after the getters reading them
+    uniconf_mapping_t *replaced = __atomic_exchange_n(&uniconf_shm_base, NULL, __ATOMIC_ACQ_REL);
+    uniconf_readers_drain();
+    pthread_mutex_lock(&uniconf_shm_mutex);
+    uniconf__shm_release(replaced);
+    if (checked)
+    {
+        uniconf_shm_base_image = (uniconf_mapping_t){.base = (void *)image, .size = size, .embedded = 1};
+        __atomic_store_n(&uniconf_shm_base, &uniconf_shm_base_image, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&uniconf_shm_mutex);
+    return checked ? (int)checked->count : 0;
+}
+
+/**
+ * Get the current mapping, the published generation is mapped under the lock when it has changed
+ *
+ * @return uniconf_mapping_t* | NULL = not attached
+ */
+static uniconf_mapping_t *uniconf__shm_mapping()
+{
+    uniconf_mapping_t *mapping = __atomic_load_n(&uniconf_shm_current, __ATOMIC_ACQUIRE);
+    uniconf_control_t *control = __atomic_load_n(&uniconf_shm_control, __ATOMIC_ACQUIRE);
+    if (control && (!mapping || mapping->generation != __atomic_load_n(&control->generation, __ATOMIC_ACQUIRE)))
+    {
+        pthread_mutex_lock(&uniconf_shm_mutex);
+        if (uniconf_shm_control)
+        {
+            uniconf__shm_remap();
+        }
+        mapping = uniconf_shm_current;
+        pthread_mutex_unlock(&uniconf_shm_mutex);
+    }
+    return mapping;
+}
+
+/**
+ * Get the generation of the attached snapshot
+ *
+ * @return uint64_t : 0 = not attached
+ */
+uint64_t uniconf_generation()
+{
+    unsigned long epoch = uniconf_reader_enter();
+    uniconf_mapping_t *mapping = uniconf__shm_mapping();
+    uint64_t generation = mapping ? mapping->generation : 0;
+    uniconf_reader_leave(epoch);
+    return generation;
+}
+
+/**
+ * Is the snapshot or the compiled file attached
+ *
+ * @return int
+ */
+int uniconf_shm_attached()
+{
+    return NULL != __atomic_load_n(&uniconf_shm_current, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Get the node of the image
+ * In the getter, the mapping is released after it.
+ *
+ * @param mapping
+ * @param path
+ * @param view : for the scalars or NULL
+ *
+ * @return cJSON* the view | the object built once per mapping | NULL
+ */
+static cJSON *uniconf__shm_object(uniconf_mapping_t *mapping, const char *path, cJSON *view)
+{
+    if (!mapping)
+    {
+        return NULL;
+    }
+    const uniconf_image_t *image = mapping->base;
+    const uniconf_flat_t *flat = uniconf_image_walk(image, path);
+    cJSON *object = uniconf_image_view(image, flat, view);
+    if (flat && !object)
+    {
+        pthread_mutex_lock(&uniconf_shm_mutex);
+        if (!mapping->objects)
+        {
+            mapping->objects = uniconf_map_create(0);
+        }
+        void **slot = mapping->objects ? uniconf_map_slot(mapping->objects, flat) : NULL;
+        if (slot)
+        {
+            if (!*slot)
+            {
+                *slot = uniconf_image_tree(image, flat);
+            }
+            object = *slot;
+        }
+        pthread_mutex_unlock(&uniconf_shm_mutex);
+    }
+    return object;
+}
+
+/**
+ * Get the node of the snapshot
+ * In the getter.
+ *
+ * @param path
+ * @param view : for the scalars or NULL
+ *
+ * @return cJSON* the view | the object built once per generation | NULL
+ */
+cJSON *uniconf_shm_object(const char *path, cJSON *view)
+{
+    return uniconf__shm_object(uniconf__shm_mapping(), path, view);
+}
+
+/**
+ * Get the node of the mounted base
+ * In the getter.
+ *
+ * @param path
+ * @param view : for the scalars or NULL
+ *
+ * @return cJSON* the view | the object built once per mount | NULL = not found|not mounted
+ */
+cJSON *uniconf_shm_base_object(const char *path, cJSON *view)
+{
+    return uniconf__shm_object(__atomic_load_n(&uniconf_shm_base, __ATOMIC_ACQUIRE), path, view);
+}
@@ -0,0 +1,220 @@
+#include "uniconf.internal.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The in-memory sources
+ *
+ * The sources are the virtual directory: the names are the relative paths with '/',
+ * each level is processed in the alphabetical order as the directory, the subdirectory
+ * names give the branches and the extensions (or the formats) choose the parsers.
+ * Nothing is read from the filesystem, nothing is loaded lazily.
+ */
+
+typedef struct uniconf_source_entry
+{
+    char *name; // of the file or the subdirectory at the level
+    int dir;
+    size_t index;
+} uniconf_source_entry_t;
+
+/**
+ * Order the entries as alphasort, the subdirectories after the same named files
+ *
+ * @param a
+ * @param b
+ *
+ * @return int
+ */
+static int uniconf__source_compare(const void *a, const void *b)
+{
+    const uniconf_source_entry_t *x = a;
+    const uniconf_source_entry_t *y = b;
+    int ret = strcoll(x->name, y->name);
+    if (!ret)
+    {
+        ret = (x->dir > y->dir) - (x->dir < y->dir);
+    }
+    return ret ? ret : (x->index > y->index) - (x->index < y->index);
+}
+
+/**
+ * Parse the source by the parser of the format
+ *
+ * @param root
+ * @param source
+ * @param filename : the name at the level
+ *
+ * @return <0 = error, >=0 = count
+ */
+static int uniconf__source_file(cJSON *root, const uniconf_source_t *source, const char *filename)
+{
+    int ret = 0;
+    char *name = strdup(filename);
+    if (!name)
+    {
+        return -ENOMEM;
+    }
+    const char *format = source->format;
+    const char *compression = NULL;
+    size_t len = strlen(name);
+    if (!format)
+    {
+        char *ext = strrchr(name, '.');
+        if (ext && uniconf_compressed(ext + 1))
+        {
+            ext[0] = '\0';
+            compression = ext + 1;
+            ext = strrchr(name, '.');
+        }
+        if (ext)
+        {
+            ext[0] = '\0';
+            format = ext + 1;
+        }
+    }
+    else if (len > strlen(format) && '.' == name[len - strlen(format) - 1] && !strcmp(name + len - strlen(format), format))
+    {
+        name[len - strlen(format) - 1] = '\0';
+    }
+
+    uniconf_parser_f parser = format ? uniconf_parser_find(format) : NULL;
+    if (parser && compression)
+    {
+        ret = uniconf_parse_compressed(root, format, compression, source->buffer, source->length, *source->name ? source->name : format, name);
+    }
+    if (parser && (!compression || -EOPNOTSUPP == ret))
+    {
+        // the parsers get the '\0' after the buffer
+        ret = 0;
+        size_t length = source->length;
+        size_t limit = uniconf_budget_file_limit();
+        char *buffer = compression ? uniconf_inflate(compression, source->buffer, source->length, &length, limit) : malloc(length + 1);
+        if (!buffer && compression && EFBIG == errno)
+        {
+            ret = uniconf_budget_file(source->name, limit + 1); // stopped at the limit
+        }
+        else if (!buffer && compression)
+        {
+            uniconf_error("Failed to decompress source '%s': %s", source->name, strerror(errno));
+        }
+        else if (!buffer)
+        {
+            free(name);
+            return -ENOMEM;
+        }
+        else if (!compression)
+        {
+            if (length)
+            {
+                memcpy(buffer, source->buffer, length);
+            }
+            buffer[length] = '\0';
+        }
+        if (buffer)
+        {
+            ret = uniconf_parse(root, parser, format, buffer, length, *source->name ? source->name : format, name);
+            free(buffer);
+        }
+    }
+    free(name);
+    return ret;
+}
+
+/**
+ * Process the sources under the prefix, as the directory
+ *
+ * @param node
+ * @param sources
+ * @param count
+ * @param prefix : "" or "dir/"
+ *
+ * @return <0 = error, >=0 = count
+ */
+static int uniconf__source_scan(cJSON *node, const uniconf_source_t *sources, size_t count, const char *prefix)
+{
+    uniconf_source_entry_t *entries = calloc(count ? count : 1, sizeof(uniconf_source_entry_t));
+    if (!entries)
+    {
+        return -ENOMEM;
+    }
+    int ret = 0;
+    size_t n = 0;
+    size_t prefix_len = strlen(prefix);
+    for (size_t i = 0; i < count && ret >= 0; i++)
+    {
+        if (!strncmp(sources[i].name, prefix, prefix_len))
+        {
+            const char *rest = sources[i].name + prefix_len;
+            const char *slash = strchr(rest, '/');
+            entries[n] = (uniconf_source_entry_t){.name = strndup(rest, slash ? (size_t)(slash - rest) : strlen(rest)), .dir = !!slash, .index = i};
+            ret = entries[n++].name ? 0 : -ENOMEM;
+        }
+    }
+    qsort(entries, n, sizeof(uniconf_source_entry_t), uniconf__source_compare);
+
+    int total = 0;
+    for (size_t k = 0; k < n && ret >= 0; k++)
+    {
+        uniconf_source_entry_t *entry = &entries[k];
+        ret = 0;
+        if (!entry->dir)
+        {
+            ret = uniconf__source_file(node, &sources[entry->index], entry->name);
+        }
+        else if ((!k || !entries[k - 1].dir || strcmp(entries[k - 1].name, entry->name)) &&
+                 *entry->name && strcmp(".", entry->name) && strcmp("..", entry->name))
+        {
+            // the whole subdirectory at once
+            cJSON *branch = node;
+            char *name = strdup(entry->name);
+            char *ext = name ? strchr(name, '.') : NULL;
+            if (ext)
+            {
+                ext[0] = '\0';
+            }
+            char *path = NULL;
+            asprintf(&path, "%s%s/", prefix, entry->name);
+            if (name && *name)
+            {
+                uint64_t whence = uniconf_whence_enter(path);
+                branch = uniconf_node(node, name);
+                uniconf_whence_leave(whence);
+            }
+            ret = (name && path) ? uniconf__source_scan(branch, sources, count, path) : -ENOMEM;
+            free(path);
+            free(name);
+        }
+        total += ret > 0 ? ret : 0;
+    }
+
+    for (size_t k = 0; k < n; k++)
+    {
+        free(entries[k].name);
+    }
+    free(entries);
+    return ret < 0 ? ret : total;
+}
+
+/**
+ * Process the in-memory sources into the root
+ *
+ * @param root
+ * @param sources
+ * @param count
+ *
+ * @return <0 = error, >=0 = count
+ */
+int uniconf_sources(cJSON *root, const uniconf_source_t *sources, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!sources[i].name || (!sources[i].buffer && sources[i].length))
+        {
+            return -EINVAL;
+        }
+    }
+    return uniconf__source_scan(root, sources, count, "");
+}
@@ -0,0 +1,187 @@
+#include "uniconf.internal.h"
+
+#include <string.h>
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#if __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define UNICONF_AVX2 // the target attribute works with the intrinsics
+#include <immintrin.h>
+#endif
+#endif
+
+/**
+ * The structural index of the large .json files
+ *
+ * The first stage finds the quotes delimiting the strings, 64 bytes per step:
+ * the quote and the backslash masks are taken by AVX2, SSE2 or bytewise,
+ * the quotes escaped by the odd backslash runs are dropped (as simdjson).
+ * The tokenizer then gets each string end from the index instead of scanning the bytes.
+ */
+
+#define BLOCK_SIZE 64
+#define EVEN_BITS 0x5555555555555555ULL
+#define ODD_BITS (~EVEN_BITS)
+
+typedef void (*uniconf_masks_f)(const char *block, uint64_t *quotes, uint64_t *backslashes);
+
+#if !defined(__x86_64__)
+/**
+ * Get the masks bytewise
+ *
+ * @param block
+ * @param quotes
+ * @param backslashes
+ */
+static void uniconf__masks_scalar(const char *block, uint64_t *quotes, uint64_t *backslashes)
+{
+    uint64_t q = 0;
+    uint64_t b = 0;
+    for (int i = 0; i < BLOCK_SIZE; i++)
+    {
+        q |= (uint64_t)('"' == block[i]) << i;
+        b |= (uint64_t)('\\' == block[i]) << i;
+    }
+    *quotes = q;
+    *backslashes = b;
+}
+#else
+/**
+ * Get the masks by SSE2
+ *
+ * @param block
+ * @param quotes
+ * @param backslashes
+ */
+static void uniconf__masks_sse2(const char *block, uint64_t *quotes, uint64_t *backslashes)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    uint64_t q = 0;
+    uint64_t b = 0;
+    for (int i = 0; i < BLOCK_SIZE; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(block + i));
+        q |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote)) << i;
+        b |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, backslash)) << i;
+    }
+    *quotes = q;
+    *backslashes = b;
+}
+#endif
+
+#ifdef UNICONF_AVX2
+/**
+ * Get the masks by AVX2
+ *
+ * @param block
+ * @param quotes
+ * @param backslashes
+ */
+__attribute__((target("avx2"))) static void uniconf__masks_avx2(const char *block, uint64_t *quotes, uint64_t *backslashes)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    __m256i low = _mm256_loadu_si256((const __m256i *)block);
+    __m256i high = _mm256_loadu_si256((const __m256i *)(block + 32));
+    *quotes = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, quote)) |
+              (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, quote)) << 32;
+    *backslashes = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, backslash)) |
+                   (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, backslash)) << 32;
+}
+#endif
+
+/**
+ * Choose the masks of the CPU
+ *
+ * @return uniconf_masks_f
+ */
+static uniconf_masks_f uniconf__masks()
+{
+#ifdef UNICONF_AVX2
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return uniconf__masks_avx2;
+    }
+#endif
+#if defined(__x86_64__)
+    return uniconf__masks_sse2;
+#else
+    return uniconf__masks_scalar;
+#endif
+}
+
+/**
+ * Get the chars escaped by the odd backslash runs
+ *
+ * @param backslashes
+ * @param carry : the run of the previous block ends odd, in|out
+ *
+ * @return uint64_t
+ */
+static uint64_t uniconf__escaped(uint64_t backslashes, uint64_t *carry)
+{
+    uint64_t starts = backslashes & ~(backslashes << 1);
+    uint64_t even_start_mask = EVEN_BITS ^ *carry;
+    uint64_t even_starts = starts & even_start_mask;
+    uint64_t odd_starts = starts & ~even_start_mask;
+    uint64_t even_carries = backslashes + even_starts;
+    uint64_t odd_carries = backslashes + odd_starts;
+    uint64_t overflow = odd_carries < backslashes;
+    odd_carries |= *carry;
+    *carry = overflow;
+    uint64_t even_carry_ends = even_carries & ~backslashes;
+    uint64_t odd_carry_ends = odd_carries & ~backslashes;
+    return (even_carry_ends & ODD_BITS) | (odd_carry_ends & EVEN_BITS);
+}
+
+/**
+ * Index the quotes delimiting the strings
+ *
+ * @param buffer
+ * @param length : < 4G
+ * @param count : out
+ *
+ * @return uint32_t* : the offsets, must be freed | NULL = no memory
+ */
+uint32_t *uniconf_json_quotes(const char *buffer, size_t length, size_t *count)
+{
+    uniconf_masks_f masks = uniconf__masks();
+    size_t size = length / 16 + 16;
+    uint32_t *offsets = malloc(size * sizeof(uint32_t));
+    *count = 0;
+    uint64_t carry = 0;
+    for (size_t at = 0; offsets && at < length; at += BLOCK_SIZE)
+    {
+        uint64_t quotes = 0;
+        uint64_t backslashes = 0;
+        if (length - at >= BLOCK_SIZE)
+        {
+            masks(buffer + at, &quotes, &backslashes);
+        }
+        else
+        {
+            char tail[BLOCK_SIZE] = {0};
+            memcpy(tail, buffer + at, length - at);
+            masks(tail, &quotes, &backslashes);
+        }
+        quotes &= ~uniconf__escaped(backslashes, &carry);
+
+        if (*count + BLOCK_SIZE > size)
+        {
+            size = size * 2 + BLOCK_SIZE;
+            uint32_t *grown = realloc(offsets, size * sizeof(uint32_t));
+            if (!grown)
+            {
+                FREE_AND_NULL(offsets);
+                break;
+            }
+            offsets = grown;
+        }
+        while (quotes)
+        {
+            offsets[(*count)++] = at + __builtin_ctzll(quotes);
+            quotes &= quotes - 1;
+        }
+    }
+    return offsets;
+}
@@ -0,0 +1,203 @@
+#include "uniconf.internal.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The subtree change subscriptions
+ *
+ * After each construct the subscribed subtrees of the previous and the new tree
+ * are compared by the structural hashes, the callback fires only when its subtree has changed.
+ * After each layer change the same is done for the paths got through the layers.
+ * The callbacks run under the construct lock, the construct from them fails with -EDEADLK.
+ * The subscriptions are changed under the same lock, so the dispatch on the construct thread
+ * doesn't see them moved; the callback holds it already and changes them in place.
+ */
+
+typedef struct uniconf_subscription
+{
+    int id;
+    char *path;
+    uniconf_callback_f callback;
+    void *data;
+} uniconf_subscription_t;
+
+static uniconf_subscription_t *uniconf_subscriptions = NULL;
+static int uniconf_subscriptions_count = 0;
+static int uniconf_subscriptions_last = 0;
+static int uniconf_dispatching = 0;
+
+/**
+ * Subscribe on the subtree changes
+ *
+ * @param callback
+ * @param data : passed to the callback
+ * @param format : the subtree path, "" = the whole tree
+ * @param ...
+ *
+ * @return int : >0 = subscription id, <0 = error
+ */
+int uniconf_subscribe(uniconf_callback_f callback, void *data, const char *format, ...)
+{
+    if (!callback || !format)
+    {
+        return -EINVAL;
+    }
+
+    char *path = NULL;
+    va_list ap;
+    va_start(ap, format);
+    vasprintf(&path, format, ap);
+    va_end(ap);
+    if (!path)
+    {
+        return -ENOMEM;
+    }
+
+    int locked = uniconf_build_enter();
+    if (locked < 0)
+    {
+        free(path);
+        return locked;
+    }
+    int id = -ENOMEM;
+    uniconf_subscription_t *subscriptions = realloc(uniconf_subscriptions, (uniconf_subscriptions_count + 1) * sizeof(uniconf_subscription_t));
+    if (subscriptions)
+    {
+        uniconf_subscriptions = subscriptions;
+        id = ++uniconf_subscriptions_last;
+        uniconf_subscriptions[uniconf_subscriptions_count++] = (uniconf_subscription_t){
+            .id = id,
+            .path = path,
+            .callback = callback,
+            .data = data,
+        };
+    }
+    else
+    {
+        free(path);
+    }
+    uniconf_build_leave(locked);
+    return id;
+}
+
+/**
+ * Drop the cancelled subscriptions
+ *
+ */
+static void uniconf__compact()
+{
+    int count = 0;
+    for (int i = 0; i < uniconf_subscriptions_count; i++)
+    {
+        if (uniconf_subscriptions[i].callback)
+        {
+            uniconf_subscriptions[count++] = uniconf_subscriptions[i];
+        }
+        else
+        {
+            FREE_AND_NULL(uniconf_subscriptions[i].path);
+        }
+    }
+    uniconf_subscriptions_count = count;
+    if (!count)
+    {
+        FREE_AND_NULL(uniconf_subscriptions);
+    }
+}
+
+/**
+ * Cancel the subscription
+ * Safe to call from the callback.
+ *
+ * @param id
+ *
+ * @return int : 1 = cancelled, 0 = not found, <0 = error
+ */
+int uniconf_unsubscribe(int id)
+{
+    int locked = uniconf_build_enter();
+    if (locked < 0)
+    {
+        return locked;
+    }
+    int found = 0;
+    for (int i = 0; !found && i < uniconf_subscriptions_count; i++)
+    {
+        if (id == uniconf_subscriptions[i].id && uniconf_subscriptions[i].callback)
+        {
+            uniconf_subscriptions[i].callback = NULL;
+            if (!uniconf_dispatching)
+            {
+                uniconf__compact();
+            }
+            found = 1;
+        }
+    }
+    uniconf_build_leave(locked);
+    return found;
+}
+
+/**
+ * Walk the tree as the view
+ *
+ * @param view : the root
+ * @param path
+ *
+ * @return cJSON*
+ */
+static cJSON *uniconf__walk(const void *view, const char *path)
+{
+    return uniconf_walk((cJSON *)view, path);
+}
+
+/**
+ * Fire the callbacks of the changed subtrees
+ * Called under the construct lock, when the new tree is already published and the previous one is still alive.
+ *
+ * @param previous : the previous root
+ * @param current : the new root
+ *
+ * @return int : the count of fired callbacks
+ */
+int uniconf_notify(cJSON *previous, cJSON *current)
+{
+    return uniconf_notify_view(uniconf__walk, previous, current);
+}
+
+/**
+ * Fire the callbacks of the changed subtrees of the views
+ * Called under the construct lock, when the new view is already published and the previous one is still alive.
+ *
+ * @param walk : gets the node of the view by the path
+ * @param previous : the previous view
+ * @param current : the new view
+ *
+ * @return int : the count of fired callbacks
+ */
+int uniconf_notify_view(cJSON *(*walk)(const void *view, const char *path), const void *previous, const void *current)
+{
+    int count = 0;
+    uniconf_dispatching++;
+    // the callbacks added while dispatching wait for the next construct
+    for (int i = 0, n = uniconf_subscriptions_count; i < n; i++)
+    {
+        if (uniconf_subscriptions[i].callback)
+        {
+            cJSON *before = walk(previous, uniconf_subscriptions[i].path);
+            cJSON *after = walk(current, uniconf_subscriptions[i].path);
+            if (!uniconf_equal(before, after))
+            {
+                uniconf_subscriptions[i].callback(uniconf_subscriptions[i].path, before, after, uniconf_subscriptions[i].data);
+                count++;
+            }
+        }
+    }
+    if (!--uniconf_dispatching)
+    {
+        uniconf__compact();
+    }
+    return count;
+}
@@ -0,0 +1,90 @@
+#include "uniconf.internal.h"
+
+#include <time.h>
+
+/**
+ * The tracing
+ *
+ * The probe points are the USDT probes of the provider "uniconf" when built with sys/sdt.h,
+ * and the events of the user callback. Both get the same arguments:
+ * the path, the parser, the size, the result and the duration in nanoseconds.
+ *
+ * The USDT probes have the semaphores, so the probe points are not timed
+ * unless the tracer is attached to them or the callback is set.
+ */
+
+#ifdef UNICONF_SDT
+// set by the tracers attached to the probes
+#define UNICONF_SEMAPHORE_DEFINE(name) unsigned short UNICONF_SEMAPHORE(name) __attribute__((unused, section(".probes")))
+
+UNICONF_SEMAPHORE_DEFINE(file__start);
+UNICONF_SEMAPHORE_DEFINE(file__done);
+UNICONF_SEMAPHORE_DEFINE(scan);
+UNICONF_SEMAPHORE_DEFINE(substitute);
+UNICONF_SEMAPHORE_DEFINE(miss);
+UNICONF_SEMAPHORE_DEFINE(lookup);
+#endif
+
+static uniconf_trace_f uniconf_tracer = NULL;
+static void *uniconf_tracer_data = NULL;
+
+/**
+ * Set the callback of the probe points
+ *
+ * @param callback : NULL = off
+ * @param data
+ */
+void uniconf_trace(uniconf_trace_f callback, void *data)
+{
+    uniconf_tracer_data = data;
+    uniconf_tracer = callback;
+}
+
+/**
+ * Is the callback set
+ *
+ * @return int
+ */
+int uniconf_tracing()
+{
+    return NULL != uniconf_tracer;
+}
+
+/**
+ * Get the monotonic time
+ *
+ * @return uint64_t : nanoseconds
+ */
+uint64_t uniconf_trace_clock()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * Call the callback, if set
+ *
+ * @param event
+ * @param path
+ * @param parser
+ * @param size
+ * @param result
+ * @param nanoseconds
+ */
+void uniconf_trace_emit(uniconf_trace_event_t event, const char *path, const char *parser, size_t size, int result, uint64_t nanoseconds)
+{
+    uniconf_trace_f callback = uniconf_tracer;
+    if (callback)
+    {
+        uniconf_trace_t trace = {
+            .event = event,
+            .path = path,
+            .parser = parser,
+            .size = size,
+            .result = result,
+            .nanoseconds = nanoseconds,
+        };
+        callback(&trace, uniconf_tracer_data);
+    }
+}
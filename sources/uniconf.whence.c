@@ -0,0 +1,319 @@
+#include "uniconf.internal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The provenance of the nodes
+ *
+ * In the provenance mode each constructed tree and each layer gets the side table
+ * of its nodes origins: the file id and the line packed into the slot value.
+ * The parsers set the current line as they go, the nodes are marked when added,
+ * so there is no extra pass. The file names are kept once in the list of the ids.
+ * The line 0 is the whole file|directory, e.g. of the branch node.
+ *
+ * The layer isn't stored: it is the one the path is found in, as the layers are reordered by the removals.
+ * The lazy branches loaded after the construct and the rolled back versions have no provenance.
+ * The tables and the names are read under the reader lock, the table of the tree is filled
+ * by the constructing thread only, before the tree is published.
+ */
+
+typedef struct uniconf_whence_table
+{
+    const cJSON *tree;
+    uniconf_map_t *map;
+} uniconf_whence_table_t;
+
+typedef struct uniconf_whence_file
+{
+    uint64_t hash;
+    char *name;
+} uniconf_whence_file_t;
+
+#define WHENCE_POSITION(file, line) (((uint64_t)(file) << 32) | (uint32_t)(line))
+#define WHENCE_FILE(position) ((uint32_t)((position) >> 32)) // the id + 1, 0 = none
+#define WHENCE_LINE(position) ((int)(uint32_t)(position))
+
+static int uniconf_whence_mode = 0;
+static uniconf_whence_table_t *uniconf_whence_tables = NULL;
+static int uniconf_whence_tables_count = 0;
+static uniconf_whence_file_t *uniconf_whence_files = NULL;
+static uint32_t uniconf_whence_files_count = 0;
+static pthread_rwlock_t uniconf_whence_lock = PTHREAD_RWLOCK_INITIALIZER;
+// while constructing
+static __thread uniconf_map_t *uniconf_whence_current = NULL;
+static __thread uint64_t uniconf_whence_position = 0;
+
+/**
+ * Enable|disable the provenance for the next constructs and layers
+ *
+ * @param enabled
+ */
+void uniconf_provenance(int enabled)
+{
+    uniconf_whence_mode = enabled;
+}
+
+/**
+ * Find the table of the tree
+ *
+ * @param tree
+ *
+ * @return int : the index, <0 = not found
+ */
+static int uniconf__whence_table(const cJSON *tree)
+{
+    for (int i = 0; tree && i < uniconf_whence_tables_count; i++)
+    {
+        if (uniconf_whence_tables[i].tree == tree)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Start the table of the tree being constructed, if enabled
+ *
+ * @param tree
+ */
+void uniconf_whence_begin(const cJSON *tree)
+{
+    uniconf_whence_current = NULL;
+    uniconf_whence_position = 0;
+    if (!uniconf_whence_mode || !tree)
+    {
+        return;
+    }
+    pthread_rwlock_wrlock(&uniconf_whence_lock);
+    uniconf_whence_table_t *tables = realloc(uniconf_whence_tables, (uniconf_whence_tables_count + 1) * sizeof(uniconf_whence_table_t));
+    uniconf_map_t *map = tables ? uniconf_map_create(0) : NULL;
+    if (tables)
+    {
+        uniconf_whence_tables = tables;
+    }
+    if (map)
+    {
+        uniconf_whence_tables[uniconf_whence_tables_count++] = (uniconf_whence_table_t){.tree = tree, .map = map};
+        uniconf_whence_current = map;
+    }
+    pthread_rwlock_unlock(&uniconf_whence_lock);
+}
+
+/**
+ * Stop marking the nodes
+ *
+ */
+void uniconf_whence_end()
+{
+    uniconf_whence_current = NULL;
+    uniconf_whence_position = 0;
+}
+
+/**
+ * Drop the table of the tree, before the tree is deleted
+ *
+ * @param tree
+ */
+void uniconf_whence_drop(const cJSON *tree)
+{
+    pthread_rwlock_wrlock(&uniconf_whence_lock);
+    int index = uniconf__whence_table(tree);
+    if (index >= 0)
+    {
+        if (uniconf_whence_tables[index].map == uniconf_whence_current)
+        {
+            uniconf_whence_end();
+        }
+        uniconf_map_destroy(uniconf_whence_tables[index].map, NULL);
+        uniconf_whence_tables[index] = uniconf_whence_tables[--uniconf_whence_tables_count];
+    }
+    pthread_rwlock_unlock(&uniconf_whence_lock);
+}
+
+/**
+ * Get the id of the file name, added if new
+ *
+ * @param name
+ *
+ * @return uint32_t : the id + 1, 0 = no memory
+ */
+static uint32_t uniconf__whence_file(const char *name)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char *ptr = (const unsigned char *)name; *ptr; ptr++)
+    {
+        hash ^= *ptr;
+        hash *= 0x100000001b3ULL;
+    }
+    for (uint32_t i = uniconf_whence_files_count; i > 0; i--)
+    {
+        // the recent files are the likely ones
+        if (uniconf_whence_files[i - 1].hash == hash && STR_EQUAL(uniconf_whence_files[i - 1].name, name))
+        {
+            return i;
+        }
+    }
+    uniconf_whence_file_t *files = realloc(uniconf_whence_files, (uniconf_whence_files_count + 1) * sizeof(uniconf_whence_file_t));
+    if (!files)
+    {
+        return 0;
+    }
+    uniconf_whence_files = files;
+    char *copy = strdup(name);
+    if (!copy)
+    {
+        return 0;
+    }
+    uniconf_whence_files[uniconf_whence_files_count++] = (uniconf_whence_file_t){.hash = hash, .name = copy};
+    return uniconf_whence_files_count;
+}
+
+/**
+ * Set the current file, the line 0
+ *
+ * @param source : the file|directory path
+ *
+ * @return uint64_t : the previous position, for uniconf_whence_leave()
+ */
+uint64_t uniconf_whence_enter(const char *source)
+{
+    uint64_t previous = uniconf_whence_position;
+    if (uniconf_whence_current && source)
+    {
+        pthread_rwlock_wrlock(&uniconf_whence_lock);
+        uniconf_whence_position = WHENCE_POSITION(uniconf__whence_file(source), 0);
+        pthread_rwlock_unlock(&uniconf_whence_lock);
+    }
+    return previous;
+}
+
+/**
+ * Restore the position
+ *
+ * @param previous : of uniconf_whence_enter()
+ */
+void uniconf_whence_leave(uint64_t previous)
+{
+    if (uniconf_whence_current)
+    {
+        uniconf_whence_position = previous;
+    }
+}
+
+/**
+ * Set the current line of the file
+ *
+ * @param line
+ *
+ * @return int : the line
+ */
+int uniconf_whence_line(int line)
+{
+    if (uniconf_whence_current)
+    {
+        uniconf_whence_position = WHENCE_POSITION(WHENCE_FILE(uniconf_whence_position), line);
+    }
+    return line;
+}
+
+/**
+ * Record the current position as the origin of the node
+ *
+ * @param node
+ *
+ * @return cJSON* : the node
+ */
+cJSON *uniconf_whence_mark(cJSON *node)
+{
+    if (uniconf_whence_current && node && WHENCE_FILE(uniconf_whence_position))
+    {
+        void **slot = uniconf_map_slot(uniconf_whence_current, node);
+        if (slot)
+        {
+            *slot = (void *)(uintptr_t)uniconf_whence_position; // 64-bit slot
+        }
+    }
+    return node;
+}
+
+/**
+ * Get the origin of the value
+ *
+ * @param whence : out
+ * @param format : the path
+ * @param ...
+ *
+ * @return int : 0 = found, -ENOENT = no such path, -ENODATA = no provenance
+ */
+int uniconf_whence(uniconf_whence_t *whence, const char *format, ...)
+{
+    if (!whence || !format)
+    {
+        return -EINVAL;
+    }
+    char *path = NULL;
+    va_list ap;
+    va_start(ap, format);
+    vasprintf(&path, format, ap);
+    va_end(ap);
+    if (!path)
+    {
+        return -ENOMEM;
+    }
+
+    unsigned long epoch = uniconf_reader_enter();
+    cJSON *tree = uniconf_root_mutable();
+    cJSON *node = uniconf_layered() ? uniconf_layer_walk(path, &tree) : uniconf_walk(tree, path);
+    free(path);
+    if (!node)
+    {
+        uniconf_reader_leave(epoch);
+        return -ENOENT;
+    }
+
+    pthread_rwlock_rdlock(&uniconf_whence_lock);
+    int index = uniconf__whence_table(tree);
+    uint64_t position = (index < 0) ? 0 : (uint64_t)(uintptr_t)uniconf_map_get(uniconf_whence_tables[index].map, node);
+    uint32_t file = WHENCE_FILE(position);
+    int found = file && file <= uniconf_whence_files_count;
+    if (found)
+    {
+        whence->file = uniconf_whence_files[file - 1].name; // kept until uniconf_destruct()
+        whence->line = WHENCE_LINE(position);
+    }
+    pthread_rwlock_unlock(&uniconf_whence_lock);
+    if (found)
+    {
+        whence->layer = uniconf_layer_name(tree);
+    }
+    uniconf_reader_leave(epoch);
+    return found ? 0 : -ENODATA;
+}
+
+/**
+ * Drop all the tables and the file names
+ *
+ */
+void uniconf_whence_reset()
+{
+    uniconf_whence_end();
+    pthread_rwlock_wrlock(&uniconf_whence_lock);
+    for (int i = 0; i < uniconf_whence_tables_count; i++)
+    {
+        uniconf_map_destroy(uniconf_whence_tables[i].map, NULL);
+    }
+    FREE_AND_NULL(uniconf_whence_tables);
+    uniconf_whence_tables_count = 0;
+    for (uint32_t i = 0; i < uniconf_whence_files_count; i++)
+    {
+        free(uniconf_whence_files[i].name);
+    }
+    FREE_AND_NULL(uniconf_whence_files);
+    uniconf_whence_files_count = 0;
+    pthread_rwlock_unlock(&uniconf_whence_lock);
+}
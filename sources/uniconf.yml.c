@@ -9,62 +9,116 @@
 #include <lists.h>
 #include <yaml.h>
 
-static void process_event(cJSON *json, yaml_event_t *event);
-static cJSON *node = NULL;
+static void process_event(list_t **stack, cJSON *json, yaml_event_t *event);
 
 /**
- * Parse the .yml file
+ * Parse the .yml events of the parser with the input set
  *
  * @param root
- * @param filepath
+ * @param parser
+ * @param source
  * @param branch
  * @return int
  */
-int uniconf_yml(cJSON *root, const char *filepath, const char *branch)
+static int uniconf__yml(cJSON *root, yaml_parser_t *parser, const char *source, const char *branch)
 {
     int count = 0;
-    node = uniconf_nodeNULL(root, branch);
+    cJSON *node = uniconf_nodeNULL(root, branch);
 
     if (node)
     {
-        FILE *_file = NULL;
-        if (filepath && (_file = fopen(filepath, "rt")))
+        yaml_event_t event;
+        yaml_event_type_t event_type;
+        list_t *stack = NULL; // local, the nested lazy loads may parse other files
+        int depth = 0;
+
+        do
         {
-            yaml_parser_t parser;
-            yaml_event_t event;
-            yaml_event_type_t event_type;
+            if (!yaml_parser_parse(parser, &event))
+            {
+                uniconf_error("Failed to parse file '%s': '%s'", source, parser->problem);
+                count = 0;
+                break;
+            }
+            process_event(&stack, node, &event);
+            event_type = event.type;
+            depth += (YAML_SEQUENCE_START_EVENT == event_type || YAML_MAPPING_START_EVENT == event_type) -
+                     (YAML_SEQUENCE_END_EVENT == event_type || YAML_MAPPING_END_EVENT == event_type);
+            int line = (int)event.start_mark.line + 1;
+            yaml_event_delete(&event);
+            count++;
+            if (uniconf_budget_depth(source, line, depth) < 0)
+            {
+                break;
+            }
+        } while (event_type != YAML_STREAM_END_EVENT);
 
-            yaml_parser_initialize(&parser);
-            yaml_parser_set_input_file(&parser, _file);
+        stack = list_destruct(stack, NULL);
+    }
+    return count;
+}
 
-            do
-            {
-                if (!yaml_parser_parse(&parser, &event))
-                {
-                    uniconf_error("Failed to parse file '%s': '%s'", filepath, parser.problem);
-                    count = 0;
-                    break;
-                }
-                process_event(node, &event);
-                event_type = event.type;
-                yaml_event_delete(&event);
-                count++;
-            } while (event_type != YAML_STREAM_END_EVENT);
-
-            yaml_parser_delete(&parser);
-            fclose(_file);
-        }
-        else
-        {
-            uniconf_error("Failed to open file '%s'", filepath);
-            count = 0;
-        }
+/**
+ * Parse the .yml file
+ *
+ * @param root
+ * @param buffer
+ * @param length
+ * @param source
+ * @param branch
+ * @return int
+ */
+int uniconf_yml(cJSON *root, const char *buffer, size_t length, const char *source, const char *branch)
+{
+    int count = 0;
+    if (buffer)
+    {
+        yaml_parser_t parser;
+        yaml_parser_initialize(&parser);
+        yaml_parser_set_input_string(&parser, (const unsigned char *)buffer, length);
+        count = uniconf__yml(root, &parser, source, branch);
+        yaml_parser_delete(&parser);
     }
     return count;
 }
 
+/**
+ * Read the decompressed input of the parser
+ *
+ * @param data : the stream
+ * @param buffer
+ * @param size
+ * @param size_read : 0 = the end
+ *
+ * @return int : 1 = success, 0 = error
+ */
+static int uniconf__yml_read(void *data, unsigned char *buffer, size_t size, size_t *size_read)
+{
+    ssize_t read = uniconf_stream_read(data, (char *)buffer, size);
+    *size_read = (read > 0) ? (size_t)read : 0;
+    return read >= 0;
+}
+
+/**
+ * Parse the .yml file while decompressing
+ *
+ * @param root
+ * @param stream
+ * @param source
+ * @param branch
+ * @return int
+ */
+int uniconf_yml_stream(cJSON *root, uniconf_stream_t *stream, const char *source, const char *branch)
+{
+    yaml_parser_t parser;
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input(&parser, uniconf__yml_read, stream);
+    int count = uniconf__yml(root, &parser, source, branch);
+    yaml_parser_delete(&parser);
+    return count;
+}
+
 #define STRVAL(x) ((x) ? (char *)(x) : "")
-static list_t *stack = NULL;
 
 static char *astrncpy(char *src, int len)
 {
@@ -85,7 +139,7 @@ static cJSON *add_NullToArray(cJSON *json)
         cJSON_Delete(item);
         item = NULL;
     }
-    return item;
+    return uniconf_added(item);
 }
 
 static cJSON *add_ObjectToArray(cJSON *json)
@@ -96,7 +150,7 @@ static cJSON *add_ObjectToArray(cJSON *json)
         cJSON_Delete(item);
         item = NULL;
     }
-    return item;
+    return uniconf_added(item);
 }
 
 static cJSON *add_StringToArray(cJSON *json, char *name, int namelen)
@@ -114,6 +168,7 @@ static cJSON *add_StringToArray(cJSON *json, char *name, int namelen)
                 cJSON_Delete(item);
                 item = NULL;
             }
+            uniconf_added(item);
             free(expanded);
         }
         free(buff);
@@ -127,12 +182,7 @@ static cJSON *add_NullToObject(cJSON *json, char *name, int namelen)
     char *buff = astrncpy(name, namelen);
     if (buff)
     {
-        item = cJSON_CreateNull();
-        if (item && !cJSON_AddItemToObject(json, buff, item))
-        {
-            cJSON_Delete(item);
-            item = NULL;
-        }
+        item = uniconf_add(json, buff, cJSON_CreateNull());
         free(buff);
     }
     return item;
@@ -172,29 +222,30 @@ static void set_AsObject(cJSON *json)
     }
 }
 
-static void process_event(cJSON *json, yaml_event_t *event)
+static void process_event(list_t **stack, cJSON *json, yaml_event_t *event)
 {
+    uniconf_whence_line((int)event->start_mark.line + 1);
     switch (event->type)
     {
     case YAML_DOCUMENT_START_EVENT:
-        stack = list_construct();
-        list_push(stack, json);
+        *stack = list_construct();
+        list_push(*stack, json);
         break;
     case YAML_DOCUMENT_END_EVENT:
-        stack = list_destruct(stack, NULL);
+        *stack = list_destruct(*stack, NULL);
         break;
     case YAML_SCALAR_EVENT:
         // JSONise
         {
-            cJSON *item = (cJSON *)list_get(stack);
+            cJSON *item = (cJSON *)list_get(*stack);
             if (cJSON_IsNull(item))
             {
                 set_AsString(item, STRVAL(event->data.scalar.value), (int)event->data.scalar.length);
-                list_pop(stack);
+                list_pop(*stack);
             }
             else if (cJSON_IsObject(item))
             {
-                list_push(stack, add_NullToObject(item, STRVAL(event->data.scalar.value), (int)event->data.scalar.length));
+                list_push(*stack, add_NullToObject(item, STRVAL(event->data.scalar.value), (int)event->data.scalar.length));
             }
             else if (cJSON_IsArray(item))
             {
@@ -205,36 +256,36 @@ static void process_event(cJSON *json, yaml_event_t *event)
     case YAML_SEQUENCE_START_EVENT:
         // JSONise
         {
-            cJSON *item = (cJSON *)list_get(stack);
+            cJSON *item = (cJSON *)list_get(*stack);
             if (cJSON_IsNull(item))
             {
                 set_AsArray(item);
             }
             else if (cJSON_IsArray(item))
             {
-                list_push(stack, add_NullToArray(item));
+                list_push(*stack, add_NullToArray(item));
             }
         }
         break;
     case YAML_SEQUENCE_END_EVENT:
-        list_pop(stack);
+        list_pop(*stack);
         break;
     case YAML_MAPPING_START_EVENT:
         // JSONise
         {
-            cJSON *item = (cJSON *)list_get(stack);
+            cJSON *item = (cJSON *)list_get(*stack);
             if (cJSON_IsNull(item))
             {
                 set_AsObject(item);
             }
             else if (cJSON_IsArray(item))
             {
-                list_push(stack, add_ObjectToArray(item));
+                list_push(*stack, add_ObjectToArray(item));
             }
         }
         break;
     case YAML_MAPPING_END_EVENT:
-        list_pop(stack);
+        list_pop(*stack);
         break;
     default:
         break;
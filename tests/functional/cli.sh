@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+# The functional test of the uniconf command line tool
+#
+# cli.sh <uniconf> : checks the exit codes and the outputs of the subcommands
+#
+
+UNICONF=${1:-../../tools/uniconf}
+DATA=cli
+SNAP=${TMPDIR:-/tmp}/uniconf_cli.$$.snap
+failed=0
+
+# expect <code> <output or -> <args...>
+expect()
+{
+    code=$1
+    output=$2
+    shift 2
+    actual=$("$UNICONF" "$@" 2>/dev/null)
+    ret=$?
+    if [ "$ret" -ne "$code" ]; then
+        echo "FAIL: uniconf $*: exit $ret, expected $code"
+        failed=$((failed + 1))
+    elif [ "-" != "$output" ] && [ "$actual" != "$output" ]; then
+        echo "FAIL: uniconf $*: '$actual', expected '$output'"
+        failed=$((failed + 1))
+    fi
+}
+
+# the usage
+expect 2 -
+expect 2 - get $DATA/good
+expect 2 - unknown $DATA/good
+
+# get
+expect 0 8080 get $DATA/good listen.port
+expect 0 localhost get $DATA/good listen/host
+expect 1 - get $DATA/good listen.missing
+expect 1 - get $DATA/missing listen.port
+
+# dump
+expect 0 - dump $DATA/good
+expect 1 - dump $DATA/missing
+
+# check
+expect 0 "$DATA/good: 0 errors, 0 warnings" check $DATA/good
+expect 1 "$DATA/broken: 1 errors, 0 warnings" check $DATA/broken
+
+# compile, then read the snapshot
+expect 0 - compile $DATA/good "$SNAP"
+expect 0 8080 get "$SNAP" listen.port
+expect 0 "$("$UNICONF" dump $DATA/good)" dump "$SNAP"
+expect 1 - compile $DATA/missing "$SNAP.missing"
+rm -f "$SNAP" "$SNAP.missing"
+
+# profile
+expect 0 - profile $DATA/good
+expect 1 - profile $DATA/missing
+
+if [ "$failed" -ne 0 ]; then
+    echo "cli: $failed failed"
+    exit 1
+fi
+echo "cli: passed"
@@ -0,0 +1,81 @@
+/*
+ * The functional test of uniconf-gen
+ *
+ * gen-bind good|bad <config>
+ *
+ * Binds the config by the generated server_bind(), exits 0 when the fields
+ * and the errors are the expected ones.
+ */
+#include "server.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EXPECT(cond)                                                         \
+    if (!(cond))                                                             \
+    {                                                                        \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);           \
+        failed++;                                                            \
+    }
+
+static int failed = 0;
+
+static void expect_good(void)
+{
+    server_t conf;
+    // the host, debug and upstreams are bound, the rest are the defaults
+    EXPECT(3 == server_bind(&conf, NULL));
+    EXPECT(8080 == conf.listen_port);
+    EXPECT(conf.listen_host && !strcmp("localhost", conf.listen_host));
+    EXPECT(0.5 == conf.ratio);
+    EXPECT(1 == conf.debug);
+    EXPECT(81 == uniconf_getNumber("upstreams.a.port"));
+    EXPECT(conf.upstreams == uniconf_getObject("upstreams"));
+    EXPECT(!uniconf_bind_errors());
+}
+
+static void expect_bad(void)
+{
+    server_t conf;
+    // the port and debug mismatch, the host is missing, the ratio is bound
+    EXPECT(-3 == server_bind(&conf, NULL));
+    EXPECT(2 == conf.ratio);
+    EXPECT(!conf.listen_host);
+    EXPECT(!uniconf_getObject("errors"));
+    char *text = uniconf_bind_errors();
+    cJSON *errors = text ? cJSON_Parse(text) : NULL;
+    free(text);
+    EXPECT(3 == cJSON_GetArraySize(errors));
+    const char *error = cJSON_GetStringValue(cJSON_GetArrayItem(errors, 0));
+    EXPECT(error && strstr(error, "'listen.port' expects number"));
+    error = cJSON_GetStringValue(cJSON_GetArrayItem(errors, 1));
+    EXPECT(error && strstr(error, "'debug' expects boolean"));
+    error = cJSON_GetStringValue(cJSON_GetArrayItem(errors, 2));
+    EXPECT(error && strstr(error, "'listen.host' of type string is required"));
+    cJSON_Delete(errors);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s good|bad <config>\n", argv[0]);
+        return 2;
+    }
+    if (uniconf_construct("%s", argv[2]) < 0)
+    {
+        fprintf(stderr, "%s: can't construct\n", argv[2]);
+        return 1;
+    }
+    if (!strcmp("good", argv[1]))
+    {
+        expect_good();
+    }
+    else
+    {
+        expect_bad();
+    }
+    uniconf_destruct();
+    return failed ? 1 : 0;
+}
@@ -4,10 +4,18 @@
  **/
 #define _GNU_SOURCE
 
+#include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <locale.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include <CUnit/Basic.h>
 #include <uniconf.h>
@@ -21,7 +29,7 @@ static void test_construct(void)
     int result = uniconf_construct(NULL);
     CU_ASSERT_EQUAL(0, result);
 
-    cJSON *root = uniconf_get_root();
+    uniconf_t root = uniconf_get_root();
     char *expect = "{}";
     char *actual = cJSON_PrintUnformatted(root);
     CU_ASSERT_STRING_EQUAL(expect, actual);
@@ -130,6 +138,1097 @@ static void test_yml(void)
     FREE_TEST_DATA(expect);
 }
 
+static void test_getObject(void)
+{
+    char *path = NULL;
+    char *name = NULL;
+    char *expect = NULL;
+    START_USING_TEST_DATA(HOME_PATH)
+    {
+        USE_OF_THE_TEST_DATA("%ms '%m[^']' '%m[^']'", &path, &name, &expect);
+        printf("'%s' '%s'->'%s'", path, name, expect);
+        uniconf_construct(path);
+        uniconf_t object = uniconf_getObject("%s", name);
+        char *actual = object ? cJSON_PrintUnformatted(object) : strdup("null");
+        printf("<-'%s'\n", actual);
+        CU_ASSERT_STRING_EQUAL(expect, actual);
+        free(actual);
+    }
+    FINISH_USING_TEST_DATA;
+    uniconf_destruct();
+    FREE_TEST_DATA(path);
+    FREE_TEST_DATA(name);
+    FREE_TEST_DATA(expect);
+}
+
+static void *environ_reader(void *arg)
+{
+    const char *home = uniconf_getString("sub.home");
+    return home ? strdup(home) : arg;
+}
+
+static void test_environ(void)
+{
+    setenv("UNICONF_TEST_HOME", "/home/test", 1);
+    setenv("UNICONF_TEST__SECTION__BAR", "overridden", 1);
+    setenv("UNICONF_TEST__NEW__VALUE", "created", 1);
+
+    uniconf_construct(HOME_PATH "config8");
+    CU_ASSERT_STRING_EQUAL("$(UNICONF_TEST_HOME)/$(foo)", uniconf_getString("home"));
+
+    uniconf_env_fallback(1);
+    uniconf_construct(HOME_PATH "config8");
+    CU_ASSERT_STRING_EQUAL("/home/test/bar", uniconf_getString("home"));
+    CU_ASSERT_STRING_EQUAL("$(UNICONF_TEST_MISSING)", uniconf_getString("missing"));
+    CU_ASSERT_PTR_NULL(uniconf_getObject("UNICONF_TEST_HOME"));
+
+    // the lazy branch falls back on the reader thread, its index is of the load
+    uniconf_lazy(1);
+    uniconf_construct(HOME_PATH "config19");
+    pthread_t reader;
+    char *home = NULL;
+    CU_ASSERT_FATAL(0 == pthread_create(&reader, NULL, environ_reader, NULL));
+    pthread_join(reader, (void **)&home);
+    CU_ASSERT_STRING_EQUAL("/home/test/root", home);
+    free(home);
+    uniconf_lazy(0);
+
+    uniconf_env_prefix("UNICONF_TEST__");
+    uniconf_construct(HOME_PATH "config2");
+    CU_ASSERT_STRING_EQUAL("overridden", uniconf_getString("section.bar"));
+    CU_ASSERT_STRING_EQUAL("created", uniconf_getString("new.value"));
+    CU_ASSERT_STRING_EQUAL("bar", uniconf_getString("foo"));
+
+    uniconf_env_prefix(NULL);
+    uniconf_env_fallback(0);
+    unsetenv("UNICONF_TEST_HOME");
+    unsetenv("UNICONF_TEST__SECTION__BAR");
+    unsetenv("UNICONF_TEST__NEW__VALUE");
+    uniconf_destruct();
+}
+
+static void test_lazy(void)
+{
+    uniconf_lazy(1);
+    uniconf_construct(HOME_PATH "config9");
+    uniconf_t root = uniconf_get_root();
+    CU_ASSERT_STRING_EQUAL("root", cJSON_GetObjectItem(root, "name")->valuestring);
+    CU_ASSERT_PTR_NULL(cJSON_GetObjectItem(root, "region")->child);
+    CU_ASSERT_PTR_NULL(cJSON_GetObjectItem(root, "other")->child);
+
+    CU_ASSERT_STRING_EQUAL("root", uniconf_getString("region.title"));
+    CU_ASSERT_PTR_NOT_NULL(cJSON_GetObjectItem(root, "region")->child);
+    CU_ASSERT_PTR_NULL(cJSON_GetObjectItem(root, "other")->child);
+
+    int count = 0;
+    uniconf_ForEach(item, cJSON_GetObjectItem(root, "other"))
+    {
+        count++;
+    }
+    CU_ASSERT_EQUAL(2, count);
+
+    // hashed without loading, the version doesn't change on the load
+    uniconf_construct(HOME_PATH "config9");
+    uint64_t version = uniconf_version();
+    CU_ASSERT_NOT_EQUAL(0, version);
+    CU_ASSERT_PTR_NULL(cJSON_GetObjectItem(uniconf_get_root(), "other")->child);
+    CU_ASSERT_EQUAL(2, uniconf_getNumber("other.y"));
+    CU_ASSERT_EQUAL(version, uniconf_version());
+
+    // the errors of the loads are not in the tree
+    uniconf_construct(HOME_PATH "config18");
+    CU_ASSERT_PTR_NULL(uniconf_lazy_errors());
+    CU_ASSERT_PTR_NULL(uniconf_getObject("bad.x"));
+    CU_ASSERT_PTR_NULL(uniconf_getObject("errors"));
+    char *errors = uniconf_lazy_errors();
+    CU_ASSERT_PTR_NOT_NULL(errors);
+    CU_ASSERT_PTR_NOT_NULL(errors ? strstr(errors, "config18/bad/x.json' at line 1") : NULL);
+    free(errors);
+
+    uniconf_lazy(0);
+    uniconf_construct(HOME_PATH "config9");
+    CU_ASSERT_PTR_NOT_NULL(cJSON_GetObjectItem(uniconf_get_root(), "other")->child);
+    uniconf_destruct();
+}
+
+static void test_bind(void)
+{
+    long long number = 0;
+    double real = 0;
+    int boolean = -1;
+    const char *string = NULL;
+
+    cJSON *node = cJSON_Parse("[\"0x10\", \"12abc\", 2.5, \"yes\", false, \"text\", {}, 3.7, 1e30, -42]");
+    CU_ASSERT_TRUE(uniconf_asNumber(cJSON_GetArrayItem(node, 0), &number));
+    CU_ASSERT_EQUAL(16, number);
+    CU_ASSERT_FALSE(uniconf_asNumber(cJSON_GetArrayItem(node, 1), &number));
+    CU_ASSERT_FALSE(uniconf_asNumber(cJSON_GetArrayItem(node, 7), &number));
+    CU_ASSERT_FALSE(uniconf_asNumber(cJSON_GetArrayItem(node, 8), &number));
+    CU_ASSERT_EQUAL(16, number);
+    CU_ASSERT_TRUE(uniconf_asNumber(cJSON_GetArrayItem(node, 9), &number));
+    CU_ASSERT_EQUAL(-42, number);
+    CU_ASSERT_TRUE(uniconf_asDouble(cJSON_GetArrayItem(node, 2), &real));
+    CU_ASSERT_DOUBLE_EQUAL(2.5, real, 0.001);
+    // the decimal point doesn't depend on the locale, if the one with the comma is installed
+    if (setlocale(LC_NUMERIC, "de_DE.UTF-8") || setlocale(LC_NUMERIC, "fr_FR.UTF-8"))
+    {
+        cJSON *text = cJSON_CreateString("0.25");
+        CU_ASSERT_TRUE(uniconf_asDouble(text, &real));
+        CU_ASSERT_DOUBLE_EQUAL(0.25, real, 0.001);
+        cJSON_Delete(text);
+        setlocale(LC_NUMERIC, "C");
+    }
+    CU_ASSERT_TRUE(uniconf_asBoolean(cJSON_GetArrayItem(node, 3), &boolean));
+    CU_ASSERT_EQUAL(1, boolean);
+    CU_ASSERT_TRUE(uniconf_asBoolean(cJSON_GetArrayItem(node, 4), &boolean));
+    CU_ASSERT_EQUAL(0, boolean);
+    CU_ASSERT_FALSE(uniconf_asBoolean(cJSON_GetArrayItem(node, 5), &boolean));
+    CU_ASSERT_FALSE(uniconf_asString(cJSON_GetArrayItem(node, 6), &string));
+    CU_ASSERT_PTR_NULL(string);
+    CU_ASSERT_STRING_EQUAL("object", uniconf_typeName(cJSON_GetArrayItem(node, 6)));
+
+    // the errors are kept aside of the read-only tree until the next construct
+    uniconf_construct(HOME_PATH "config1");
+    uint64_t version = uniconf_version();
+    CU_ASSERT_EQUAL(1, uniconf_bind_error("app", "port", "number", cJSON_GetArrayItem(node, 1)));
+    CU_ASSERT_EQUAL(1, uniconf_bind_error("app", "host", "string", NULL));
+    CU_ASSERT_PTR_NULL(uniconf_getObject("errors"));
+    CU_ASSERT_EQUAL(version, uniconf_version());
+    char *errors = uniconf_bind_errors();
+    CU_ASSERT_STRING_EQUAL("[\"ERROR: schema 'app': 'port' expects number, got string \\\"12abc\\\"\","
+                           "\"ERROR: schema 'app': 'host' of type string is required\"]",
+                           errors);
+    free(errors);
+    uniconf_construct(HOME_PATH "config1");
+    CU_ASSERT_PTR_NULL(uniconf_bind_errors());
+    cJSON_Delete(node);
+    uniconf_destruct();
+}
+
+static int publish_reading = 0;
+
+static void *publish_reader(void *arg)
+{
+    long *reads = arg;
+    while (__atomic_load_n(&publish_reading, __ATOMIC_ACQUIRE))
+    {
+        *reads += (NULL != uniconf_getString("foo"));
+    }
+    return NULL;
+}
+
+static void test_publish(void)
+{
+    uniconf_unpublish("uniconf_test");
+    uniconf_construct(HOME_PATH "config2");
+    CU_ASSERT_EQUAL(1, uniconf_publish("uniconf_test"));
+    char *bar = strdup(uniconf_getString("section.bar"));
+    uniconf_destruct();
+    CU_ASSERT_PTR_NULL(uniconf_getString("foo"));
+
+    CU_ASSERT_EQUAL(1, uniconf_attach("uniconf_test"));
+    CU_ASSERT_STRING_EQUAL("bar", uniconf_getString("foo"));
+    CU_ASSERT_STRING_EQUAL(bar, uniconf_getString("section.bar"));
+    free(bar);
+    uniconf_t section = uniconf_getObject("section");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(section);
+    CU_ASSERT_STRING_EQUAL("section", uniconf_GetName(section));
+    CU_ASSERT_PTR_EQUAL(section, uniconf_getObject("section"));
+    CU_ASSERT_PTR_NULL(uniconf_getObject("section.missing"));
+
+    // the worker sees the next publication
+    uniconf_construct(HOME_PATH "config1");
+    CU_ASSERT_EQUAL(2, uniconf_publish("uniconf_test"));
+    CU_ASSERT_EQUAL(2, uniconf_generation());
+    CU_ASSERT_PTR_NULL(uniconf_getObject("section"));
+    CU_ASSERT_STRING_EQUAL(cJSON_GetObjectItem(uniconf_get_root(), "foo")->valuestring, uniconf_getString("foo"));
+
+    // the retired mappings aren't unmapped under the getters of the other thread
+    pthread_t reader;
+    __atomic_store_n(&publish_reading, 1, __ATOMIC_RELEASE);
+    long reads = 0;
+    CU_ASSERT_FATAL(0 == pthread_create(&reader, NULL, publish_reader, &reads));
+    for (int i = 0; i < 100; i++)
+    {
+        CU_ASSERT_EQUAL(3 + i, uniconf_publish("uniconf_test"));
+        CU_ASSERT_PTR_NOT_NULL(uniconf_getString("foo"));
+    }
+    __atomic_store_n(&publish_reading, 0, __ATOMIC_RELEASE);
+    pthread_join(reader, NULL);
+    CU_ASSERT_TRUE(reads > 0);
+    CU_ASSERT_EQUAL(102, uniconf_generation());
+
+    uniconf_detach();
+    uniconf_destruct();
+
+    // the corrupted segment isn't mapped: the first child of the root out of the nodes
+    int fd = shm_open("/uniconf_test.102", O_RDWR, 0);
+    CU_ASSERT_TRUE_FATAL(fd >= 0);
+    uint32_t value = 0xFFFFFF;
+    CU_ASSERT_EQUAL(sizeof(value), pwrite(fd, &value, sizeof(value), 48 + 8)); // the root after the header
+    close(fd);
+    CU_ASSERT_EQUAL(-EINVAL, uniconf_attach("uniconf_test"));
+    CU_ASSERT_PTR_NULL(uniconf_getObject("foo"));
+
+    CU_ASSERT_EQUAL(0, uniconf_unpublish("uniconf_test"));
+    CU_ASSERT_TRUE(uniconf_attach("uniconf_test") < 0);
+    uniconf_destruct();
+}
+
+static void on_file(const uniconf_file_stats_t *stats, void *data)
+{
+    int *count = data;
+    if (strstr(stats->filepath, "region"))
+    {
+        CU_ASSERT_EQUAL(1, stats->substitutions);
+    }
+    (*count)++;
+}
+
+static void test_compile(void)
+{
+    int files = 0;
+    uniconf_profile(on_file, &files);
+    uniconf_construct(HOME_PATH "config9");
+    uniconf_profile(NULL, NULL);
+    CU_ASSERT_EQUAL(3, files);
+
+    CU_ASSERT_TRUE(uniconf_compile("/tmp/uniconf_test.snap") > 0);
+    uniconf_destruct();
+    CU_ASSERT_TRUE(uniconf_attach_file(HOME_PATH "config9/.env") < 0);
+    CU_ASSERT_TRUE(uniconf_attach_file("/tmp/uniconf_test.snap") > 0);
+    CU_ASSERT_STRING_EQUAL("root", uniconf_getString("region.title"));
+    CU_ASSERT_EQUAL(2, uniconf_getNumber("other.y"));
+    uniconf_detach();
+    CU_ASSERT_PTR_NULL(uniconf_getString("region.title"));
+    // the truncated file isn't mapped
+    CU_ASSERT_EQUAL(0, truncate("/tmp/uniconf_test.snap", 64));
+    CU_ASSERT_EQUAL(-EINVAL, uniconf_attach_file("/tmp/uniconf_test.snap"));
+    CU_ASSERT_PTR_NULL(uniconf_getString("region.title"));
+    unlink("/tmp/uniconf_test.snap");
+
+    size_t size = 0;
+    uniconf_construct(HOME_PATH "config9");
+    char *image = uniconf_compile_image(&size);
+    uniconf_destruct();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(image);
+    CU_ASSERT_EQUAL(-EINVAL, uniconf_mount(image + 1, size - 1));
+    CU_ASSERT_EQUAL(-EINVAL, uniconf_mount(image, size - 8));
+    // the corrupted copies aren't mounted: the last string unterminated, the root key out of the image, the keys out of order
+    char *copy = malloc(size);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(copy);
+    memcpy(copy, image, size);
+    copy[size - 1] = 'x';
+    CU_ASSERT_EQUAL(-EINVAL, uniconf_mount(copy, size));
+    memcpy(copy, image, size);
+    uint32_t key = 0xFFFFFF;
+    memcpy(copy + 48 + 4, &key, sizeof(key)); // the root after the header
+    CU_ASSERT_EQUAL(-EINVAL, uniconf_mount(copy, size));
+    memcpy(copy, image, size);
+    uint32_t sorted = 0, first[2];
+    memcpy(&sorted, copy + 40, sizeof(sorted)); // the keys order offset in the header
+    memcpy(first, copy + sorted, sizeof(first)); // the keys of the root
+    memcpy(copy + sorted, &first[1], sizeof(uint32_t));
+    memcpy(copy + sorted + sizeof(uint32_t), &first[0], sizeof(uint32_t));
+    CU_ASSERT_EQUAL(-EINVAL, uniconf_mount(copy, size));
+    free(copy);
+    CU_ASSERT_PTR_NULL(uniconf_getString("region.title"));
+    CU_ASSERT_TRUE(uniconf_mount(image, size) > 0);
+    CU_ASSERT_STRING_EQUAL("root", uniconf_getString("region.title"));
+    uniconf_detach();
+
+    // the base under the constructed tree and the layers
+    uniconf_construct(HOME_PATH "config14");
+    CU_ASSERT_TRUE(uniconf_mount_base(image, size) > 0);
+    CU_ASSERT_STRING_EQUAL("base", uniconf_getString("name"));
+    CU_ASSERT_STRING_EQUAL("root", uniconf_getString("region.title"));
+    CU_ASSERT_TRUE(uniconf_layer("local", HOME_PATH "config15") > 0);
+    CU_ASSERT_EQUAL(6432, uniconf_getNumber("db.port"));
+    CU_ASSERT_STRING_EQUAL("db.example", uniconf_getString("db.host"));
+    CU_ASSERT_EQUAL(2, uniconf_getNumber("other.y"));
+    uniconf_t region = uniconf_getObject("region");
+    CU_ASSERT_PTR_NOT_NULL(region);
+    CU_ASSERT_PTR_EQUAL(region, uniconf_getObject("region"));
+    CU_ASSERT_EQUAL(-EINVAL, uniconf_mount_base(image + 1, size - 1));
+    CU_ASSERT_STRING_EQUAL("root", uniconf_getString("region.title"));
+    CU_ASSERT_EQUAL(0, uniconf_mount_base(NULL, 0));
+    CU_ASSERT_PTR_NULL(uniconf_getString("region.title"));
+    CU_ASSERT_STRING_EQUAL("base", uniconf_getString("name"));
+    uniconf_destruct();
+    free(image);
+}
+
+static void test_list(void)
+{
+    for (int compact = 0; compact <= 1; compact++)
+    {
+        uniconf_list_compact(compact);
+        uniconf_construct(HOME_PATH "config10");
+        CU_ASSERT_EQUAL(compact ? 0 : 6, cJSON_GetArraySize(uniconf_getObject("deny")));
+        CU_ASSERT_EQUAL(compact ? 5 : 6, uniconf_listSize("deny"));
+        CU_ASSERT_TRUE(uniconf_getBoolean("deny"));
+
+        CU_ASSERT_TRUE(uniconf_listContains("deny", "foo"));
+        CU_ASSERT_TRUE(uniconf_listContains("deny", "quoted.org"));
+        CU_ASSERT_FALSE(uniconf_listContains("deny", "fo"));
+        CU_ASSERT_FALSE(uniconf_listContains("deny", "# the comment"));
+        CU_ASSERT_FALSE(uniconf_listContains("missing", "foo"));
+
+        CU_ASSERT_STRING_EQUAL("example.com/api/", uniconf_listMatch("deny", "example.com/api/v1"));
+        CU_ASSERT_STRING_EQUAL("example.com/", uniconf_listMatch("deny", "example.com/app"));
+        CU_ASSERT_STRING_EQUAL("foo", uniconf_listMatch("deny", "foobar"));
+        CU_ASSERT_PTR_NULL(uniconf_listMatch("deny", "example.co"));
+
+        const char *entries[2] = {NULL};
+        CU_ASSERT_EQUAL(compact ? 3 : 4, uniconf_listPrefix("deny", "example.", entries, 2));
+        CU_ASSERT_STRING_EQUAL("example.com/", entries[0]);
+        CU_ASSERT_EQUAL(0, uniconf_listPrefix("deny", "z", NULL, 0));
+    }
+    uniconf_list_compact(0);
+    uniconf_destruct();
+}
+
+static void test_intern(void)
+{
+    uniconf_intern_keys(1);
+    uniconf_construct(HOME_PATH "config11");
+    // host, port, weight, upstreams
+    CU_ASSERT_EQUAL(4, uniconf_intern_count());
+    uniconf_t first = uniconf_getObject("upstreams.0.host");
+    uniconf_t last = uniconf_getObject("upstreams.2.host");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(first);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(last);
+    CU_ASSERT_PTR_EQUAL(first->string, last->string);
+    CU_ASSERT_PTR_EQUAL(first->string, uniconf_getObject("host")->string);
+    CU_ASSERT_STRING_EQUAL("gamma", uniconf_getString("upstreams.2.host"));
+    CU_ASSERT_EQUAL(8081, uniconf_getNumber("upstreams.1.port"));
+    // the directory and the .json of the branch
+    const char *json = "{\"a\": 1}";
+    const char *env = "b=2\n";
+    const char *inner = "{\"c\": 3}";
+    uniconf_source_t sources[] = {
+        {"db.json", NULL, json, strlen(json)},
+        {"db/b.env", NULL, env, strlen(env)},
+        {"db/.json", NULL, inner, strlen(inner)},
+    };
+    uniconf_construct_sources(sources, 3);
+    CU_ASSERT_PTR_NULL(uniconf_getObject("errors"));
+    CU_ASSERT_EQUAL(1, uniconf_getNumber("db.a"));
+    CU_ASSERT_EQUAL(2, uniconf_getNumber("db.b.b"));
+    CU_ASSERT_EQUAL(3, uniconf_getNumber("db.c"));
+
+    uniconf_intern_keys(0);
+    uniconf_construct(HOME_PATH "config11");
+    CU_ASSERT_EQUAL(0, uniconf_intern_count());
+    CU_ASSERT_TRUE(uniconf_getObject("upstreams.0.host")->string != uniconf_getObject("upstreams.2.host")->string);
+    uniconf_destruct();
+}
+
+static void test_ignore_case(void)
+{
+    uniconf_ignore_case(1);
+    uniconf_construct(HOME_PATH "config12");
+    CU_ASSERT_STRING_EQUAL("primary", uniconf_getString("DB_HOST"));
+    CU_ASSERT_STRING_EQUAL("primary", uniconf_getString("db_host"));
+    CU_ASSERT_EQUAL(5432, uniconf_getNumber("DB_Port"));
+    CU_ASSERT_STRING_EQUAL("front", uniconf_getString("server.name"));
+    CU_ASSERT_EQUAL(1, cJSON_GetArraySize(uniconf_getObject("Errors")));
+    CU_ASSERT_PTR_NULL(uniconf_getObject("db_user"));
+    // the tables hold the read-only children
+    uniconf_t server = uniconf_getObject("SERVER");
+    CU_ASSERT_TRUE(_Generic(server, const cJSON *: 1, default: 0));
+    CU_ASSERT_PTR_EQUAL(cJSON_GetObjectItem(server, "name"), uniconf_getObject("Server.NAME"));
+    // the renamed key is the change
+    cJSON *before = cJSON_Parse("{\"Host\": \"a\", \"0\": 1}");
+    cJSON *after = cJSON_Parse("{\"host\": \"a\", \"1\": 1}");
+    cJSON *patch = uniconf_diff(before, after);
+    CU_ASSERT_EQUAL(4, cJSON_GetArraySize(patch));
+    cJSON_Delete(patch);
+    cJSON_Delete(before);
+    cJSON_Delete(after);
+
+    uniconf_ignore_case(0);
+    uniconf_construct(HOME_PATH "config12");
+    CU_ASSERT_PTR_NULL(uniconf_getObject("DB_HOST"));
+    CU_ASSERT_STRING_EQUAL("replica", uniconf_getString("db_host"));
+    uniconf_destruct();
+}
+
+static int parse_text(cJSON *root, const char *buffer, size_t length, const char *source, const char *branch)
+{
+    (void)source;
+    cJSON *item = cJSON_CreateString("");
+    if (item)
+    {
+        free(item->valuestring);
+        item->valuestring = strndup(buffer, length - (length && '\n' == buffer[length - 1]));
+        cJSON_AddItemToObject(root, branch, item);
+    }
+    return 1;
+}
+
+static void test_parsers(void)
+{
+    CU_ASSERT_PTR_NOT_NULL(uniconf_parser_find("yaml"));
+    CU_ASSERT_PTR_NULL(uniconf_parser_find("txt"));
+
+    CU_ASSERT_EQUAL(0, uniconf_parser_register("txt", parse_text));
+    uniconf_construct(HOME_PATH "config13");
+    CU_ASSERT_STRING_EQUAL("Hello, operator", uniconf_getString("motd"));
+    CU_ASSERT_STRING_EQUAL("edge", uniconf_getString("name"));
+
+    uniconf_parser_f env = uniconf_parser_find("env");
+    CU_ASSERT_EQUAL(0, uniconf_parser_register("env", NULL));
+    CU_ASSERT_EQUAL(0, uniconf_parser_register("txt", NULL));
+    uniconf_construct(HOME_PATH "config13");
+    CU_ASSERT_PTR_NULL(uniconf_getObject("motd"));
+    CU_ASSERT_PTR_NULL(uniconf_getObject("name"));
+
+    CU_ASSERT_EQUAL(0, uniconf_parser_register("env", env));
+    CU_ASSERT_EQUAL(-ENAMETOOLONG, uniconf_parser_register("a-very-long-extension", parse_text));
+    uniconf_destruct();
+}
+
+static void test_sources(void)
+{
+    const char *yml = "hosts:\n  - alpha\n  - beta\n";
+    uniconf_source_t sources[] = {
+        {"region/.env", NULL, "title=$(name)\n", 14},
+        {"defaults", "json", "{\"port\": 80}", 12},
+        {".env", NULL, "name=edge\n", 10},
+        {"region/net.yml", NULL, yml, strlen(yml)},
+        {"README.md", NULL, "ignored", 7},
+    };
+    CU_ASSERT_TRUE(uniconf_construct_sources(sources, 5) > 0);
+    CU_ASSERT_STRING_EQUAL("edge", uniconf_getString("region.title"));
+    CU_ASSERT_STRING_EQUAL("beta", uniconf_getString("region.net.hosts.1"));
+    CU_ASSERT_EQUAL(80, uniconf_getNumber("defaults.port"));
+    CU_ASSERT_PTR_NULL(uniconf_getObject("README"));
+
+    CU_ASSERT_EQUAL(1, uniconf_construct_buffer("json", "{\"port\": 81}", 12));
+    CU_ASSERT_EQUAL(81, uniconf_getNumber("port"));
+    CU_ASSERT_EQUAL(-EINVAL, uniconf_construct_buffer(NULL, "", 0));
+    uniconf_destruct();
+}
+
+static void test_json_errors(void)
+{
+    const char *bad = "{\n  \"a\": 1,\n  \"b\": tru\n}";
+    const char *good = "{\"url\": \"$(good.host):80\", \"host\": \"h\", \"text\": \"\\u00e9\\ud83d\\ude00\"}";
+    uniconf_source_t sources[] = {
+        {"bad.json", NULL, bad, strlen(bad)},
+        {"good.json", NULL, good, strlen(good)},
+    };
+    uniconf_construct_sources(sources, 2);
+    CU_ASSERT_STRING_EQUAL("ERROR: in file 'bad.json' at line 3: column 8: invalid literal", uniconf_getString("errors.0"));
+    CU_ASSERT_PTR_NULL(uniconf_getObject("bad"));
+    // the later key of the same file
+    CU_ASSERT_STRING_EQUAL("h:80", uniconf_getString("good.url"));
+    CU_ASSERT_STRING_EQUAL("\xc3\xa9\xf0\x9f\x98\x80", uniconf_getString("good.text"));
+    // the scalar replaces the scalar of the branch
+    const char *env = "a=foo\nb=bar\n";
+    const char *scalar = "\"x$(a)\"";
+    uniconf_source_t scalars[] = {
+        {".env", NULL, env, strlen(env)},
+        {"b.json", NULL, scalar, strlen(scalar)},
+    };
+    uniconf_construct_sources(scalars, 2);
+    CU_ASSERT_STRING_EQUAL("xfoo", uniconf_getString("b"));
+    uniconf_destruct();
+}
+
+static void test_json_large(void)
+{
+    // the escaped quotes and the backslash runs on all the block offsets
+    const int count = 150000;
+    char *json = malloc(count * 16 + 4);
+    char *ptr = json;
+    *ptr++ = '[';
+    for (int i = 0; i < count; i++)
+    {
+        ptr += sprintf(ptr, "%s\"x", i ? "," : "");
+        for (int k = 0; k < i % 5; k++)
+        {
+            ptr += sprintf(ptr, "\\\\");
+        }
+        ptr += sprintf(ptr, "\\\"\"");
+    }
+    *ptr++ = ']';
+    uniconf_source_t source = {"big.json", NULL, json, ptr - json};
+    CU_ASSERT_EQUAL(1, uniconf_construct_sources(&source, 1));
+    CU_ASSERT_EQUAL(count, cJSON_GetArraySize(uniconf_getObject("big")));
+    CU_ASSERT_STRING_EQUAL("x\"", uniconf_getString("big.0"));
+    CU_ASSERT_STRING_EQUAL("x\\\\\\\\\"", uniconf_getString("big.149999"));
+    // the tree is read-only, the items are read by the vector
+    CU_ASSERT_TRUE(_Generic(uniconf_getObject("big"), const cJSON *: 1, default: 0));
+    CU_ASSERT_STRING_EQUAL("x\\\"", uniconf_getString("big.1"));
+    CU_ASSERT_STRING_EQUAL("x\\\\\\\\\"", uniconf_getString("big.-1"));
+    CU_ASSERT_STRING_EQUAL("x\\\\\\\"", uniconf_getString("big.-2"));
+    free(json);
+    uniconf_destruct();
+}
+
+static void test_compressed(void)
+{
+    uniconf_construct(HOME_PATH "config16");
+    CU_ASSERT_STRING_EQUAL("10.0.0.1", uniconf_getString("routes.default"));
+    CU_ASSERT_EQUAL(2, uniconf_getNumber("routes.count"));
+    // the concatenated members
+    CU_ASSERT_EQUAL(3, uniconf_listSize("deny"));
+    // the yaml is parsed while inflating
+    CU_ASSERT_STRING_EQUAL("server", uniconf_getString("app.name"));
+    CU_ASSERT_EQUAL(2, uniconf_listSize("app.workers"));
+    CU_ASSERT_PTR_NULL(uniconf_getObject("x"));
+    CU_ASSERT_PTR_NOT_NULL(uniconf_getObject("errors"));
+    uniconf_destruct();
+}
+
+static void on_count(const char *path, uniconf_t previous, uniconf_t current, void *data)
+{
+    (void)path;
+    (void)previous;
+    (void)current;
+    (*(int *)data)++;
+}
+
+static void test_layers(void)
+{
+    uniconf_construct(HOME_PATH "config14");
+    // the subscribers are notified of the paths through the layers, the version covers them
+    uint64_t version = uniconf_version();
+    int changes = 0;
+    int port = uniconf_subscribe(on_count, &changes, "db.port");
+    int host = uniconf_subscribe(on_count, &changes, "db.host");
+    CU_ASSERT_TRUE(uniconf_layer("local", HOME_PATH "config15") > 0);
+    CU_ASSERT_EQUAL(1, changes);
+    CU_ASSERT_NOT_EQUAL(version, uniconf_version());
+    CU_ASSERT_EQUAL(8080, uniconf_getNumber("port"));
+    CU_ASSERT_STRING_EQUAL("base", uniconf_getString("name"));
+    CU_ASSERT_STRING_EQUAL("base.example:8080", uniconf_getString("url"));
+    // the object is of the top layer, the paths fall through
+    CU_ASSERT_PTR_NULL(cJSON_GetObjectItem(uniconf_getObject("db"), "host"));
+    CU_ASSERT_STRING_EQUAL("db.example", uniconf_getString("db.host"));
+    CU_ASSERT_EQUAL(6432, uniconf_getNumber("db.port"));
+    CU_ASSERT_PTR_NULL(cJSON_GetObjectItem(uniconf_get_root(), "url"));
+
+    // reconstructed in place, the base is kept
+    uniconf_t base = uniconf_get_root();
+    CU_ASSERT_TRUE(uniconf_layer("local", HOME_PATH "config14") > 0);
+    CU_ASSERT_TRUE(base == uniconf_get_root());
+    CU_ASSERT_EQUAL(80, uniconf_getNumber("port"));
+    CU_ASSERT_EQUAL(2, changes);
+    CU_ASSERT_TRUE(uniconf_layer("local", HOME_PATH "none") < 0);
+    CU_ASSERT_PTR_NOT_NULL(uniconf_layer_get("local"));
+
+    CU_ASSERT_EQUAL(0, uniconf_layer_remove("local"));
+    CU_ASSERT_EQUAL(-ENOENT, uniconf_layer_remove("local"));
+    CU_ASSERT_PTR_NULL(uniconf_getObject("url"));
+    CU_ASSERT_EQUAL(2, changes);
+    CU_ASSERT_EQUAL(version, uniconf_version());
+    uniconf_unsubscribe(port);
+    uniconf_unsubscribe(host);
+
+    // the errors of the layer are kept apart from the tree
+    CU_ASSERT_TRUE(uniconf_layer("bad", HOME_PATH "config18") >= 0);
+    CU_ASSERT_PTR_NULL(uniconf_getObject("errors"));
+    char *errors = uniconf_layer_errors("bad");
+    CU_ASSERT_PTR_NOT_NULL(errors);
+    CU_ASSERT_PTR_NOT_NULL(errors ? strstr(errors, "config18/bad/x.json") : NULL);
+    FREE_TEST_DATA(errors);
+    CU_ASSERT_PTR_NULL(uniconf_layer_errors("none"));
+    uniconf_destruct();
+}
+
+static void test_provenance(void)
+{
+    uniconf_whence_t whence;
+    uniconf_construct(HOME_PATH "config17");
+    CU_ASSERT_EQUAL(-ENODATA, uniconf_whence(&whence, "host"));
+
+    uniconf_provenance(1);
+    setenv("UNICONF_TEST__PORT", "8080", 1);
+    uniconf_env_prefix("UNICONF_TEST__");
+    uniconf_construct(HOME_PATH "config17");
+    CU_ASSERT_EQUAL(0, uniconf_whence(&whence, "host"));
+    CU_ASSERT_STRING_EQUAL(HOME_PATH "config17/.env", whence.file);
+    CU_ASSERT_EQUAL(1, whence.line);
+    CU_ASSERT_PTR_NULL(whence.layer);
+    CU_ASSERT_EQUAL(0, uniconf_whence(&whence, "port"));
+    CU_ASSERT_STRING_EQUAL("environment", whence.file);
+    CU_ASSERT_EQUAL(0, uniconf_whence(&whence, "db.hosts.1"));
+    CU_ASSERT_EQUAL(5, whence.line);
+    CU_ASSERT_EQUAL(0, uniconf_whence(&whence, "routes.paths.-1"));
+    CU_ASSERT_STRING_EQUAL(HOME_PATH "config17/routes.json", whence.file);
+    CU_ASSERT_EQUAL(5, whence.line);
+    CU_ASSERT_EQUAL(0, uniconf_whence(&whence, "app.workers"));
+    CU_ASSERT_EQUAL(2, whence.line);
+    CU_ASSERT_EQUAL(0, uniconf_whence(&whence, "deny.1"));
+    CU_ASSERT_EQUAL(2, whence.line);
+    CU_ASSERT_EQUAL(0, uniconf_whence(&whence, "sub.x.s.k"));
+    CU_ASSERT_EQUAL(2, whence.line);
+    CU_ASSERT_EQUAL(0, uniconf_whence(&whence, "sub"));
+    CU_ASSERT_STRING_EQUAL(HOME_PATH "config17/sub", whence.file);
+    CU_ASSERT_EQUAL(0, whence.line);
+    CU_ASSERT_EQUAL(-ENOENT, uniconf_whence(&whence, "none"));
+
+    // the path of the layer
+    uniconf_layer("local", HOME_PATH "config14");
+    CU_ASSERT_EQUAL(0, uniconf_whence(&whence, "name"));
+    CU_ASSERT_STRING_EQUAL("local", whence.layer);
+    CU_ASSERT_EQUAL(3, whence.line);
+    CU_ASSERT_EQUAL(0, uniconf_whence(&whence, "db.hosts.0"));
+    CU_ASSERT_PTR_NULL(whence.layer);
+
+    uniconf_env_prefix(NULL);
+    unsetenv("UNICONF_TEST__PORT");
+    uniconf_provenance(0);
+    uniconf_destruct();
+}
+
+typedef struct trace_counts
+{
+    int events[UNICONF_TRACE_LOOKUP + 1];
+    int found;
+    char parser[16];
+} trace_counts_t;
+
+static void on_trace(const uniconf_trace_t *trace, void *data)
+{
+    trace_counts_t *counts = data;
+    counts->events[trace->event]++;
+    if (UNICONF_TRACE_FILE_DONE == trace->event && strstr(trace->path, "routes.json"))
+    {
+        snprintf(counts->parser, sizeof(counts->parser), "%s", trace->parser);
+    }
+    if (UNICONF_TRACE_LOOKUP == trace->event)
+    {
+        counts->found += trace->result;
+    }
+}
+
+static void test_trace(void)
+{
+    trace_counts_t counts = {{0}, 0, ""};
+    uniconf_trace(on_trace, &counts);
+    uniconf_construct(HOME_PATH "config17");
+    CU_ASSERT_EQUAL(6, counts.events[UNICONF_TRACE_FILE_START]);
+    CU_ASSERT_EQUAL(6, counts.events[UNICONF_TRACE_FILE_DONE]);
+    CU_ASSERT_EQUAL(2, counts.events[UNICONF_TRACE_SCAN]);
+    CU_ASSERT_STRING_EQUAL("json", counts.parser);
+
+    uniconf_getString("db.name");
+    uniconf_getString("db.none");
+    CU_ASSERT_EQUAL(2, counts.events[UNICONF_TRACE_LOOKUP]);
+    CU_ASSERT_EQUAL(1, counts.found);
+
+    const char env[] = "a=1\nb=$(a)\nc=$(none)\n";
+    uniconf_construct_buffer("env", env, sizeof(env) - 1);
+    CU_ASSERT_EQUAL(2, counts.events[UNICONF_TRACE_SUBSTITUTE]);
+    CU_ASSERT_EQUAL(1, counts.events[UNICONF_TRACE_MISS]);
+
+    uniconf_trace(NULL, NULL);
+    uniconf_getString("db.name");
+    CU_ASSERT_EQUAL(2, counts.events[UNICONF_TRACE_LOOKUP]);
+    uniconf_destruct();
+}
+
+static void test_access(void)
+{
+    uniconf_access_sampling(1);
+    uniconf_construct(HOME_PATH "config17");
+    uint64_t version = uniconf_version();
+    for (int i = 0; i < 3; i++)
+    {
+        const char *value = uniconf_getString("sub.x.s.k");
+        CU_ASSERT_STRING_EQUAL("v", value);
+    }
+    CU_ASSERT_PTR_NOT_NULL(uniconf_getObject("routes.enabled"));
+    CU_ASSERT_TRUE(uniconf_reorganize() > 0);
+    CU_ASSERT_STRING_EQUAL("sub", uniconf_get_root()->child->string);
+    CU_ASSERT_STRING_EQUAL("routes", uniconf_get_root()->child->next->string);
+    CU_ASSERT_EQUAL(version, uniconf_version());
+    CU_ASSERT_STRING_EQUAL("localhost", uniconf_getString("host"));
+
+    char *profile = uniconf_access_export();
+    CU_ASSERT_PTR_NOT_NULL(strstr(profile, "\"sub.x.s.k\":3"));
+    free(profile);
+
+    // the counts order the next construct
+    uniconf_construct(HOME_PATH "config17");
+    CU_ASSERT_STRING_EQUAL("sub", uniconf_get_root()->child->string);
+
+    CU_ASSERT_EQUAL(-EINVAL, uniconf_access_load("[1]"));
+    CU_ASSERT_EQUAL(1, uniconf_access_load("{\"db.name\": 10}"));
+    uniconf_construct(HOME_PATH "config17");
+    CU_ASSERT_STRING_EQUAL("db", uniconf_get_root()->child->string);
+    // the export loads back
+    profile = uniconf_access_export();
+    CU_ASSERT_PTR_NOT_NULL(strstr(profile, "\"db.name\":10"));
+    CU_ASSERT_TRUE(uniconf_access_load(profile) > 0);
+    free(profile);
+    uniconf_construct(HOME_PATH "config17");
+    CU_ASSERT_STRING_EQUAL("db", uniconf_get_root()->child->string);
+
+    uniconf_access_sampling(0);
+    uniconf_destruct();
+}
+
+static int has_error(const char *text)
+{
+    char *errors = cJSON_PrintUnformatted(uniconf_getObject("errors"));
+    int found = errors && strstr(errors, text);
+    free(errors);
+    return found;
+}
+
+static void test_budget(void)
+{
+    uniconf_budget_t budget = {.nodes = 5};
+    uniconf_budget(&budget);
+    CU_ASSERT_EQUAL(-E2BIG, uniconf_construct(HOME_PATH "config17"));
+    CU_ASSERT_TRUE(has_error("budget exceeded: the tree is over 5 nodes"));
+
+    budget = (uniconf_budget_t){.file_size = 16};
+    uniconf_budget(&budget);
+    CU_ASSERT_EQUAL(-EFBIG, uniconf_construct(HOME_PATH "config17"));
+    CU_ASSERT_TRUE(has_error("budget exceeded: file '" HOME_PATH "config17/.env' is over 16 bytes"));
+    CU_ASSERT_EQUAL(-EFBIG, uniconf_construct(HOME_PATH "config16/routes.json.gz"));
+    CU_ASSERT_EQUAL(-EFBIG, uniconf_construct(HOME_PATH "config16/app.yml.gz"));
+    CU_ASSERT_TRUE(has_error("budget exceeded: file '" HOME_PATH "config16/app.yml.gz' is over 16 bytes"));
+
+    budget = (uniconf_budget_t){.depth = 2};
+    uniconf_budget(&budget);
+    const char json[] = "{\"a\": {\"b\":\n {\"c\": 1}}}";
+    CU_ASSERT_EQUAL(-E2BIG, uniconf_construct_buffer("json", json, sizeof(json) - 1));
+    CU_ASSERT_TRUE(has_error("at line 2: column 2: too deep nesting"));
+
+    budget = (uniconf_budget_t){.expansion = 20};
+    uniconf_budget(&budget);
+    const char env[] = "a=0123456789\nb=$(a)$(a)$(a)\nc=d\n";
+    CU_ASSERT_EQUAL(-E2BIG, uniconf_construct_buffer("env", env, sizeof(env) - 1));
+    CU_ASSERT_PTR_NULL(uniconf_getObject("b"));
+    CU_ASSERT_PTR_NULL(uniconf_getObject("c"));
+
+    uniconf_budget(NULL);
+    CU_ASSERT_TRUE(uniconf_construct_buffer("env", env, sizeof(env) - 1) > 0);
+    CU_ASSERT_EQUAL(30, strlen(uniconf_getString("b")));
+    uniconf_destruct();
+}
+
+static void async_done(int result, void *data)
+{
+    char *title = uniconf_getString("region.title");
+    *(int *)data = (title && !strcmp("root", title)) ? result : -1; // published
+}
+
+static sem_t async_parsed;
+static sem_t async_checked;
+
+static void async_paused(const uniconf_file_stats_t *stats, void *data)
+{
+    (void)stats;
+    int *paused = data;
+    if (!(*paused)++)
+    {
+        sem_post(&async_parsed);
+        sem_wait(&async_checked); // the main thread reads meanwhile
+    }
+}
+
+static uniconf_async_t *async_self = NULL;
+static pthread_mutex_t async_stored = PTHREAD_MUTEX_INITIALIZER;
+
+static void async_nested(int result, void *data)
+{
+    (void)result;
+    int *rets = data;
+    pthread_mutex_lock(&async_stored); // the handle is stored
+    pthread_mutex_unlock(&async_stored);
+    rets[0] = uniconf_async_wait(async_self);
+    rets[1] = uniconf_async_free(async_self);
+}
+
+static void test_async(void)
+{
+    int called = 0;
+    uniconf_async_t *async = uniconf_construct_async(async_done, &called, HOME_PATH "config%d", 9);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(async);
+    int ret = uniconf_async_wait(async);
+    CU_ASSERT_TRUE(ret > 0);
+    CU_ASSERT_EQUAL(ret, called);
+    CU_ASSERT_EQUAL(ret, uniconf_async_timedwait(async, 0));
+
+    uniconf_progress_t progress = {0};
+    uniconf_async_progress(async, &progress);
+    CU_ASSERT_EQUAL(1, progress.done);
+    CU_ASSERT_EQUAL(3, progress.total);
+    CU_ASSERT_EQUAL(3, progress.files);
+    CU_ASSERT_EQUAL(32, progress.bytes);
+    uniconf_async_free(async);
+
+    async = uniconf_construct_async(NULL, NULL, HOME_PATH "config%d", 9);
+    CU_ASSERT_EQUAL(ret, uniconf_async_timedwait(async, 10000));
+    uniconf_async_free(async);
+    CU_ASSERT_STRING_EQUAL("1", uniconf_getString("other.x"));
+
+    // the callback can't wait for nor free its own handle
+    int rets[2] = {0};
+    pthread_mutex_lock(&async_stored);
+    async_self = uniconf_construct_async(async_nested, rets, HOME_PATH "config%d", 9);
+    pthread_mutex_unlock(&async_stored);
+    CU_ASSERT_TRUE(uniconf_async_wait(async_self) > 0);
+    CU_ASSERT_EQUAL(-EDEADLK, rets[0]);
+    CU_ASSERT_EQUAL(-EDEADLK, rets[1]);
+    CU_ASSERT_EQUAL(0, uniconf_async_free(async_self));
+
+    // the getters read the previous tree until the new one is complete
+    uniconf_construct(HOME_PATH "config1");
+    int paused = 0;
+    sem_init(&async_parsed, 0, 0);
+    sem_init(&async_checked, 0, 0);
+    uniconf_profile(async_paused, &paused);
+    async = uniconf_construct_async(NULL, NULL, HOME_PATH "config%d", 9);
+    sem_wait(&async_parsed);
+    CU_ASSERT_STRING_EQUAL("bar", uniconf_getString("foo"));
+    CU_ASSERT_PTR_NULL(uniconf_getObject("other"));
+    sem_post(&async_checked);
+    CU_ASSERT_TRUE(uniconf_async_wait(async) > 0);
+    uniconf_async_free(async);
+    uniconf_profile(NULL, NULL);
+    CU_ASSERT_PTR_NULL(uniconf_getObject("foo"));
+    CU_ASSERT_STRING_EQUAL("1", uniconf_getString("other.x"));
+    sem_destroy(&async_parsed);
+    sem_destroy(&async_checked);
+    uniconf_destruct();
+}
+
+static void test_hash(void)
+{
+    uniconf_construct(HOME_PATH "config2");
+    uint64_t version = uniconf_version();
+    uint64_t section = uniconf_hash(uniconf_getObject("section"));
+    CU_ASSERT_NOT_EQUAL(0, version);
+    CU_ASSERT_NOT_EQUAL(version, section);
+
+    uniconf_construct(HOME_PATH "config2");
+    CU_ASSERT_EQUAL(version, uniconf_version());
+    CU_ASSERT_EQUAL(section, uniconf_hash(uniconf_getObject("section")));
+
+    uniconf_construct(HOME_PATH "config1");
+    CU_ASSERT_NOT_EQUAL(version, uniconf_version());
+    CU_ASSERT_TRUE(uniconf_equal(uniconf_getObject("foo"), uniconf_getObject("foo")));
+    CU_ASSERT_FALSE(uniconf_equal(uniconf_getObject("foo"), uniconf_getObject("baz")));
+
+    uniconf_destruct();
+    CU_ASSERT_EQUAL(0, uniconf_version());
+}
+
+static void test_diff(void)
+{
+    char *previous = NULL;
+    char *current = NULL;
+    char *expect = NULL;
+    START_USING_TEST_DATA(HOME_PATH)
+    {
+        USE_OF_THE_TEST_DATA("'%m[^']' '%m[^']' '%m[^']'", &previous, &current, &expect);
+        printf("'%s' '%s'->'%s'", previous, current, expect);
+        cJSON *before = cJSON_Parse(previous);
+        cJSON *after = cJSON_Parse(current);
+        cJSON *patch = uniconf_diff(before, after);
+        char *actual = cJSON_PrintUnformatted(patch);
+        printf("<-'%s'\n", actual);
+        CU_ASSERT_STRING_EQUAL(expect, actual);
+        free(actual);
+        cJSON_Delete(patch);
+        cJSON_Delete(before);
+        cJSON_Delete(after);
+    }
+    FINISH_USING_TEST_DATA;
+    FREE_TEST_DATA(previous);
+    FREE_TEST_DATA(current);
+    FREE_TEST_DATA(expect);
+}
+
+static void on_change(const char *path, uniconf_t previous, uniconf_t current, void *data)
+{
+    (void)previous;
+    (void)current;
+    char **fired = (char **)data;
+    char *temp = NULL;
+    asprintf(&temp, "%s[%s]", *fired ? *fired : "", path);
+    free(*fired);
+    *fired = temp;
+}
+
+static void on_nested(const char *path, uniconf_t previous, uniconf_t current, void *data)
+{
+    (void)path;
+    (void)previous;
+    (void)current;
+    *(int *)data = uniconf_construct(HOME_PATH "config1");
+}
+
+static void test_versions(void)
+{
+    const char *first = "{\"db\": {\"host\": \"a\", \"ports\": [1, 2, 3]}, \"name\": \"x\"}";
+    const char *second = "{\"db\": {\"host\": \"b\", \"ports\": [1, 2]}, \"name\": \"x\", \"new/key\": 1}";
+    const char *third = "{\"db\": {\"host\": \"c\"}}";
+    uniconf_versions_keep(2);
+    uniconf_construct_buffer("json", first, strlen(first));
+    uint64_t v1 = uniconf_version();
+    uniconf_construct_buffer("json", second, strlen(second));
+    uint64_t v2 = uniconf_version();
+    uniconf_construct_buffer("json", third, strlen(third));
+    uniconf_construct_buffer("json", third, strlen(third)); // unchanged
+
+    uint64_t versions[4] = {0};
+    CU_ASSERT_EQUAL(2, uniconf_versions(versions, 4));
+    CU_ASSERT_EQUAL(v2, versions[0]);
+    CU_ASSERT_EQUAL(v1, versions[1]);
+
+    CU_ASSERT_EQUAL(0, uniconf_rollback(v1));
+    CU_ASSERT_EQUAL(v1, uniconf_version());
+    CU_ASSERT_STRING_EQUAL("a", uniconf_getString("db.host"));
+    CU_ASSERT_EQUAL(3, uniconf_getNumber("db.ports.2"));
+    CU_ASSERT_PTR_NULL(cJSON_GetObjectItem(uniconf_get_root(), "new/key"));
+
+    // the rolled back tree is the new version
+    CU_ASSERT_EQUAL(0, uniconf_rollback(v2));
+    CU_ASSERT_EQUAL(v2, uniconf_version());
+    CU_ASSERT_PTR_NULL(uniconf_getObject("db.ports.2"));
+    CU_ASSERT_EQUAL(-ENOENT, uniconf_rollback(12345));
+
+    // the rollbacks and the reads serialized with the async constructs pushing the versions
+    uniconf_versions_keep(4);
+    uniconf_construct(HOME_PATH "config1");
+    uint64_t v3 = uniconf_version();
+    for (int round = 0; round < 10; round++)
+    {
+        uniconf_async_t *async = uniconf_construct_async(NULL, NULL, HOME_PATH "config2");
+        int count = uniconf_versions(versions, 4);
+        CU_ASSERT_TRUE(count >= 1 && count <= 4);
+        int ret = uniconf_rollback(v3);
+        CU_ASSERT_TRUE(0 == ret || -ENOENT == ret);
+        uniconf_async_free(async);
+    }
+    CU_ASSERT_EQUAL(0, uniconf_rollback(v3));
+    CU_ASSERT_STRING_EQUAL("bar", uniconf_getString("foo"));
+
+    uniconf_versions_keep(0);
+    CU_ASSERT_EQUAL(0, uniconf_versions(NULL, 0));
+    uniconf_destruct();
+}
+
+static void test_subscribe(void)
+{
+    char *fired = NULL;
+    uniconf_construct(HOME_PATH "config1");
+
+    int foo = uniconf_subscribe(on_change, &fired, "foo");
+    int section = uniconf_subscribe(on_change, &fired, "section");
+    int bar = uniconf_subscribe(on_change, &fired, "%s.%s", "section", "bar");
+    CU_ASSERT_TRUE(foo > 0 && section > foo && bar > section);
+
+    uniconf_construct(HOME_PATH "config2");
+    CU_ASSERT_STRING_EQUAL("[section][section.bar]", fired);
+    FREE_TEST_DATA(fired);
+    fired = NULL;
+
+    uniconf_construct(HOME_PATH "config2");
+    CU_ASSERT_PTR_NULL(fired);
+
+    // the compact list of the previous tree, loaded after the construct, hashed on demand
+    uniconf_lazy(1);
+    uniconf_list_compact(1);
+    uniconf_construct(HOME_PATH "config18");
+    FREE_TEST_DATA(fired);
+    fired = NULL;
+    CU_ASSERT_TRUE(uniconf_listContains("acl.deny", "foo"));
+    int deny = uniconf_subscribe(on_change, &fired, "acl.deny");
+    uniconf_construct(HOME_PATH "config18");
+    CU_ASSERT_PTR_NULL(fired);
+    FREE_TEST_DATA(fired);
+    fired = NULL;
+    uniconf_unsubscribe(deny);
+    uniconf_lazy(0);
+    uniconf_list_compact(0);
+    uniconf_construct(HOME_PATH "config2");
+    FREE_TEST_DATA(fired);
+    fired = NULL;
+
+    // the construct from the subscriber fails, the tree is kept
+    int nested = 0;
+    int self = uniconf_subscribe(on_nested, &nested, "section.bar");
+    uniconf_construct(HOME_PATH "config1");
+    CU_ASSERT_EQUAL(-EDEADLK, nested);
+    CU_ASSERT_STRING_EQUAL("[section][section.bar]", fired);
+    FREE_TEST_DATA(fired);
+    fired = NULL;
+    uniconf_unsubscribe(self);
+    uniconf_construct(HOME_PATH "config2");
+    FREE_TEST_DATA(fired);
+    fired = NULL;
+
+    // subscribed and cancelled while the async constructs dispatch
+    int changes = 0;
+    int counter = uniconf_subscribe(on_count, &changes, "section.bar");
+    for (int round = 0; round < 20; round++)
+    {
+        uniconf_async_t *async = uniconf_construct_async(NULL, NULL, HOME_PATH "config%d", (round & 1) ? 2 : 1);
+        for (int i = 0; i < 50; i++)
+        {
+            CU_ASSERT_EQUAL(1, uniconf_unsubscribe(uniconf_subscribe(on_count, &changes, "foo")));
+        }
+        uniconf_async_free(async);
+    }
+    CU_ASSERT_EQUAL(20, changes);
+    uniconf_unsubscribe(counter);
+    FREE_TEST_DATA(fired);
+    fired = NULL;
+
+    CU_ASSERT_EQUAL(1, uniconf_unsubscribe(section));
+    CU_ASSERT_EQUAL(0, uniconf_unsubscribe(section));
+    uniconf_construct(HOME_PATH "config1");
+    CU_ASSERT_STRING_EQUAL("[section.bar]", fired);
+    FREE_TEST_DATA(fired);
+
+    uniconf_unsubscribe(foo);
+    uniconf_unsubscribe(bar);
+    uniconf_destruct();
+}
+
+static void test_query(void)
+{
+    char *path = NULL;
+    char *query = NULL;
+    char *expect = NULL;
+    START_USING_TEST_DATA(HOME_PATH)
+    {
+        USE_OF_THE_TEST_DATA("%ms '%m[^']' '%m[^']'", &path, &query, &expect);
+        printf("'%s' '%s'->'%s'", path, query, expect);
+        uniconf_construct(path);
+        uniconf_query_t *compiled = uniconf_query_compile("%s", query);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(compiled);
+        cJSON *matches = cJSON_CreateArray();
+        uniconf_cursor_t *cursor = uniconf_query_exec(compiled, NULL);
+        uniconf_ForEachMatch(match, cursor)
+        {
+            cJSON_AddItemToArray(matches, cJSON_Duplicate(match, 1));
+        }
+        uniconf_cursor_close(cursor);
+        uniconf_query_free(compiled);
+        char *actual = cJSON_PrintUnformatted(matches);
+        printf("<-'%s'\n", actual);
+        CU_ASSERT_STRING_EQUAL(expect, actual);
+        free(actual);
+        cJSON_Delete(matches);
+    }
+    FINISH_USING_TEST_DATA;
+    uniconf_destruct();
+    FREE_TEST_DATA(path);
+    FREE_TEST_DATA(query);
+    FREE_TEST_DATA(expect);
+}
 
 CU_TestInfo test_tree[] =
     {
@@ -139,6 +1238,31 @@ CU_TestInfo test_tree[] =
         {"(conf)", test_conf},
         {"(json)", test_json},
         {"(yml)", test_yml},
+        {"(getObject)", test_getObject},
+        {"(query)", test_query},
+        {"(environ)", test_environ},
+        {"(lazy)", test_lazy},
+        {"(bind)", test_bind},
+        {"(publish)", test_publish},
+        {"(compile)", test_compile},
+        {"(list)", test_list},
+        {"(intern)", test_intern},
+        {"(ignore case)", test_ignore_case},
+        {"(parsers)", test_parsers},
+        {"(sources)", test_sources},
+        {"(json errors)", test_json_errors},
+        {"(json large)", test_json_large},
+        {"(compressed)", test_compressed},
+        {"(layers)", test_layers},
+        {"(provenance)", test_provenance},
+        {"(trace)", test_trace},
+        {"(access)", test_access},
+        {"(budget)", test_budget},
+        {"(async)", test_async},
+        {"(hash)", test_hash},
+        {"(diff)", test_diff},
+        {"(versions)", test_versions},
+        {"(subscribe)", test_subscribe},
 
         CU_TEST_INFO_NULL,
 };
@@ -0,0 +1,663 @@
+/**
+ * The generator of the typed config bindings
+ *
+ * uniconf-gen <schema> <name> [outdir]
+ *
+ * The schema (any format uniconf reads) maps the config paths to the field types:
+ * {
+ *     "listen.port": {"type": "number", "default": 8080},
+ *     "listen.host": {"type": "string", "required": true},
+ *     "ratio":       {"type": "double"},
+ *     "debug":       {"type": "boolean"},
+ *     "upstreams":   {"type": "object"}
+ * }
+ *
+ * Emits <name>.h with the plain struct <name>_t and <name>.c with
+ * int <name>_bind(<name>_t *conf, uniconf_t root), which fills the struct by one walk
+ * of the tree. The paths and their prefixes are matched by the perfect hash
+ * found here, the branches out of the schema are not visited.
+ *
+ * @author Yurii Prudius [https://github.com/yuriimouse]
+ * @link https://github.com/yuriimouse/uniconf
+ **/
+
+#include "uniconf.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef enum
+{
+    FIELD_STRING,
+    FIELD_NUMBER,
+    FIELD_DOUBLE,
+    FIELD_BOOLEAN,
+    FIELD_OBJECT,
+} field_e;
+
+static const struct
+{
+    const char *name;
+    const char *ctype;
+} gen_field_types[] = {
+    [FIELD_STRING] = {"string", "const char *"},
+    [FIELD_NUMBER] = {"number", "long long "},
+    [FIELD_DOUBLE] = {"double", "double "},
+    [FIELD_BOOLEAN] = {"boolean", "int "},
+    [FIELD_OBJECT] = {"object", "uniconf_t "},
+};
+
+typedef struct gen_field
+{
+    char *path;
+    char *ident;
+    field_e type;
+    int required;
+    const cJSON *value; // the default
+} gen_field_t;
+
+typedef struct gen_key
+{
+    char *path;
+    int field;  // -1 = the prefix only
+    int branch; // has longer paths
+} gen_key_t;
+
+#define SEED_TRIES 100000
+
+static gen_field_t *fields = NULL;
+static int fields_count = 0;
+static gen_key_t *keys = NULL;
+static int keys_count = 0;
+
+/**
+ * Hash the path, the same function is emitted to the generated code
+ *
+ * @param key
+ * @param seed
+ *
+ * @return uint32_t
+ */
+static uint32_t gen_hash(const char *key, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+    for (; *key; key++)
+    {
+        h ^= (unsigned char)*key;
+        h *= 16777619u;
+    }
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h;
+}
+
+/**
+ * Find the key
+ *
+ * @param path
+ * @param len
+ *
+ * @return gen_key_t* | NULL
+ */
+static gen_key_t *gen_key(const char *path, size_t len)
+{
+    for (int i = 0; i < keys_count; i++)
+    {
+        if (strlen(keys[i].path) == len && !strncmp(keys[i].path, path, len))
+        {
+            return &keys[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Add the path and all its prefixes to the keys
+ *
+ * @param path
+ * @param field
+ *
+ * @return int : <0 = error
+ */
+static int gen_keys(const char *path, int field)
+{
+    for (const char *dot = strchr(path, '.');; dot = strchr(dot + 1, '.'))
+    {
+        size_t len = dot ? (size_t)(dot - path) : strlen(path);
+        gen_key_t *key = gen_key(path, len);
+        if (!key)
+        {
+            gen_key_t *grown = realloc(keys, (keys_count + 1) * sizeof(gen_key_t));
+            if (!grown)
+            {
+                return -ENOMEM;
+            }
+            keys = grown;
+            key = &keys[keys_count++];
+            *key = (gen_key_t){.path = strndup(path, len), .field = -1};
+        }
+        if (!dot)
+        {
+            key->field = field;
+            break;
+        }
+        key->branch = 1;
+    }
+    return 0;
+}
+
+/**
+ * Make the C identifier of the path
+ *
+ * @param path
+ *
+ * @return char* must be freed
+ */
+static char *gen_ident(const char *path)
+{
+    char *ident = malloc(strlen(path) + 2);
+    if (ident)
+    {
+        char *ptr = ident;
+        if (isdigit(*path))
+        {
+            *ptr++ = '_';
+        }
+        for (; *path; path++)
+        {
+            *ptr++ = isalnum(*path) ? *path : '_';
+        }
+        *ptr = '\0';
+    }
+    return ident;
+}
+
+/**
+ * Read the fields of the schema
+ *
+ * @param schema
+ *
+ * @return int : the count of errors
+ */
+static int gen_fields(uniconf_t schema)
+{
+    int errors = 0;
+    uniconf_ForEach(item, schema)
+    {
+        if (!strcmp("errors", item->string))
+        {
+            continue;
+        }
+
+        const char *path = item->string;
+        cJSON *type = cJSON_GetObjectItemCaseSensitive(item, "type");
+        int found = -1;
+        for (size_t i = 0; cJSON_IsString(type) && i < sizeof(gen_field_types) / sizeof(gen_field_types[0]); i++)
+        {
+            found = strcmp(gen_field_types[i].name, type->valuestring) ? found : (int)i;
+        }
+        if (found < 0 || !*path || '.' == path[0] || '.' == path[strlen(path) - 1] || strstr(path, ".."))
+        {
+            fprintf(stderr, "%s: bad path or type\n", path);
+            errors++;
+            continue;
+        }
+
+        gen_field_t field = {
+            .path = strdup(path),
+            .ident = gen_ident(path),
+            .type = found,
+            .value = cJSON_GetObjectItemCaseSensitive(item, "default"),
+        };
+        cJSON *required = cJSON_GetObjectItemCaseSensitive(item, "required");
+        field.required = required && uniconf_asBoolean(required, &field.required) && field.required;
+
+        // the default must fit the type
+        union
+        {
+            long long number;
+            double real;
+            int boolean;
+            const char *string;
+        } value;
+        int fits = !field.value || (FIELD_STRING == found && uniconf_asString(field.value, &value.string)) ||
+                   (FIELD_NUMBER == found && uniconf_asNumber(field.value, &value.number)) ||
+                   (FIELD_DOUBLE == found && uniconf_asDouble(field.value, &value.real)) ||
+                   (FIELD_BOOLEAN == found && uniconf_asBoolean(field.value, &value.boolean));
+        if (!fits)
+        {
+            fprintf(stderr, "%s: the default is not %s\n", path, gen_field_types[found].name);
+            errors++;
+        }
+        for (int i = 0; i < fields_count; i++)
+        {
+            if (!strcmp(fields[i].ident, field.ident))
+            {
+                fprintf(stderr, "%s: the field '%s' is taken by '%s'\n", path, field.ident, fields[i].path);
+                errors++;
+            }
+        }
+
+        gen_field_t *grown = realloc(fields, (fields_count + 1) * sizeof(gen_field_t));
+        if (!grown || gen_keys(path, fields_count) < 0)
+        {
+            fprintf(stderr, "%s\n", strerror(ENOMEM));
+            return errors + 1;
+        }
+        fields = grown;
+        fields[fields_count++] = field;
+    }
+    return errors;
+}
+
+/**
+ * Find the seed without collisions
+ *
+ * @param size : power of 2, grows until found
+ *
+ * @return uint32_t the seed
+ */
+static uint32_t gen_perfect(uint32_t *size)
+{
+    for (;; *size <<= 1)
+    {
+        unsigned char *used = malloc(*size);
+        for (uint32_t seed = 1; used && seed < SEED_TRIES; seed++)
+        {
+            memset(used, 0, *size);
+            int i = 0;
+            for (; i < keys_count; i++)
+            {
+                uint32_t at = gen_hash(keys[i].path, seed) & (*size - 1);
+                if (used[at]++)
+                {
+                    break;
+                }
+            }
+            if (i == keys_count)
+            {
+                free(used);
+                return seed;
+            }
+        }
+        free(used);
+    }
+}
+
+/**
+ * Write the C string literal
+ *
+ * @param out
+ * @param str
+ */
+static void gen_literal(FILE *out, const char *str)
+{
+    fputc('"', out);
+    for (; *str; str++)
+    {
+        if ('"' == *str || '\\' == *str)
+        {
+            fprintf(out, "\\%c", *str);
+        }
+        else if (isprint((unsigned char)*str))
+        {
+            fputc(*str, out);
+        }
+        else
+        {
+            fprintf(out, "\\%03o", (unsigned char)*str);
+        }
+    }
+    fputc('"', out);
+}
+
+/**
+ * Write the header
+ *
+ * @param out
+ * @param name
+ */
+static void gen_header(FILE *out, const char *name)
+{
+    char *guard = gen_ident(name);
+    for (char *ptr = guard; *ptr; ptr++)
+    {
+        *ptr = toupper(*ptr);
+    }
+
+    fprintf(out, "#ifndef %s_CONF_H\n#define %s_CONF_H\n", guard, guard);
+    fprintf(out, "/**\n * Generated by uniconf-gen, do not edit\n *\n");
+    fprintf(out, " * Bind after each uniconf_construct(), the strings and objects live in the tree.\n **/\n\n");
+    fprintf(out, "#include <uniconf.h>\n\n");
+    fprintf(out, "typedef struct %s\n{\n", name);
+    for (int i = 0; i < fields_count; i++)
+    {
+        fprintf(out, "    %s%s; // %s\n", gen_field_types[fields[i].type].ctype, fields[i].ident, fields[i].path);
+    }
+    fprintf(out, "} %s_t;\n\n", name);
+    fprintf(out, "int %s_bind(%s_t *conf, uniconf_t root);\n\n", name, name);
+    fprintf(out, "#endif // %s_CONF_H\n", guard);
+    free(guard);
+}
+
+/**
+ * Write the default of the field
+ *
+ * @param out
+ * @param field
+ */
+static void gen_default(FILE *out, const gen_field_t *field)
+{
+    long long number = 0;
+    double real = 0;
+    int boolean = 0;
+    const char *string = NULL;
+
+    fprintf(out, "        .%s = ", field->ident);
+    switch (field->type)
+    {
+    case FIELD_STRING:
+        uniconf_asString(field->value, &string);
+        gen_literal(out, string);
+        break;
+    case FIELD_NUMBER:
+        uniconf_asNumber(field->value, &number);
+        fprintf(out, "%lldLL", number);
+        break;
+    case FIELD_DOUBLE:
+        uniconf_asDouble(field->value, &real);
+        fprintf(out, "%.17g", real);
+        break;
+    case FIELD_BOOLEAN:
+        uniconf_asBoolean(field->value, &boolean);
+        fprintf(out, "%d", boolean);
+        break;
+    case FIELD_OBJECT:
+        fprintf(out, "NULL");
+        break;
+    }
+    fprintf(out, ",\n");
+}
+
+/**
+ * Write the source
+ *
+ * @param out
+ * @param name
+ * @param seed
+ * @param size
+ */
+static void gen_source(FILE *out, const char *name, uint32_t seed, uint32_t size)
+{
+    char *upper = gen_ident(name);
+    for (char *ptr = upper; *ptr; ptr++)
+    {
+        *ptr = toupper(*ptr);
+    }
+    size_t longest = 0;
+    for (int i = 0; i < keys_count; i++)
+    {
+        longest = strlen(keys[i].path) > longest ? strlen(keys[i].path) : longest;
+    }
+
+    fprintf(out, "/**\n * Generated by uniconf-gen, do not edit\n **/\n\n");
+    fprintf(out, "#include \"%s.h\"\n\n#include <stdint.h>\n#include <stdio.h>\n#include <string.h>\n\n", name);
+    fprintf(out, "#define %s_SEED %uu\n#define %s_MASK %uu\n#define %s_PATH_MAX %zu\n\n", upper, seed, upper, size - 1, upper, longest);
+
+    // the keys in their slots
+    fprintf(out, "static const struct\n{\n    const char *path;\n    int field;\n    int branch;\n} %s_keys[%u] = {\n", name, size);
+    for (int i = 0; i < keys_count; i++)
+    {
+        fprintf(out, "    [%u] = {", gen_hash(keys[i].path, seed) & (size - 1));
+        gen_literal(out, keys[i].path);
+        fprintf(out, ", %d, %d},\n", keys[i].field, keys[i].branch);
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out,
+            "static uint32_t %s_hash(const char *key)\n"
+            "{\n"
+            "    uint32_t h = 2166136261u ^ %s_SEED;\n"
+            "    for (; *key; key++)\n"
+            "    {\n"
+            "        h ^= (unsigned char)*key;\n"
+            "        h *= 16777619u;\n"
+            "    }\n"
+            "    h ^= h >> 15;\n"
+            "    h *= 0x2c1b3c6du;\n"
+            "    h ^= h >> 12;\n"
+            "    return h;\n"
+            "}\n\n",
+            name, upper);
+
+    // the typed stores
+    fprintf(out, "static int %s_set(%s_t *conf, int field, const cJSON *item, const char *path)\n{\n    switch (field)\n    {\n", name, name);
+    for (int i = 0; i < fields_count; i++)
+    {
+        const char *call = NULL;
+        switch (fields[i].type)
+        {
+        case FIELD_STRING:
+            call = "uniconf_asString(item, &conf->%s)";
+            break;
+        case FIELD_NUMBER:
+            call = "uniconf_asNumber(item, &conf->%s)";
+            break;
+        case FIELD_DOUBLE:
+            call = "uniconf_asDouble(item, &conf->%s)";
+            break;
+        case FIELD_BOOLEAN:
+            call = "uniconf_asBoolean(item, &conf->%s)";
+            break;
+        case FIELD_OBJECT:
+            call = "uniconf_IsComplex(item) && (conf->%s = (uniconf_t)item)";
+            break;
+        }
+        fprintf(out, "    case %d:\n        if (!(", i);
+        fprintf(out, call, fields[i].ident);
+        fprintf(out, "))\n        {\n            return uniconf_bind_error(\"%s\", path, \"%s\", item);\n        }\n        break;\n",
+                name, gen_field_types[fields[i].type].name);
+    }
+    fprintf(out, "    }\n    return 0;\n}\n\n");
+
+    // the walk of the schema branches only
+    fprintf(out,
+            "static int %s_walk(%s_t *conf, const cJSON *node, char *path, size_t len, unsigned char *seen)\n"
+            "{\n"
+            "    int errors = 0;\n"
+            "    int index = -1;\n"
+            "    uniconf_ForEach(item, node)\n"
+            "    {\n"
+            "        char number[24];\n"
+            "        const char *name = item->string;\n"
+            "        index++;\n"
+            "        if (cJSON_IsArray(node))\n"
+            "        {\n"
+            "            snprintf(number, sizeof(number), \"%%d\", index);\n"
+            "            name = number;\n"
+            "        }\n"
+            "        size_t size = name ? strlen(name) : 0;\n"
+            "        if (!size || len + !!len + size > %s_PATH_MAX)\n"
+            "        {\n"
+            "            continue;\n"
+            "        }\n"
+            "        size_t at = len;\n"
+            "        if (len)\n"
+            "        {\n"
+            "            path[at++] = '.';\n"
+            "        }\n"
+            "        memcpy(path + at, name, size + 1);\n"
+            "\n"
+            "        int slot = %s_hash(path) & %s_MASK;\n"
+            "        if (%s_keys[slot].path && !strcmp(%s_keys[slot].path, path))\n"
+            "        {\n"
+            "            int field = %s_keys[slot].field;\n"
+            "            if (field >= 0)\n"
+            "            {\n"
+            "                errors += %s_set(conf, field, item, path);\n"
+            "                seen[field] = 1;\n"
+            "            }\n"
+            "            if (%s_keys[slot].branch && uniconf_IsComplex(item))\n"
+            "            {\n"
+            "                errors += %s_walk(conf, item, path, at + size, seen);\n"
+            "            }\n"
+            "        }\n"
+            "        path[len] = '\\0';\n"
+            "    }\n"
+            "    return errors;\n"
+            "}\n\n",
+            name, name, upper, name, upper, name, name, name, name, name, name);
+
+    // the bind
+    fprintf(out,
+            "/**\n"
+            " * Fill the struct from the tree, the defaults first\n"
+            " *\n"
+            " * @param conf\n"
+            " * @param root : NULL = the constructed root\n"
+            " *\n"
+            " * @return int : <0 = -count of errors (in the \"errors\" array), >=0 = count of bound fields\n"
+            " */\n"
+            "int %s_bind(%s_t *conf, uniconf_t root)\n"
+            "{\n"
+            "    static const %s_t defaults = {\n",
+            name, name, name);
+    int defaults = 0;
+    for (int i = 0; i < fields_count; i++)
+    {
+        if (fields[i].value)
+        {
+            gen_default(out, &fields[i]);
+            defaults++;
+        }
+    }
+    fprintf(out,
+            "%s"
+            "    };\n"
+            "    unsigned char seen[%d] = {0};\n"
+            "    char path[%s_PATH_MAX + 1] = \"\";\n"
+            "\n"
+            "    *conf = defaults;\n"
+            "    root = root ? root : uniconf_get_root();\n"
+            "    int errors = root ? %s_walk(conf, root, path, 0, seen) : 0;\n",
+            defaults ? "" : "        0,\n", fields_count, upper, name);
+    for (int i = 0; i < fields_count; i++)
+    {
+        if (fields[i].required)
+        {
+            fprintf(out, "    errors += seen[%d] ? 0 : uniconf_bind_error(\"%s\", ", i, name);
+            gen_literal(out, fields[i].path);
+            fprintf(out, ", \"%s\", NULL);\n", gen_field_types[fields[i].type].name);
+        }
+    }
+    fprintf(out, "\n    int count = 0;\n    for (int i = 0; i < %d; i++)\n    {\n        count += seen[i];\n    }\n", fields_count);
+    fprintf(out, "    return errors ? -errors : count;\n}\n");
+    free(upper);
+}
+
+/**
+ * Write the file
+ *
+ * @param dir
+ * @param name
+ * @param ext
+ * @param seed
+ * @param size
+ *
+ * @return int : 0 = success
+ */
+static int gen_file(const char *dir, const char *name, const char *ext, uint32_t seed, uint32_t size)
+{
+    char *filepath = NULL;
+    if (asprintf(&filepath, "%s/%s.%s", dir, name, ext) < 0)
+    {
+        return -ENOMEM;
+    }
+    FILE *out = fopen(filepath, "w");
+    if (!out)
+    {
+        int ret = -errno;
+        fprintf(stderr, "%s: %s\n", filepath, strerror(-ret));
+        free(filepath);
+        return ret;
+    }
+    if (!strcmp("h", ext))
+    {
+        gen_header(out, name);
+    }
+    else
+    {
+        gen_source(out, name, seed, size);
+    }
+    fclose(out);
+    free(filepath);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <schema> <name> [outdir]\n", argv[0]);
+        return 2;
+    }
+    const char *name = argv[2];
+    const char *dir = argc > 3 ? argv[3] : ".";
+    for (const char *ptr = name; *ptr; ptr++)
+    {
+        if (!(isalnum(*ptr) || '_' == *ptr) || isdigit(*name))
+        {
+            fprintf(stderr, "%s: the name must be the C identifier\n", name);
+            return 2;
+        }
+    }
+
+    int ret = uniconf_construct("%s", argv[1]);
+    if (ret < 0)
+    {
+        fprintf(stderr, "%s: %s\n", argv[1], strerror(-ret));
+        return 1;
+    }
+    uniconf_t schema = uniconf_get_root();
+    int errors = 0;
+    uniconf_ForEach(error, cJSON_GetObjectItemCaseSensitive(schema, "errors"))
+    {
+        fprintf(stderr, "%s\n", error->valuestring);
+        errors++;
+    }
+    errors += gen_fields(schema);
+    if (!errors && !fields_count)
+    {
+        fprintf(stderr, "%s: no fields\n", argv[1]);
+        errors++;
+    }
+
+    if (!errors)
+    {
+        uint32_t size = 1;
+        while (size < (uint32_t)keys_count)
+        {
+            size <<= 1;
+        }
+        uint32_t seed = gen_perfect(&size);
+        errors = gen_file(dir, name, "h", seed, size) || gen_file(dir, name, "c", seed, size);
+    }
+
+    for (int i = 0; i < fields_count; i++)
+    {
+        free(fields[i].path);
+        free(fields[i].ident);
+    }
+    free(fields);
+    for (int i = 0; i < keys_count; i++)
+    {
+        free(keys[i].path);
+    }
+    free(keys);
+    uniconf_destruct();
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,422 @@
+/**
+ * The command line tool
+ *
+ * uniconf get <source> <path>          print the value
+ * uniconf query <source> <query>       print the matches
+ * uniconf dump <source>                print the effective tree
+ * uniconf check <source>               print the errors, exit 1 on errors
+ * uniconf compile <source> <output>    write the compiled snapshot
+ * uniconf embed <source> <name> [dir]  write <name>.h and <name>.c with the snapshot as the const data
+ * uniconf profile <source>             print the per-file parse time, memory and substitutions
+ *
+ * The source is the config directory, the file or the compiled snapshot.
+ *
+ * @author Yurii Prudius [https://github.com/yuriimouse]
+ * @link https://github.com/yuriimouse/uniconf
+ **/
+
+#include "uniconf.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+
+static long long cli_allocated = 0;
+static long long cli_mark = 0;
+
+/**
+ * Count the tree memory
+ *
+ * @param size
+ *
+ * @return void*
+ */
+static void *cli_malloc(size_t size)
+{
+    void *ptr = malloc(size);
+    if (ptr)
+    {
+        cli_allocated += malloc_usable_size(ptr);
+    }
+    return ptr;
+}
+
+/**
+ * Count the tree memory
+ *
+ * @param ptr
+ */
+static void cli_free(void *ptr)
+{
+    if (ptr)
+    {
+        cli_allocated -= malloc_usable_size(ptr);
+        free(ptr);
+    }
+}
+
+/**
+ * Load the source
+ *
+ * @param source
+ *
+ * @return int : <0 = error
+ */
+static int cli_load(const char *source)
+{
+    int ret = uniconf_attach_file(source);
+    if (ret < 0)
+    {
+        ret = uniconf_construct("%s", source);
+    }
+    if (ret < 0)
+    {
+        fprintf(stderr, "%s: %s\n", source, strerror(-ret));
+    }
+    return ret;
+}
+
+/**
+ * Print the node
+ *
+ * @param node
+ */
+static void cli_print(const cJSON *node)
+{
+    if (cJSON_IsString(node))
+    {
+        printf("%s\n", node->valuestring);
+    }
+    else if (cJSON_IsNumber(node) && node->valuedouble == (double)(long long)node->valuedouble)
+    {
+        printf("%lld\n", (long long)node->valuedouble);
+    }
+    else
+    {
+        char *text = cJSON_Print(node);
+        if (text)
+        {
+            printf("%s\n", text);
+            free(text);
+        }
+    }
+}
+
+/**
+ * Print the value by the path
+ *
+ * @param source
+ * @param path
+ *
+ * @return int : the exit code
+ */
+static int cli_get(const char *source, const char *path)
+{
+    if (cli_load(source) < 0)
+    {
+        return 1;
+    }
+    uniconf_t node = uniconf_getObject("%s", path);
+    if (!node)
+    {
+        fprintf(stderr, "%s: not found\n", path);
+        return 1;
+    }
+    cli_print(node);
+    return 0;
+}
+
+/**
+ * Print the matches of the query
+ *
+ * @param source
+ * @param text
+ *
+ * @return int : the exit code
+ */
+static int cli_query(const char *source, const char *text)
+{
+    uniconf_query_t *query = uniconf_query_compile("%s", text);
+    if (!query)
+    {
+        fprintf(stderr, "%s: bad query\n", text);
+        return 2;
+    }
+    int count = 0;
+    if (cli_load(source) >= 0)
+    {
+        uniconf_cursor_t *cursor = uniconf_query_exec(query, uniconf_getObject(""));
+        uniconf_ForEachMatch(match, cursor)
+        {
+            cli_print(match);
+            count++;
+        }
+        uniconf_cursor_close(cursor);
+    }
+    uniconf_query_free(query);
+    return count ? 0 : 1;
+}
+
+/**
+ * Print the effective tree
+ *
+ * @param source
+ *
+ * @return int : the exit code
+ */
+static int cli_dump(const char *source)
+{
+    if (cli_load(source) < 0)
+    {
+        return 1;
+    }
+    cli_print(uniconf_getObject(""));
+    return 0;
+}
+
+/**
+ * Print the errors and warnings
+ *
+ * @param source
+ *
+ * @return int : the exit code, 1 = errors found
+ */
+static int cli_check(const char *source)
+{
+    if (cli_load(source) < 0)
+    {
+        return 1;
+    }
+    int errors = 0;
+    int warnings = 0;
+    uniconf_ForEach(message, uniconf_getObject("errors"))
+    {
+        const char *text = cJSON_IsString(message) ? message->valuestring : "";
+        fprintf(stderr, "%s\n", text);
+        if (!strncmp("WARNING", text, strlen("WARNING")))
+        {
+            warnings++;
+        }
+        else
+        {
+            errors++;
+        }
+    }
+    printf("%s: %d errors, %d warnings\n", source, errors, warnings);
+    return errors ? 1 : 0;
+}
+
+/**
+ * Write the compiled snapshot
+ *
+ * @param source
+ * @param output
+ *
+ * @return int : the exit code
+ */
+static int cli_compile(const char *source, const char *output)
+{
+    int ret = uniconf_construct("%s", source);
+    if (ret >= 0)
+    {
+        ret = uniconf_compile(output);
+    }
+    if (ret < 0)
+    {
+        fprintf(stderr, "%s: %s\n", ret == -EINVAL ? source : output, strerror(-ret));
+        return 1;
+    }
+    printf("%s: %d nodes\n", output, ret);
+    return 0;
+}
+
+/**
+ * Write the snapshot as the const data for uniconf_mount()
+ *
+ * @param source
+ * @param name : the C identifier
+ * @param dir
+ *
+ * @return int : the exit code
+ */
+static int cli_embed(const char *source, const char *name, const char *dir)
+{
+    for (const char *ptr = name; *ptr; ptr++)
+    {
+        if (!(isalnum(*ptr) || '_' == *ptr) || isdigit(*name))
+        {
+            fprintf(stderr, "%s: the name must be the C identifier\n", name);
+            return 2;
+        }
+    }
+    int loaded = uniconf_construct("%s", source);
+    if (loaded < 0)
+    {
+        fprintf(stderr, "%s: %s\n", source, strerror(-loaded));
+        return 1;
+    }
+    size_t size = 0;
+    unsigned char *image = uniconf_compile_image(&size);
+    if (!image)
+    {
+        fprintf(stderr, "%s: %s\n", source, strerror(size ? ENOMEM : EINVAL));
+        return 1;
+    }
+
+    char *guard = strdup(name);
+    for (char *ptr = guard; ptr && *ptr; ptr++)
+    {
+        *ptr = toupper(*ptr);
+    }
+    int ret = 0;
+    char *path = NULL;
+    asprintf(&path, "%s/%s.h", dir, name);
+    FILE *file = (path && guard) ? fopen(path, "w") : NULL;
+    if (file)
+    {
+        fprintf(file,
+                "// generated by uniconf embed from %s\n"
+                "#ifndef %s_H\n"
+                "#define %s_H\n\n"
+                "#include <stddef.h>\n\n"
+                "// uniconf_mount(%s, %s_size)\n"
+                "extern const unsigned char %s[];\n"
+                "extern const size_t %s_size;\n\n"
+                "#endif\n",
+                source, guard, guard, name, name, name, name);
+        ret |= fclose(file);
+    }
+    else
+    {
+        ret = -1;
+    }
+    free(path);
+    path = NULL;
+
+    asprintf(&path, "%s/%s.c", dir, name);
+    file = path && !ret ? fopen(path, "w") : NULL;
+    if (file)
+    {
+        fprintf(file, "// generated by uniconf embed from %s\n#include \"%s.h\"\n\n", source, name);
+        // the image is read in place: aligned for its fields, in the read-only data
+        fprintf(file, "__attribute__((aligned(8))) const unsigned char %s[] = {", name);
+        for (size_t i = 0; i < size; i++)
+        {
+            fprintf(file, "%s0x%02x,", (i % 16) ? " " : "\n    ", image[i]);
+        }
+        fprintf(file, "\n};\nconst size_t %s_size = %zu;\n", name, size);
+        ret |= fclose(file);
+    }
+    else
+    {
+        ret = -1;
+    }
+    if (ret)
+    {
+        fprintf(stderr, "%s: %s\n", path ? path : dir, strerror(errno));
+    }
+    else
+    {
+        printf("%s/%s.c: %zu bytes\n", dir, name, size);
+    }
+    free(path);
+    free(guard);
+    free(image);
+    return ret ? 1 : 0;
+}
+
+/**
+ * Print the stats of the file
+ *
+ * @param stats
+ * @param data
+ */
+static void cli_stats(const uniconf_file_stats_t *stats, void *data)
+{
+    (void)data;
+    printf("%10.3f %12lld %8d %8zu  %s\n", stats->nanoseconds / 1e6, cli_allocated - cli_mark, stats->count, stats->substitutions, stats->filepath);
+    cli_mark = cli_allocated;
+}
+
+/**
+ * Print the per-file parse time, memory and substitutions
+ *
+ * @param source
+ *
+ * @return int : the exit code
+ */
+static int cli_profile(const char *source)
+{
+    cJSON_Hooks hooks = {.malloc_fn = cli_malloc, .free_fn = cli_free};
+    cJSON_InitHooks(&hooks);
+    uniconf_profile(cli_stats, NULL);
+
+    printf("%10s %12s %8s %8s  %s\n", "ms", "bytes", "count", "subst", "file");
+    int ret = uniconf_construct("%s", source);
+    uniconf_profile(NULL, NULL);
+    if (ret < 0)
+    {
+        fprintf(stderr, "%s: %s\n", source, strerror(-ret));
+        return 1;
+    }
+    printf("total: %lld bytes of the tree\n", cli_allocated);
+    return 0;
+}
+
+static void cli_usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s <command> <source> [argument]\n"
+            "  get <source> <path>\n"
+            "  query <source> <query>\n"
+            "  dump <source>\n"
+            "  check <source>\n"
+            "  compile <source> <output>\n"
+            "  embed <source> <name> [dir]\n"
+            "  profile <source>\n",
+            name);
+}
+
+int main(int argc, char *argv[])
+{
+    int ret = 2;
+    const char *command = argc > 2 ? argv[1] : "";
+    if (!strcmp("get", command) && 4 == argc)
+    {
+        ret = cli_get(argv[2], argv[3]);
+    }
+    else if (!strcmp("query", command) && 4 == argc)
+    {
+        ret = cli_query(argv[2], argv[3]);
+    }
+    else if (!strcmp("dump", command) && 3 == argc)
+    {
+        ret = cli_dump(argv[2]);
+    }
+    else if (!strcmp("check", command) && 3 == argc)
+    {
+        ret = cli_check(argv[2]);
+    }
+    else if (!strcmp("compile", command) && 4 == argc)
+    {
+        ret = cli_compile(argv[2], argv[3]);
+    }
+    else if (!strcmp("embed", command) && (4 == argc || 5 == argc))
+    {
+        ret = cli_embed(argv[2], argv[3], 5 == argc ? argv[4] : ".");
+    }
+    else if (!strcmp("profile", command) && 3 == argc)
+    {
+        ret = cli_profile(argv[2]);
+    }
+    else
+    {
+        cli_usage(argv[0]);
+    }
+
+    uniconf_detach();
+    uniconf_destruct();
+    return ret;
+}